@@ -1,112 +1,661 @@
+#include <unistd.h>
+
+#include <map>
+#include <memory>
+#include <random>
 #include <thread>
+#include <vector>
 
 #include "bench_util.h"
-#include "zipf.h"
+#include "perf_counters.h"
+#include "report.h"
+#include "workload.h"
 #include "include/engine.h"
+#include "include/segment.h"
 
 #define MAX_THREAD 64
-#define OP_PER_THREAD 200000ull
-#define KEY_SPACE (OP_PER_THREAD * 4)
-#define KEY_SIZE 8
-#define VALUE_SIZE 4096
 
 using namespace polar_race;
 
-int threadNR = 1;
-int readNR = 100;
-bool isSkew = 0;
+static const char *op_names[OP_NR] = {"read", "update", "insert", "scan",
+                                      "rmw"};
+
+struct Config {
+    std::string workload = "custom";
+    Mix mix;
+    double theta = 0.99;
+    int threads = 1;
+    uint64_t records = 100000;
+    SizeDist key_size = {8, 8};
+    SizeDist value_size = {4096, 4096};
+    int scan_len = 100;
+    double warmup = 2;
+    double duration = 10;
+    uint64_t ops = 0;  // per thread; 0 runs for duration instead
+    int shards = 1;  // as Options; 0 is one per hardware thread
+    bool reopen = true;
+    std::string json;
+    double rate = 0;  // offered ops/s over all threads; 0 is closed loop
+    bool poisson = true;
+    std::vector<double> sweep;  // offered loads to step through
+    std::string op_trace;
+    bool perf = false;
+    // Engines to run one after another on the same data set, each
+    // "name" or "name@shards"; empty is the default engine
+    std::vector<std::string> engines = {""};
+    uint64_t stall_ns = 0;
+    bool ingest = false;  // preload through SegmentBuilder and Ingest
+    bool numa = false;
+    size_t hot_cache = 0;  // bytes
+} cfg;
+
+enum Phase { WARMUP, MEASURE, STOP };
+
+struct Worker {
+    OpLatency lat;
+    std::atomic<uint64_t> done;  // measured ops, read by the timeline
+    PerfValues perf;
+    char pad[64];
+};
 
 Engine *engine = NULL;
+std::atomic<uint64_t> n_keys;
+std::atomic<int> phase;
+Worker workers[MAX_THREAD];
 
 void usage() {
     fprintf(stderr,
-            "Usage: ./bench thread_num[1-64] read_ratio[0-100] isSkew[0|1] \n");
+            "Usage: ./bench [--workload=a|b|c|d|e|f] [--read=0-100] "
+            "[--dist=uniform|zipf|latest]\n"
+            "               [--theta=0.99] [--threads=1-64] [--records=N] "
+            "[--key_size=N|A-B]\n"
+            "               [--value_size=N|A-B] [--scan_len=N] "
+            "[--warmup=SEC] [--duration=SEC]\n"
+            "               [--ops=N] [--shards=N] [--reopen=0|1] "
+            "[--json=FILE]\n"
+            "               [--rate=OPS_PER_SEC] [--arrival=poisson|constant] "
+            "[--sweep=R1,R2,...]\n"
+            "               [--op_trace=FILE] [--perf=0|1] "
+            "[--engines=NAME[@SHARDS],...]\n"
+            "               [--stall_us=N] [--load=write|ingest] "
+            "[--numa=0|1] [--hot_cache=MB]\n"
+            "       ./bench thread_num[1-64] read_ratio[0-100] isSkew[0|1]\n");
     exit(-1);
 }
 
+void set_read_ratio(int r) {
+    if (r < 0 || r > 100) usage();
+    memset(cfg.mix.ratio, 0, sizeof(cfg.mix.ratio));
+    cfg.mix.ratio[OP_READ] = r / 100.0;
+    cfg.mix.ratio[OP_UPDATE] = 1 - r / 100.0;
+    cfg.workload = "custom";
+}
+
 void parseArgs(int argc, char **argv) {
-    if (argc != 4) {
-        usage();
-    }
-    threadNR = std::atoi(argv[1]);
-    readNR = std::atoi(argv[2]);
-    int k = std::atoi(argv[3]);
-    isSkew = k;
-
-    if (threadNR <= 0 || threadNR > 64) usage();
-    if (readNR < 0 || readNR > 100) usage();
-    if (k != 0 && k != 1) usage();
-
-    fprintf(stdout, "thread_num: %d, read ratio: %d%%, isSkew: %s\n", threadNR,
-            readNR, isSkew ? "true" : "false");
-}
-
-void bench_thread(int id) {
-
-    struct zipf_gen_state state;
-    unsigned int seed = asm_rdtsc() + id;
-
-    char v[5000];
-    std::string value;
-    gen_random(v, 4096);
-    mehcached_zipf_init(&state, KEY_SPACE, isSkew ? 0.99 : 0,
-                        asm_rdtsc() >> 17);
-    for (int i = 0; i < OP_PER_THREAD; ++i) {
-        bool isRead = (rand_r(&seed) % 100) < readNR;
-        uint64_t key = mehcached_zipf_next(&state);
-        PolarString k((char *)&key, sizeof(uint64_t));
-        if (isRead) {
-            engine->Read(k, &value);
+    set_read_ratio(100);
+    cfg.mix.dist = DIST_UNIFORM;
+
+    // The original positional form
+    if (argc == 4 && argv[1][0] != '-') {
+        cfg.threads = std::atoi(argv[1]);
+        set_read_ratio(std::atoi(argv[2]));
+        int k = std::atoi(argv[3]);
+        if (k != 0 && k != 1) usage();
+        cfg.mix.dist = k ? DIST_ZIPF : DIST_UNIFORM;
+        cfg.ops = 200000;
+        if (cfg.threads <= 0 || cfg.threads > MAX_THREAD) usage();
+        return;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) usage();
+        std::string k = arg.substr(2, eq - 2);
+        const char *v = argv[i] + eq + 1;
+        if (k == "workload") {
+            if (strlen(v) != 1 || !ycsb_mix(v[0], &cfg.mix)) usage();
+            cfg.workload = v;
+        } else if (k == "read") {
+            set_read_ratio(std::atoi(v));
+        } else if (k == "dist") {
+            std::string d(v);
+            if (d == "uniform") cfg.mix.dist = DIST_UNIFORM;
+            else if (d == "zipf") cfg.mix.dist = DIST_ZIPF;
+            else if (d == "latest") cfg.mix.dist = DIST_LATEST;
+            else usage();
+        } else if (k == "theta") {
+            cfg.theta = std::atof(v);
+        } else if (k == "threads") {
+            cfg.threads = std::atoi(v);
+        } else if (k == "records") {
+            cfg.records = std::strtoull(v, NULL, 10);
+        } else if (k == "key_size") {
+            if (!cfg.key_size.parse(v)) usage();
+        } else if (k == "value_size") {
+            if (!cfg.value_size.parse(v)) usage();
+        } else if (k == "scan_len") {
+            cfg.scan_len = std::atoi(v);
+        } else if (k == "warmup") {
+            cfg.warmup = std::atof(v);
+        } else if (k == "duration") {
+            cfg.duration = std::atof(v);
+        } else if (k == "ops") {
+            cfg.ops = std::strtoull(v, NULL, 10);
+        } else if (k == "shards") {
+            cfg.shards = std::atoi(v);
+        } else if (k == "reopen") {
+            cfg.reopen = std::atoi(v);
+        } else if (k == "json") {
+            cfg.json = v;
+        } else if (k == "engines") {
+            cfg.engines.clear();
+            std::string list(v);
+            for (size_t b = 0, e; b <= list.size(); b = e + 1) {
+                e = list.find(',', b);
+                if (e == std::string::npos) e = list.size();
+                if (e == b) usage();
+                cfg.engines.push_back(list.substr(b, e - b));
+            }
+        } else if (k == "load") {
+            std::string l(v);
+            if (l == "write") cfg.ingest = false;
+            else if (l == "ingest") cfg.ingest = true;
+            else usage();
+        } else if (k == "stall_us") {
+            cfg.stall_ns = std::strtoull(v, NULL, 10) * 1000;
+        } else if (k == "perf") {
+            cfg.perf = std::atoi(v);
+        } else if (k == "numa") {
+            cfg.numa = std::atoi(v);
+        } else if (k == "hot_cache") {
+            cfg.hot_cache = std::strtoull(v, NULL, 10) << 20;
+        } else if (k == "op_trace") {
+            cfg.op_trace = v;
+        } else if (k == "rate") {
+            cfg.rate = std::atof(v);
+        } else if (k == "arrival") {
+            std::string a(v);
+            if (a == "poisson") cfg.poisson = true;
+            else if (a == "constant") cfg.poisson = false;
+            else usage();
+        } else if (k == "sweep") {
+            for (const char *p = v; *p; ++p) {
+                cfg.sweep.push_back(std::atof(p));
+                if (cfg.sweep.back() <= 0) usage();
+                p = strchr(p, ',');
+                if (p == NULL) break;
+            }
         } else {
-            engine->Write(k, v);
+            usage();
         }
     }
+    if (cfg.threads <= 0 || cfg.threads > MAX_THREAD) usage();
+    if (cfg.records == 0 || cfg.scan_len <= 0) usage();
+    if (cfg.theta < 0 || cfg.theta >= 1) usage();
+    if (cfg.rate < 0) usage();
 }
 
-int main(int argc, char **argv) {
-    parseArgs(argc, argv);
+class CountVisitor : public Visitor {
+public:
+    uint64_t n = 0;
+    void Visit(const PolarString &key, const PolarString &value) override {
+        ++n;
+    }
+};
 
-    system("mkdir -p data");
-    std::string engine_path =
-        std::string("./data/test-") + std::to_string(asm_rdtsc());
-    printf("open engine_path: %s\n", engine_path.c_str());
+// Per-thread source of value bytes: a random buffer of twice the largest
+// value, sliced at a random offset
+struct ValueSource {
+    std::vector<char> buf;
+    unsigned seed;
 
-    RetCode ret = Engine::Open(engine_path, &engine);
+    explicit ValueSource(unsigned s) : buf(cfg.value_size.hi * 2 + 1), seed(s) {
+        gen_random(buf.data(), buf.size() - 1);
+    }
+    PolarString next() {
+        uint32_t len = cfg.value_size.pick(rand_r(&seed));
+        return PolarString(buf.data() + rand_r(&seed) % (cfg.value_size.hi + 1),
+                           len);
+    }
+};
+
+// Seeded by thread so every engine is loaded with the same value sizes
+void load_thread(int id) {
+    ValueSource values(id + 1);
+    char k[1024];
+    for (uint64_t i = id; i < cfg.records; i += cfg.threads) {
+        size_t len = make_key(i, cfg.key_size, k);
+        engine->Write(PolarString(k, len), values.next());
+    }
+}
+
+// The same records as load_thread, built offline into segments and
+// ingested. False if the engine cannot ingest.
+bool ingest_load(const std::string &engine_path, int shards) {
+    std::string dir = engine_path + "-segments";
+    system(("mkdir -p " + dir).c_str());
+    SegmentBuilder *builder = NULL;
+    RetCode ret = SegmentBuilder::Open(dir, shards, &builder);
+    assert(ret == kSucc);
+    std::vector<ValueSource> values;
+    for (int i = 0; i < cfg.threads; ++i) values.push_back(ValueSource(i + 1));
+    char k[1024];
+    for (uint64_t i = 0; i < cfg.records; ++i) {
+        size_t len = make_key(i, cfg.key_size, k);
+        builder->Add(PolarString(k, len), values[i % cfg.threads].next());
+    }
+    ret = builder->Finish();
     assert(ret == kSucc);
+    delete builder;
+    ret = engine->Ingest(dir);
+    system(("rm -rf " + dir).c_str());
+    if (ret == kNotSupported) {
+        printf("engine cannot ingest, loading with writes\n");
+        return false;
+    }
+    assert(ret == kSucc);
+    return true;
+}
 
-    char v[5000];
-    gen_random(v, 4096);
-    for (int i = 0; i < KEY_SPACE; i += 100) {
-        uint64_t key = i;
-        PolarString k((char *)&key, sizeof(uint64_t));
-        engine->Write(k, v);
+OpType pick_op(unsigned *seed) {
+    double r = rand_r(seed) / (RAND_MAX + 1.0), acc = 0;
+    for (int i = 0; i < OP_NR; ++i) {
+        acc += cfg.mix.ratio[i];
+        if (r < acc) return (OpType)i;
     }
-    delete engine;
+    return OP_READ;
+}
+
+void run_op(OpType op, KeyChooser &keys, ValueSource &values, unsigned *seed) {
+    static thread_local std::string value;
+    char k[1024], u[1024];
+    uint64_t id = op == OP_INSERT ? keys.insert() : keys.next();
+    PolarString key(k, make_key(id, cfg.key_size, k));
+    switch (op) {
+    case OP_READ:
+        engine->Read(key, &value);
+        break;
+    case OP_UPDATE:
+    case OP_INSERT:
+        engine->Write(key, values.next());
+        break;
+    case OP_SCAN: {
+        CountVisitor visitor;
+        uint64_t len = 1 + rand_r(seed) % cfg.scan_len;
+        PolarString upper(u, make_key(id + len, cfg.key_size, u));
+        engine->Range(key, upper, visitor);
+        break;
+    }
+    case OP_RMW:
+        engine->Read(key, &value);
+        engine->Write(key, values.next());
+        break;
+    default:
+        break;
+    }
+}
+
+// Intended start times of one thread in open-loop mode: exponential gaps
+// for a Poisson process, or a fixed gap
+class Arrivals {
+public:
+    Arrivals(double rate, uint64_t seed)
+        : gap_(1e9 / rate), rng_(seed), exp_(1.0) {}
 
+    uint64_t next(uint64_t t) {
+        return t + (uint64_t)(cfg.poisson ? exp_(rng_) * gap_ : gap_);
+    }
+    double gap() const { return gap_; }
+
+private:
+    double gap_;
+    std::mt19937_64 rng_;
+    std::exponential_distribution<double> exp_;
+};
+
+// rate is this thread's share of the offered load, 0 for closed loop.
+// Open loop never waits for the previous op to catch up with the
+// schedule, so a stall shows up as the queueing delay of every op that
+// was due during it, measured from its intended start.
+void bench_thread(int id, double rate) {
+    Worker &w = workers[id];
+    unsigned seed = asm_rdtsc() + id;
+    KeyChooser keys(cfg.mix.dist, cfg.theta, &n_keys, asm_rdtsc() >> 17);
+    ValueSource values(seed);
+    Arrivals arrivals(rate ? rate : 1, seed);
+    // Stagger the threads so constant arrivals do not come in bursts
+    uint64_t intended = now_ns() + arrivals.gap() * id / cfg.threads;
+    // Counts this thread over the measurement phase
+    std::unique_ptr<PerfCounters> counters(cfg.perf ? new PerfCounters() : NULL);
+    bool counting = false;
+
+    while (true) {
+        if (rate) {
+            intended = arrivals.next(intended);
+            wait_until(intended);
+        }
+        int p = phase.load();
+        if (p == STOP) break;
+        if (p == MEASURE && cfg.ops &&
+            w.done.load(std::memory_order_relaxed) >= cfg.ops) {
+            break;
+        }
+        if (p == MEASURE && counters && !counting) {
+            counters->start();
+            counting = true;
+        }
+        OpType op = pick_op(&seed);
+        uint64_t s = rate ? intended : now_ns();
+        run_op(op, keys, values, &seed);
+        if (p == MEASURE) {
+            w.lat.op[op].Record(now_ns() - s);
+            w.done.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (counting) w.perf = counters->stop();
+}
+
+uint64_t measured_ops() {
+    uint64_t n = 0;
+    for (int i = 0; i < cfg.threads; ++i) n += workers[i].done.load();
+    return n;
+}
+
+struct Result {
+    double offered;  // 0 for closed loop
+    uint64_t ops;
+    uint64_t elapsed;
+    OpLatency lat;
+    std::vector<uint64_t> timeline;  // throughput of every second
+    PerfValues perf;
+    std::vector<PerfValues> thread_perf;
+
+    double throughput() const { return ops * 1e9 / elapsed; }
+};
+
+// Warms up and measures the mix at one offered load
+void run_point(double rate, Result *r) {
+    for (int i = 0; i < cfg.threads; ++i) {
+        workers[i].lat = OpLatency();
+        workers[i].done = 0;
+        workers[i].perf = PerfValues();
+    }
     std::thread ths[MAX_THREAD];
+    phase = WARMUP;
+    for (int i = 0; i < cfg.threads; ++i) {
+        ths[i] = std::thread(bench_thread, i, rate / cfg.threads);
+    }
+    usleep(cfg.warmup * 1000000);
 
-    timespec s, e;
+    uint64_t start = now_ns(), last = 0, tick = start;
+    phase = MEASURE;
+    while (true) {
+        usleep(10000);
+        uint64_t now = now_ns(), n = measured_ops();
+        bool finished = cfg.ops ? n >= cfg.ops * cfg.threads
+                                : now - start >= cfg.duration * 1e9;
+        if (now - tick >= 1000000000ull || finished) {
+            r->timeline.push_back((n - last) * 1e9 / (now - tick));
+            last = n;
+            tick = now;
+        }
+        if (finished) break;
+    }
+    r->elapsed = now_ns() - start;
+    phase = STOP;
+    for (int i = 0; i < cfg.threads; ++i) ths[i].join();
 
-    clock_gettime(CLOCK_REALTIME, &s);
-    ret = Engine::Open(engine_path, &engine);
-    assert(ret == kSucc);
-    for (int i = 0; i < threadNR; ++i) {
-        ths[i] = std::thread(bench_thread, i);
+    r->offered = rate;
+    r->ops = measured_ops();
+    for (int i = 0; i < cfg.threads; ++i) {
+        r->lat.merge(workers[i].lat);
+        r->perf.add(workers[i].perf);
+        r->thread_perf.push_back(workers[i].perf);
     }
+}
+
+// Counters per operation, over all worker threads
+void print_perf(const Result &r) {
+    printf("per op:");
+    for (int i = 0; i < PERF_NR; ++i) {
+        if (r.perf.v[i] < 0) {
+            printf("  %s n/a", perf_names[i]);
+        } else {
+            printf("  %s %.2f", perf_names[i], (double)r.perf.v[i] / r.ops);
+        }
+    }
+    if (r.perf.v[PERF_CYCLES] > 0 && r.perf.v[PERF_INSTRUCTIONS] >= 0) {
+        printf("  ipc %.2f", (double)r.perf.v[PERF_INSTRUCTIONS] /
+                                 r.perf.v[PERF_CYCLES]);
+    }
+    printf("\n");
+}
 
-    for (int i = 0; i < threadNR; ++i) {
-        ths[i].join();
+std::string perf_json(const PerfValues &v, uint64_t ops) {
+    JsonWriter j;
+    for (int i = 0; i < PERF_NR; ++i) {
+        std::string name = std::string(perf_names[i]) + (ops ? "_per_op" : "");
+        if (v.v[i] < 0) {
+            j.raw(name, "null");
+        } else {
+            j.num(name, ops ? (double)v.v[i] / ops : v.v[i]);
+        }
     }
-    clock_gettime(CLOCK_REALTIME, &e);
+    return j.done();
+}
 
-    double us = (e.tv_sec - s.tv_sec) * 1000000 +
-                (double)(e.tv_nsec - s.tv_nsec) / 1000;
-    printf("%d thread, %d operations per thread, time: %lfus\n", threadNR, OP_PER_THREAD, us);
-    printf("throughput %lf operations/s\n", 1ull * (threadNR * OP_PER_THREAD) * 1000000 / us);
+// Per-op totals, then the raw counts of every thread
+std::string perf_json(const Result &r) {
+    std::string threads = "[";
+    for (size_t i = 0; i < r.thread_perf.size(); ++i) {
+        threads += (i ? ", " : "") + perf_json(r.thread_perf[i], 0);
+    }
+    JsonWriter j;
+    j.raw("per_op", perf_json(r.perf, r.ops));
+    j.raw("threads", threads + "]");
+    return j.done();
+}
+
+std::string latency_json(const OpLatency &l) {
+    JsonWriter j;
+    for (int i = 0; i < OP_NR; ++i) {
+        if (l.op[i].count()) j.raw(op_names[i], hist_json(l.op[i]));
+    }
+    j.raw("all", hist_json(l.all()));
+    return j.done();
+}
+
+// Logged stalls by cause
+void print_stalls() {
+    std::vector<StallEvent> events;
+    if (engine->GetStallEvents(&events) != kSucc) return;
+    std::map<std::string, std::pair<uint64_t, uint64_t> > causes;
+    for (auto &e : events) {
+        auto &c = causes[e.op + " " + e.cause];
+        ++c.first;
+        c.second = std::max(c.second, e.duration_ns);
+    }
+    printf("stalls over %lu us (latest %lu):\n",
+           (unsigned long)(cfg.stall_ns / 1000), (unsigned long)events.size());
+    for (auto &c : causes) {
+        printf("  %-24s %8lu  max %9lu ns\n", c.first.c_str(),
+               (unsigned long)c.second.first, (unsigned long)c.second.second);
+    }
+}
+
+// Adds the results of one engine's run to out
+void results_json(const std::vector<Result> &results, JsonWriter *out) {
+    if (cfg.sweep.empty()) {
+        const Result &r = results[0];
+        out->num("offered", r.offered);
+        out->num("elapsed_s", r.elapsed / 1e9);
+        out->num("ops", r.ops);
+        out->num("throughput", r.throughput());
+        out->raw("latency", latency_json(r.lat));
+        out->raw("timeline", timeline_json(r.timeline));
+        if (cfg.perf) out->raw("perf", perf_json(r));
+    } else {
+        std::string sweep = "[";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result &r = results[i];
+            JsonWriter p;
+            p.num("offered", r.offered);
+            p.num("elapsed_s", r.elapsed / 1e9);
+            p.num("ops", r.ops);
+            p.num("throughput", r.throughput());
+            p.raw("latency", latency_json(r.lat));
+            p.raw("timeline", timeline_json(r.timeline));
+            if (cfg.perf) p.raw("perf", perf_json(r));
+            sweep += (i ? ",\n" : "\n") + p.done();
+        }
+        out->raw("sweep", sweep + "\n]");
+    }
+    out->raw("engine", engine_stats_json(engine));
+}
+
+// Loads, reopens and measures one engine, adding its results to out
+void run_engine(const std::string &spec, JsonWriter *out) {
+    Options options;
+    options.shards = cfg.shards;
+    options.op_trace = cfg.op_trace;
+    options.stall_threshold_ns = cfg.stall_ns;
+    options.numa = cfg.numa;
+    options.hot_cache_bytes = cfg.hot_cache;
+    size_t at = spec.find('@');
+    options.engine = spec.substr(0, at);
+    if (at != std::string::npos) options.shards = std::atoi(spec.c_str() + at + 1);
+    // Segments are built for a fixed shard count; 0 would let the engine
+    // pick, one per hardware thread
+    if (cfg.ingest && options.shards == 0) {
+        options.shards = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    if (spec.size()) printf("engine: %s\n", spec.c_str());
+
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    printf("open engine_path: %s\n", engine_path.c_str());
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    if (ret != kSucc) {
+        fprintf(stderr, "cannot open engine %s: %d\n", spec.c_str(), ret);
+        exit(-1);
+    }
+
+    uint64_t load_start = now_ns();
+    bool ingested = cfg.ingest && ingest_load(engine_path, options.shards);
+    if (!ingested) {
+        std::thread ths[MAX_THREAD];
+        for (int i = 0; i < cfg.threads; ++i) ths[i] = std::thread(load_thread, i);
+        for (int i = 0; i < cfg.threads; ++i) ths[i].join();
+    }
+    double load_s = (now_ns() - load_start) / 1e9;
+    printf("load: %lu records in %.3lfs by %s\n", (unsigned long)cfg.records,
+           load_s, ingested ? "ingest" : "write");
+    out->str("load", ingested ? "ingest" : "write");
+    out->num("load_s", load_s);
+    n_keys = cfg.records;
+
+    if (cfg.reopen) {
+        delete engine;
+        ret = Engine::Open(engine_path, options, &engine);
+        assert(ret == kSucc);
+    }
+
+    std::vector<Result> results;
+    if (cfg.sweep.empty()) {
+        results.resize(1);
+        run_point(cfg.rate, &results[0]);
+        const Result &r = results[0];
+        if (r.offered) printf("offered %lf operations/s\n", r.offered);
+        printf("%d thread, %lu operations, time: %lfus\n", cfg.threads,
+               (unsigned long)r.ops, r.elapsed / 1e3);
+        printf("throughput %lf operations/s\n", r.throughput());
+        for (int i = 0; i < OP_NR; ++i) print_hist(op_names[i], r.lat.op[i]);
+        if (cfg.perf) print_perf(r);
+    } else {
+        // Latency against throughput, one line per offered load
+        results.resize(cfg.sweep.size());
+        printf("%12s %12s %9s %9s %9s %9s (ns)\n", "offered", "achieved",
+               "p50", "p99", "p999", "max");
+        for (size_t i = 0; i < cfg.sweep.size(); ++i) {
+            run_point(cfg.sweep[i], &results[i]);
+            const Result &r = results[i];
+            Histogram all = r.lat.all();
+            printf("%12.0f %12.0f %9lu %9lu %9lu %9lu\n", r.offered,
+                   r.throughput(), (unsigned long)all.Percentile(0.5),
+                   (unsigned long)all.Percentile(0.99),
+                   (unsigned long)all.Percentile(0.999),
+                   (unsigned long)all.max());
+            if (cfg.perf) print_perf(r);
+            fflush(stdout);
+        }
+    }
+    if (cfg.stall_ns) print_stalls();
+    results_json(results, out);
 
     delete engine;
+    engine = NULL;
+
+    system((std::string("rm -rf ") + engine_path + "*").c_str());
+}
+
+int main(int argc, char **argv) {
+    parseArgs(argc, argv);
 
-    system((std::string("rm -rf ") + engine_path).c_str());
+    printf("workload: %s, threads: %d, records: %lu, key size: %s, "
+           "value size: %s\n",
+           cfg.workload.c_str(), cfg.threads, (unsigned long)cfg.records,
+           cfg.key_size.str().c_str(), cfg.value_size.str().c_str());
+
+    system("mkdir -p data");
+
+    JsonWriter out;
+    out.str("revision", git_revision());
+    if (cfg.engines.size() == 1) {
+        out.str("engine_name", cfg.engines[0]);
+        run_engine(cfg.engines[0], &out);
+    } else {
+        // Side by side, one entry per engine
+        std::string runs = "[";
+        for (size_t i = 0; i < cfg.engines.size(); ++i) {
+            JsonWriter run;
+            run.str("engine_name", cfg.engines[i]);
+            run_engine(cfg.engines[i], &run);
+            runs += (i ? ",\n" : "\n") + run.done();
+        }
+        out.raw("runs", runs + "\n]");
+    }
+
+    if (cfg.json.size()) {
+        JsonWriter conf;
+        conf.str("workload", cfg.workload);
+        for (int i = 0; i < OP_NR; ++i) {
+            conf.num(std::string(op_names[i]) + "_ratio", cfg.mix.ratio[i]);
+        }
+        conf.str("dist", cfg.mix.dist == DIST_UNIFORM
+                             ? "uniform"
+                             : cfg.mix.dist == DIST_ZIPF ? "zipf" : "latest");
+        conf.num("theta", cfg.theta);
+        conf.num("threads", cfg.threads);
+        conf.num("records", cfg.records);
+        conf.str("key_size", cfg.key_size.str());
+        conf.str("value_size", cfg.value_size.str());
+        conf.num("scan_len", cfg.scan_len);
+        conf.num("warmup_s", cfg.warmup);
+        conf.num("shards", cfg.shards);
+        conf.num("numa", cfg.numa);
+        conf.num("hot_cache_mb", cfg.hot_cache >> 20);
+        conf.str("arrival", cfg.poisson ? "poisson" : "constant");
+        out.raw("config", conf.done());
+
+        FILE *f = fopen(cfg.json.c_str(), "w");
+        if (f == NULL) {
+            perror(cfg.json.c_str());
+        } else {
+            fprintf(f, "%s\n", out.done().c_str());
+            fclose(f);
+        }
+    }
 
     return 0;
 }
@@ -1,10 +1,6 @@
 #!/bin/bash
 
-bench=('bench.cc')
-
+# Rebuilds the library and the benchmarks with the same flags; pass make
+# variables through, e.g. `sh build.sh LOCK_PROFILE=1`
 rm -rf ./data/test-*
-for f in ${bench[@]}; do
-    exe=$(echo $f | cut -d . -f1)
-    echo $f
-    g++ -std=c++11 -o $exe -g -I.. $f  -L../lib -lengine -lpthread
-done
+make -C .. bench "$@"
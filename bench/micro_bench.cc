@@ -0,0 +1,396 @@
+#include <math.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench_util.h"
+#include "report.h"
+#include "engine_race/engine_race.h"
+
+using namespace polar_race;
+
+struct Config {
+    int reps = 15;
+    std::string filter;
+    std::vector<uint64_t> index_sizes = {1000, 100000, 1000000};
+    std::string json;
+} cfg;
+
+// Keeps the compiler from dropping a computation whose result is unused
+template <class T>
+inline void keep(const T &v) {
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+namespace polar_race {
+
+// Reaches into EngineRace for the steps below; a friend of it
+class EngineRaceProbe {
+public:
+    typedef decltype(EngineRace::lookup_long) LongIndex;
+    typedef decltype(EngineRace::lookup_short) ShortIndex;
+
+    explicit EngineRaceProbe(EngineRace *e) : e(e) {}
+
+    size_t allocMemory(size_t n) { return e->allocMemory(n); }
+    void copyToMemory(size_t idx, size_t ptr, const PolarString &k,
+                      const PolarString &v) {
+        e->copyToMemory(idx, ptr, k, v);
+    }
+    char *getMemory(size_t ptr) { return e->getMemory(ptr, true); }
+    void relieveMemory(size_t ptr) { e->relieveMemory(ptr); }
+
+    // Allocation position. Rewinding to it frees the chunks allocated
+    // since, as allocMemory only starts a chunk at offset 0 when it
+    // pushes a new one.
+    struct Position {
+        size_t p_current, sz_current, n_blks;
+    };
+    Position position() {
+        Position pos = {e->p_current, e->sz_current, e->datablks.size()};
+        return pos;
+    }
+    void rewind(const Position &pos) {
+        for (size_t i = pos.n_blks; i < e->datablks.size(); ++i) {
+            delete[] e->datablks[i].pmem;
+            delete e->datablks[i].op;
+        }
+        e->datablks.resize(pos.n_blks);
+        e->p_current = pos.p_current;
+        e->sz_current = pos.sz_current;
+    }
+
+    // Fills the journal with n records and times flush() alone
+    uint64_t flushBatch(const std::vector<std::string> &keys,
+                        const PolarString &value) {
+        std::lock_guard<ProfiledMutex> lck(e->journal_mtx);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            Item &it = e->journal[i];
+            it.szKey = keys[i].size();
+            it.szVal = value.size();
+            it.p = e->allocMemory(it.szKey + it.szVal);
+            e->copyToMemory(i, it.p, keys[i], value);
+        }
+        e->n_journal = keys.size();
+        uint64_t s = now_ns();
+        e->flush();
+        return now_ns() - s;
+    }
+
+    size_t syncedChunks() { return e->p_synced; }
+
+    // Drops a chunk from memory, so the next access reloads it
+    void evictChunk(size_t blk) {
+        EngineRace::DataBlk &b = e->datablks[blk];
+        delete[] b.pmem;
+        b.pmem = 0;
+    }
+
+    static size_t chunkSize() { return EngineRace::chunk_size; }
+    static size_t maxJournal() { return EngineRace::max_journal; }
+
+private:
+    EngineRace *e;
+};
+
+}  // namespace polar_race
+
+struct Measurement {
+    std::string name;
+    uint64_t iters;  // per repetition
+    double median, min, rsd;  // ns per iteration; rsd in percent
+};
+
+std::vector<Measurement> results;
+
+// Runs body, which performs iters iterations and returns the nanoseconds
+// they took, cfg.reps times after one warmup run, and records the
+// median, minimum and relative standard deviation per iteration
+void run(const std::string &name, uint64_t iters,
+         std::function<uint64_t(uint64_t)> body) {
+    if (cfg.filter.size() && name.find(cfg.filter) == std::string::npos) {
+        return;
+    }
+    body(iters);
+    std::vector<double> ns;
+    for (int r = 0; r < cfg.reps; ++r) ns.push_back((double)body(iters) / iters);
+    std::sort(ns.begin(), ns.end());
+    double mean = 0, var = 0;
+    for (double v : ns) mean += v / ns.size();
+    for (double v : ns) var += (v - mean) * (v - mean) / ns.size();
+
+    Measurement m;
+    m.name = name;
+    m.iters = iters;
+    m.median = ns[ns.size() / 2];
+    m.min = ns[0];
+    m.rsd = mean ? sqrt(var) / mean * 100 : 0;
+    results.push_back(m);
+    printf("%-32s %10lu %12.1f %12.1f %7.1f%%\n", name.c_str(),
+           (unsigned long)iters, m.median, m.min, m.rsd);
+    fflush(stdout);
+}
+
+// Times a loop of iters calls of f(i)
+template <class F>
+uint64_t loop(uint64_t iters, F f) {
+    uint64_t s = now_ns();
+    for (uint64_t i = 0; i < iters; ++i) f(i);
+    return now_ns() - s;
+}
+
+std::vector<std::string> random_keys(size_t n, size_t len) {
+    std::vector<std::string> keys(n);
+    std::vector<char> k(len + 1);
+    for (size_t i = 0; i < n; ++i) {
+        gen_random(k.data(), len);
+        keys[i].assign(k.data(), len);
+    }
+    return keys;
+}
+
+std::string size_name(uint64_t n) {
+    if (n % 1000000 == 0) return std::to_string(n / 1000000) + "M";
+    if (n % 1000 == 0) return std::to_string(n / 1000) + "K";
+    return std::to_string(n);
+}
+
+void bench_hash() {
+    std::vector<std::string> keys = random_keys(1024, 8);
+    for (int len : {1, 4, 8}) {
+        run("hashPolar/" + std::to_string(len), 1 << 20, [&](uint64_t n) {
+            return loop(n, [&](uint64_t i) {
+                keep(hashPolar(keys[i & 1023].data(), len));
+            });
+        });
+    }
+}
+
+void bench_compare() {
+    for (size_t len : {8, 32, 128, 1024}) {
+        std::string a(len, 'x'), b(len, 'x'), c(len, 'x');
+        c[0] = 'y';
+        PolarString pa(a), pb(b), pc(c);
+        run("PolarString::compare/eq/" + std::to_string(len), 1 << 20,
+            [&](uint64_t n) {
+                return loop(n, [&](uint64_t i) { keep(pa.compare(pb)); });
+            });
+        run("PolarString::compare/first/" + std::to_string(len), 1 << 20,
+            [&](uint64_t n) {
+                return loop(n, [&](uint64_t i) { keep(pa.compare(pc)); });
+            });
+    }
+}
+
+// The lookup maps of EngineRace on their own, keyed the way
+// EngineRace::find keys them
+void bench_index() {
+    for (uint64_t size : cfg.index_sizes) {
+        std::string sz = size_name(size);
+        std::vector<std::string> keys = random_keys(size, 16);
+        std::vector<std::string> absent = random_keys(1024, 17);
+
+        std::unique_ptr<EngineRaceProbe::LongIndex> long_index;
+        run("index/long/insert/" + sz, size, [&](uint64_t n) {
+            long_index.reset(new EngineRaceProbe::LongIndex());
+            return loop(n, [&](uint64_t i) {
+                long_index->insert(keys[i].data(), keys[i].size(), i);
+            });
+        });
+        run("index/long/find_hit/" + sz, 1 << 20, [&](uint64_t n) {
+            return loop(n, [&](uint64_t i) {
+                PolarString k(keys[mix64(i) % size]);
+                keep(long_index->find(k.data(), k.size()));
+            });
+        });
+        run("index/long/find_miss/" + sz, 1 << 20, [&](uint64_t n) {
+            return loop(n, [&](uint64_t i) {
+                PolarString k(absent[i & 1023]);
+                keep(long_index->find(k.data(), k.size()));
+            });
+        });
+        long_index.reset();
+
+        EngineRaceProbe::ShortIndex short_index;
+        run("index/short/insert/" + sz, size, [&](uint64_t n) {
+            short_index = EngineRaceProbe::ShortIndex();
+            return loop(n, [&](uint64_t i) {
+                short_index[hashPolar(keys[i].data(), 8)] = i;
+            });
+        });
+        run("index/short/find_hit/" + sz, 1 << 20, [&](uint64_t n) {
+            return loop(n, [&](uint64_t i) {
+                keep(short_index.find(hashPolar(keys[mix64(i) % size].data(), 8)));
+            });
+        });
+        run("index/short/find_miss/" + sz, 1 << 20, [&](uint64_t n) {
+            return loop(n, [&](uint64_t i) {
+                keep(short_index.find(hashPolar(absent[i & 1023].data(), 8)));
+            });
+        });
+    }
+}
+
+// Every allocation repetition starts over from the same position, so
+// includes the allocation of its chunks. Copies go to the same
+// preallocated places in every repetition.
+void bench_memory(EngineRaceProbe &probe) {
+    const size_t budget = 16 * EngineRaceProbe::chunkSize();
+    EngineRaceProbe::Position start = probe.position();
+
+    for (size_t sz : {64, 4096}) {
+        run("allocMemory/" + std::to_string(sz), budget / sz / 2,
+            [&](uint64_t n) {
+                probe.rewind(start);
+                return loop(n, [&](uint64_t i) { keep(probe.allocMemory(sz)); });
+            });
+    }
+
+    std::vector<std::string> keys = random_keys(4096, 16);
+    for (size_t sz : {16, 1024, 4096}) {
+        std::string value(sz, 'v');
+        uint64_t iters = budget / (16 + sz) / 2;
+        std::vector<size_t> ptrs;
+        for (uint64_t i = 0; i < iters; ++i) {
+            ptrs.push_back(probe.allocMemory(16 + sz));
+        }
+        run("copyToMemory/" + std::to_string(sz), iters, [&](uint64_t n) {
+            return loop(n, [&](uint64_t i) {
+                probe.copyToMemory(0, ptrs[i], keys[i & 4095], value);
+            });
+        });
+        probe.rewind(start);
+    }
+    probe.rewind(start);
+}
+
+// Cost of one flush() against the number of records it writes out
+void bench_flush(EngineRaceProbe &probe) {
+    std::string value(4096, 'v');
+    uint64_t next = 0;
+    for (size_t batch : {(size_t)1, (size_t)4, (size_t)16,
+                         EngineRaceProbe::maxJournal() - 1}) {
+        run("flush/batch=" + std::to_string(batch), 32, [&](uint64_t n) {
+            uint64_t ns = 0;
+            std::vector<std::string> keys(batch);
+            for (uint64_t i = 0; i < n; ++i) {
+                for (auto &k : keys) {
+                    k = "flush-" + std::to_string(next++) + "-key";
+                }
+                ns += probe.flushBatch(keys, value);
+            }
+            return ns;
+        });
+    }
+}
+
+void bench_chunks(EngineRaceProbe &probe) {
+    size_t n_blks = probe.syncedChunks();
+    if (n_blks == 0) return;
+    run("getPtrSafe/hit", 1 << 20, [&](uint64_t n) {
+        return loop(n, [&](uint64_t i) {
+            keep(probe.getMemory(0));
+            probe.relieveMemory(0);
+        });
+    });
+    run("getPtrSafe/miss", 16, [&](uint64_t n) {
+        uint64_t ns = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            size_t ptr = i % n_blks * EngineRaceProbe::chunkSize();
+            probe.evictChunk(i % n_blks);
+            uint64_t s = now_ns();
+            keep(probe.getMemory(ptr));
+            ns += now_ns() - s;
+            probe.relieveMemory(ptr);
+        }
+        return ns;
+    });
+}
+
+void usage() {
+    fprintf(stderr,
+            "Usage: ./micro_bench [--reps=N] [--filter=SUBSTRING] "
+            "[--index_sizes=N,N,...] [--json=FILE]\n");
+    exit(-1);
+}
+
+void parseArgs(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) usage();
+        std::string k = arg.substr(2, eq - 2);
+        const char *v = argv[i] + eq + 1;
+        if (k == "reps") {
+            cfg.reps = std::atoi(v);
+        } else if (k == "filter") {
+            cfg.filter = v;
+        } else if (k == "index_sizes") {
+            cfg.index_sizes.clear();
+            for (const char *p = v; *p; ++p) {
+                cfg.index_sizes.push_back(std::strtoull(p, NULL, 10));
+                if (cfg.index_sizes.back() == 0) usage();
+                p = strchr(p, ',');
+                if (p == NULL) break;
+            }
+        } else if (k == "json") {
+            cfg.json = v;
+        } else {
+            usage();
+        }
+    }
+    if (cfg.reps <= 0) usage();
+}
+
+int main(int argc, char **argv) {
+    parseArgs(argc, argv);
+    printf("%-32s %10s %12s %12s %8s\n", "benchmark", "iters", "median ns",
+           "min ns", "rsd");
+
+    bench_hash();
+    bench_compare();
+    bench_index();
+
+    system("mkdir -p data");
+    std::string engine_path =
+        std::string("./data/micro-") + std::to_string(asm_rdtsc());
+    EngineRace *engine = new EngineRace(engine_path);
+    engine->init(engine_path);
+    EngineRaceProbe probe(engine);
+    bench_memory(probe);
+    bench_flush(probe);
+    bench_chunks(probe);
+    delete engine;
+    system((std::string("rm -rf ") + engine_path + "*").c_str());
+
+    if (cfg.json.size()) {
+        std::string list = "[";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Measurement &m = results[i];
+            JsonWriter j;
+            j.str("name", m.name);
+            j.num("iters", m.iters);
+            j.num("median_ns", m.median);
+            j.num("min_ns", m.min);
+            j.num("rsd_pct", m.rsd);
+            list += (i ? ",\n" : "\n") + j.done();
+        }
+        JsonWriter out;
+        out.str("revision", git_revision());
+        out.num("reps", cfg.reps);
+        out.raw("results", list + "\n]");
+
+        FILE *f = fopen(cfg.json.c_str(), "w");
+        if (f == NULL) {
+            perror(cfg.json.c_str());
+        } else {
+            fprintf(f, "%s\n", out.done().c_str());
+            fclose(f);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+enum PerfEvent {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_NODE_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_PAGE_FAULTS,
+    PERF_NR
+};
+
+static const char *perf_names[PERF_NR] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses", "node_misses",
+    "context_switches", "page_faults"};
+
+// Counter totals of one or more threads. A negative value means the
+// counter could not be opened (not permitted, or absent on this CPU or
+// in this VM).
+struct PerfValues {
+    int64_t v[PERF_NR];
+
+    PerfValues() {
+        for (int i = 0; i < PERF_NR; ++i) v[i] = -1;
+    }
+    void add(const PerfValues &o) {
+        for (int i = 0; i < PERF_NR; ++i) {
+            if (o.v[i] < 0) continue;
+            v[i] = (v[i] < 0 ? 0 : v[i]) + o.v[i];
+        }
+    }
+};
+
+// perf_event_open counters of the calling thread, user and kernel time.
+// Each counter is opened on its own so one that is not supported does
+// not take the rest down, and scaled if the kernel multiplexed it.
+class PerfCounters {
+public:
+    PerfCounters() {
+        for (int i = 0; i < PERF_NR; ++i) fd_[i] = open_event((PerfEvent)i);
+    }
+    ~PerfCounters() {
+        for (int i = 0; i < PERF_NR; ++i) {
+            if (fd_[i] != -1) close(fd_[i]);
+        }
+    }
+
+    void start() {
+        for (int i = 0; i < PERF_NR; ++i) {
+            if (fd_[i] == -1) continue;
+            ioctl(fd_[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    PerfValues stop() {
+        PerfValues r;
+        for (int i = 0; i < PERF_NR; ++i) {
+            if (fd_[i] == -1) continue;
+            ioctl(fd_[i], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t buf[3];  // value, time enabled, time running
+            if (read(fd_[i], buf, sizeof(buf)) != sizeof(buf)) continue;
+            r.v[i] = buf[2] == 0 ? 0
+                                 : (int64_t)((double)buf[0] * buf[1] / buf[2]);
+        }
+        return r;
+    }
+
+private:
+    static int open_event(PerfEvent e) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.read_format =
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        switch (e) {
+        case PERF_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_LLC_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PERF_DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_NODE_MISSES:  // loads served by another node's memory
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_NODE |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_CONTEXT_SWITCHES:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            break;
+        case PERF_PAGE_FAULTS:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+            break;
+        default:
+            return -1;
+        }
+        int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd == -1) {
+            // Unprivileged users may only count their own user time
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+        return fd;
+    }
+
+    int fd_[PERF_NR];
+};
+
+#endif /* __PERF_COUNTERS_H__ */
@@ -0,0 +1,318 @@
+#include <fcntl.h>
+#include <glob.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "report.h"
+#include "workload.h"
+#include "include/engine.h"
+
+#define MAX_THREAD 64
+
+using namespace polar_race;
+
+struct Config {
+    std::vector<uint64_t> records = {1000000};
+    SizeDist key_size = {16, 16};
+    SizeDist value_size = {100, 100};
+    int threads = 8;
+    int shards = 1;  // as Options; 0 is one per hardware thread
+    bool clean = true;
+    bool kill = true;
+    bool cold = true;
+    int verify = 1000;
+    std::string json;
+} cfg;
+
+// Measured in the child that opens the store, sent back over a pipe
+struct Result {
+    double open_ms;
+    double first_read_ms;  // from the start of Open
+    uint64_t rss_before_kb;
+    uint64_t peak_rss_kb;  // high-water mark while opening
+    uint64_t rss_after_kb;
+    uint64_t found;        // of the cfg.verify keys sampled
+};
+
+void usage() {
+    fprintf(stderr,
+            "Usage: ./recovery [--records=N[K|M][,N...]] [--key_size=N|A-B] "
+            "[--value_size=N|A-B]\n"
+            "                  [--threads=1-64] [--shards=N] "
+            "[--mode=clean|kill|both] [--cold=0|1]\n"
+            "                  [--verify=N] [--json=FILE]\n");
+    exit(-1);
+}
+
+uint64_t parse_count(const char *s) {
+    char *end;
+    uint64_t n = std::strtoull(s, &end, 10);
+    if (*end == 'K' || *end == 'k') n *= 1000;
+    if (*end == 'M' || *end == 'm') n *= 1000000;
+    return n;
+}
+
+void parseArgs(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) usage();
+        std::string k = arg.substr(2, eq - 2);
+        const char *v = argv[i] + eq + 1;
+        if (k == "records") {
+            cfg.records.clear();
+            for (const char *p = v; *p; ++p) {
+                cfg.records.push_back(parse_count(p));
+                if (cfg.records.back() == 0) usage();
+                p = strchr(p, ',');
+                if (p == NULL) break;
+            }
+        } else if (k == "key_size") {
+            if (!cfg.key_size.parse(v)) usage();
+        } else if (k == "value_size") {
+            if (!cfg.value_size.parse(v)) usage();
+        } else if (k == "threads") {
+            cfg.threads = std::atoi(v);
+        } else if (k == "shards") {
+            cfg.shards = std::atoi(v);
+        } else if (k == "mode") {
+            std::string m(v);
+            if (m != "clean" && m != "kill" && m != "both") usage();
+            cfg.clean = m != "kill";
+            cfg.kill = m != "clean";
+        } else if (k == "cold") {
+            cfg.cold = std::atoi(v);
+        } else if (k == "verify") {
+            cfg.verify = std::atoi(v);
+        } else if (k == "json") {
+            cfg.json = v;
+        } else {
+            usage();
+        }
+    }
+    if (cfg.records.empty() || cfg.verify < 0) usage();
+    if (cfg.threads <= 0 || cfg.threads > MAX_THREAD) usage();
+}
+
+// VmRSS or VmHWM of this process, in kB
+uint64_t proc_status_kb(const char *field) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL) return 0;
+    char line[256];
+    uint64_t kb = 0;
+    size_t n = strlen(field);
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, field, n) == 0 && line[n] == ':') {
+            kb = std::strtoull(line + n + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+// Resets VmHWM to the current RSS, so the peak covers Open alone
+void reset_peak_rss() {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f == NULL) return;
+    fputs("5", f);
+    fclose(f);
+}
+
+// Writes back and drops the cached pages of every file of the store, so
+// Open reads from the device
+void evict_store(const std::string &path) {
+    glob_t g;
+    if (glob((path + "*").c_str(), 0, NULL, &g) != 0) return;
+    for (size_t i = 0; i < g.gl_pathc; ++i) {
+        int fd = open(g.gl_pathv[i], O_RDONLY);
+        if (fd == -1) continue;
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+    globfree(&g);
+}
+
+Engine *open_engine(const std::string &path) {
+    Engine *engine = NULL;
+    Options options;
+    options.shards = cfg.shards;
+    RetCode ret = Engine::Open(path, options, &engine);
+    assert(ret == kSucc);
+    return engine;
+}
+
+void load_thread(Engine *engine, int id, uint64_t lo, uint64_t hi) {
+    std::vector<char> buf(cfg.value_size.hi * 2 + 1);
+    gen_random(buf.data(), buf.size() - 1);
+    char k[1024];
+    for (uint64_t i = lo + id; i < hi; i += cfg.threads) {
+        PolarString key(k, make_key(i, cfg.key_size, k));
+        uint32_t len = cfg.value_size.pick(mix64(i));
+        engine->Write(key, PolarString(buf.data() + i % (cfg.value_size.hi + 1), len));
+    }
+}
+
+// Builds a store of n keys in a child process. A clean build closes the
+// engine; otherwise the child keeps writing past n keys until it is
+// killed with SIGKILL, like test/crash_test.cc.
+void build_store(const std::string &path, uint64_t n, bool clean) {
+    int fds[2];
+    if (pipe(fds) != 0) abort();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        Engine *engine = open_engine(path);
+        std::thread ths[MAX_THREAD];
+        for (int i = 0; i < cfg.threads; ++i) {
+            ths[i] = std::thread(load_thread, engine, i, 0, n);
+        }
+        for (int i = 0; i < cfg.threads; ++i) ths[i].join();
+        if (clean) delete engine;
+        char c = 0;
+        if (write(fds[1], &c, 1) != 1) _exit(1);
+        if (!clean) {
+            for (uint64_t lo = n;; lo += 1000) {
+                for (int i = 0; i < cfg.threads; ++i) {
+                    ths[i] = std::thread(load_thread, engine, i, lo, lo + 1000);
+                }
+                for (int i = 0; i < cfg.threads; ++i) ths[i].join();
+            }
+        }
+        _exit(0);
+    }
+    assert(pid > 0);
+    close(fds[1]);
+    char c;
+    if (read(fds[0], &c, 1) != 1) abort();
+    close(fds[0]);
+    if (!clean) {
+        usleep(100000);  // let the writes past n get going
+        kill(pid, SIGKILL);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+}
+
+// Opens the store in a fresh child process and times it
+Result measure(const std::string &path, uint64_t n) {
+    int fds[2];
+    if (pipe(fds) != 0) abort();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        if (cfg.cold) evict_store(path);
+        Result r;
+        reset_peak_rss();
+        r.rss_before_kb = proc_status_kb("VmRSS");
+        uint64_t start = now_ns();
+        Engine *engine = open_engine(path);
+        r.open_ms = (now_ns() - start) / 1e6;
+        r.peak_rss_kb = proc_status_kb("VmHWM");
+        r.rss_after_kb = proc_status_kb("VmRSS");
+
+        char k[1024];
+        std::string value;
+        unsigned seed = asm_rdtsc();
+        RetCode ret = engine->Read(PolarString(k, make_key(rand_r(&seed) % n,
+                                                            cfg.key_size, k)),
+                                   &value);
+        assert(ret == kSucc);
+        r.first_read_ms = (now_ns() - start) / 1e6;
+        r.found = 0;
+        for (int i = 0; i < cfg.verify; ++i) {
+            uint64_t id = ((uint64_t)rand_r(&seed) << 31 | rand_r(&seed)) % n;
+            PolarString key(k, make_key(id, cfg.key_size, k));
+            if (engine->Read(key, &value) == kSucc &&
+                value.size() == cfg.value_size.pick(mix64(id))) {
+                ++r.found;
+            }
+        }
+        delete engine;
+        if (write(fds[1], &r, sizeof(r)) != sizeof(r)) _exit(1);
+        _exit(0);
+    }
+    assert(pid > 0);
+    close(fds[1]);
+    Result r;
+    if (read(fds[0], &r, sizeof(r)) != sizeof(r)) {
+        fprintf(stderr, "open of %s failed\n", path.c_str());
+        exit(-1);
+    }
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return r;
+}
+
+int main(int argc, char **argv) {
+    parseArgs(argc, argv);
+    system("mkdir -p data");
+
+    std::string runs = "[";
+    printf("%12s %6s %10s %14s %12s %12s %8s\n", "records", "mode", "open ms",
+           "first read ms", "peak rss MB", "rss MB", "found");
+    for (size_t i = 0; i < cfg.records.size(); ++i) {
+        for (int clean = 1; clean >= 0; --clean) {
+            if (clean ? !cfg.clean : !cfg.kill) continue;
+            uint64_t n = cfg.records[i];
+            std::string path =
+                std::string("./data/recovery-") + std::to_string(asm_rdtsc());
+            uint64_t s = now_ns();
+            build_store(path, n, clean);
+            double build_s = (now_ns() - s) / 1e9;
+            Result r = measure(path, n);
+            system((std::string("rm -rf ") + path + "*").c_str());
+
+            const char *mode = clean ? "clean" : "kill";
+            printf("%12lu %6s %10.1f %14.1f %12.1f %12.1f %5lu/%d\n",
+                   (unsigned long)n, mode, r.open_ms, r.first_read_ms,
+                   r.peak_rss_kb / 1024.0, r.rss_after_kb / 1024.0,
+                   (unsigned long)r.found, cfg.verify);
+            fflush(stdout);
+
+            JsonWriter j;
+            j.num("records", n);
+            j.str("mode", mode);
+            j.num("build_s", build_s);
+            j.num("open_ms", r.open_ms);
+            j.num("first_read_ms", r.first_read_ms);
+            j.num("rss_before_kb", r.rss_before_kb);
+            j.num("peak_rss_kb", r.peak_rss_kb);
+            j.num("rss_after_kb", r.rss_after_kb);
+            j.num("verified", cfg.verify);
+            j.num("found", r.found);
+            runs += (runs.size() > 1 ? ",\n" : "\n") + j.done();
+        }
+    }
+
+    if (cfg.json.size()) {
+        JsonWriter conf;
+        conf.str("key_size", cfg.key_size.str());
+        conf.str("value_size", cfg.value_size.str());
+        conf.num("threads", cfg.threads);
+        conf.num("shards", cfg.shards);
+        conf.num("cold", cfg.cold);
+
+        JsonWriter out;
+        out.str("revision", git_revision());
+        out.raw("config", conf.done());
+        out.raw("runs", runs + "\n]");
+
+        FILE *f = fopen(cfg.json.c_str(), "w");
+        if (f == NULL) {
+            perror(cfg.json.c_str());
+        } else {
+            fprintf(f, "%s\n", out.done().c_str());
+            fclose(f);
+        }
+    }
+    return 0;
+}
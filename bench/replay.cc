@@ -0,0 +1,256 @@
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "report.h"
+#include "include/engine.h"
+#include "include/op_trace.h"
+
+#define MAX_THREAD 64
+
+using namespace polar_race;
+
+struct Config {
+    std::string trace;
+    std::string path;  // store to replay into; empty uses a scratch store
+    int threads = 1;
+    double speed = 1;  // 2 replays twice as fast, 0 as fast as possible
+    int shards = 1;  // as Options; 0 is one per hardware thread
+    std::string json;
+} cfg;
+
+static const char *trace_op_names[] = {"write", "read", "range"};
+static const int n_trace_ops = 3;
+
+// One traced operation, pointing into the loaded trace
+struct TracedOp {
+    uint64_t ts;
+    uint32_t op;
+    uint32_t value_len;
+    PolarString key;
+    PolarString upper;
+};
+
+struct Worker {
+    std::vector<const TracedOp *> ops;
+    Histogram lat[n_trace_ops];
+    char pad[64];
+};
+
+Engine *engine = NULL;
+std::vector<char> raw;
+std::vector<TracedOp> trace;
+Worker workers[MAX_THREAD];
+std::vector<char> value_buf;
+
+void usage() {
+    fprintf(stderr,
+            "Usage: ./replay --trace=FILE [--threads=1-64] [--speed=X|max] "
+            "[--path=STORE]\n"
+            "                [--shards=N] [--json=FILE]\n");
+    exit(-1);
+}
+
+void parseArgs(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) usage();
+        std::string k = arg.substr(2, eq - 2);
+        const char *v = argv[i] + eq + 1;
+        if (k == "trace") {
+            cfg.trace = v;
+        } else if (k == "threads") {
+            cfg.threads = std::atoi(v);
+        } else if (k == "speed") {
+            cfg.speed = std::string(v) == "max" ? 0 : std::atof(v);
+        } else if (k == "path") {
+            cfg.path = v;
+        } else if (k == "shards") {
+            cfg.shards = std::atoi(v);
+        } else if (k == "json") {
+            cfg.json = v;
+        } else {
+            usage();
+        }
+    }
+    if (cfg.trace.empty() || cfg.speed < 0) usage();
+    if (cfg.threads <= 0 || cfg.threads > MAX_THREAD) usage();
+}
+
+bool load_trace() {
+    FILE *f = fopen(cfg.trace.c_str(), "rb");
+    if (f == NULL) {
+        perror(cfg.trace.c_str());
+        return false;
+    }
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        raw.insert(raw.end(), buf, buf + n);
+    }
+    fclose(f);
+
+    OpTraceHeader h;
+    if (raw.size() < sizeof(h)) return false;
+    memcpy(&h, raw.data(), sizeof(h));
+    if (memcmp(h.magic, kOpTraceMagic, sizeof(h.magic)) != 0 ||
+        h.version != kOpTraceVersion) {
+        fprintf(stderr, "%s: not an op trace\n", cfg.trace.c_str());
+        return false;
+    }
+
+    // A record cut short by a crash ends the trace
+    size_t off = sizeof(h);
+    while (off + sizeof(OpTraceRecord) <= raw.size()) {
+        OpTraceRecord r;
+        memcpy(&r, raw.data() + off, sizeof(r));
+        size_t extra = r.op == kOpTraceRange ? r.value_len : 0;
+        if (r.op >= (uint32_t)n_trace_ops ||
+            off + sizeof(r) + r.key_len + extra > raw.size()) {
+            break;
+        }
+        const char *p = raw.data() + off + sizeof(r);
+        TracedOp op;
+        op.ts = r.ts_ns;
+        op.op = r.op;
+        op.value_len = r.value_len;
+        op.key = PolarString(p, r.key_len);
+        op.upper = PolarString(p + r.key_len, extra);
+        trace.push_back(op);
+        off += sizeof(r) + r.key_len + extra;
+    }
+    return true;
+}
+
+// Operations on one key stay on one thread, so they replay in order
+void partition() {
+    uint32_t max_value = 0;
+    for (size_t i = 0; i < trace.size(); ++i) {
+        const TracedOp &op = trace[i];
+        uint64_t h = 14695981039346656037ull;
+        for (size_t j = 0; j < op.key.size(); ++j) {
+            h = (h ^ (unsigned char)op.key[j]) * 1099511628211ull;
+        }
+        workers[h % cfg.threads].ops.push_back(&op);
+        if (op.op == kOpTraceWrite) max_value = std::max(max_value, op.value_len);
+    }
+    value_buf.resize(max_value + 1);
+    gen_random(value_buf.data(), max_value);
+}
+
+class CountVisitor : public Visitor {
+public:
+    uint64_t n = 0;
+    void Visit(const PolarString &key, const PolarString &value) { ++n; }
+};
+
+// Paced replays follow the recorded schedule and measure latency from
+// the recorded start, so a slow operation delays the ones behind it
+void replay_thread(int id, uint64_t start) {
+    Worker &w = workers[id];
+    std::string value;
+    uint64_t t0 = trace.empty() ? 0 : trace[0].ts;
+    for (size_t i = 0; i < w.ops.size(); ++i) {
+        const TracedOp &op = *w.ops[i];
+        uint64_t s = now_ns();
+        if (cfg.speed) {
+            s = start + (uint64_t)((op.ts - t0) / cfg.speed);
+            wait_until(s);
+        }
+        switch (op.op) {
+        case kOpTraceWrite:
+            engine->Write(op.key, PolarString(value_buf.data(), op.value_len));
+            break;
+        case kOpTraceRead:
+            engine->Read(op.key, &value);
+            break;
+        case kOpTraceRange: {
+            CountVisitor visitor;
+            engine->Range(op.key, op.upper, visitor);
+            break;
+        }
+        }
+        w.lat[op.op].Record(now_ns() - s);
+    }
+}
+
+int main(int argc, char **argv) {
+    parseArgs(argc, argv);
+    if (!load_trace()) return -1;
+    partition();
+    printf("trace: %s, %lu operations over %.3lfs, threads: %d, speed: %s\n",
+           cfg.trace.c_str(), (unsigned long)trace.size(),
+           trace.empty() ? 0 : (trace.back().ts - trace[0].ts) / 1e9,
+           cfg.threads,
+           cfg.speed ? std::to_string(cfg.speed).c_str() : "max");
+
+    std::string engine_path = cfg.path;
+    if (engine_path.empty()) {
+        system("mkdir -p data");
+        engine_path = std::string("./data/replay-") + std::to_string(asm_rdtsc());
+    }
+    printf("open engine_path: %s\n", engine_path.c_str());
+    Options options;
+    options.shards = cfg.shards;
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+
+    std::thread ths[MAX_THREAD];
+    uint64_t start = now_ns() + 10000000;  // every thread up before the first op
+    for (int i = 0; i < cfg.threads; ++i) {
+        ths[i] = std::thread(replay_thread, i, start);
+    }
+    for (int i = 0; i < cfg.threads; ++i) ths[i].join();
+    uint64_t elapsed = now_ns() - start;
+
+    Histogram total[n_trace_ops];
+    for (int i = 0; i < cfg.threads; ++i) {
+        for (int j = 0; j < n_trace_ops; ++j) total[j].Merge(workers[i].lat[j]);
+    }
+    double throughput = trace.size() * 1e9 / elapsed;
+    printf("%d thread, %lu operations, time: %lfus\n", cfg.threads,
+           (unsigned long)trace.size(), elapsed / 1e3);
+    printf("throughput %lf operations/s\n", throughput);
+    for (int i = 0; i < n_trace_ops; ++i) print_hist(trace_op_names[i], total[i]);
+
+    if (cfg.json.size()) {
+        JsonWriter conf;
+        conf.str("trace", cfg.trace);
+        conf.num("threads", cfg.threads);
+        conf.num("speed", cfg.speed);
+        conf.num("shards", cfg.shards);
+
+        JsonWriter lat;
+        for (int i = 0; i < n_trace_ops; ++i) {
+            if (total[i].count()) lat.raw(trace_op_names[i], hist_json(total[i]));
+        }
+
+        JsonWriter out;
+        out.str("revision", git_revision());
+        out.raw("config", conf.done());
+        out.num("elapsed_s", elapsed / 1e9);
+        out.num("ops", trace.size());
+        out.num("throughput", throughput);
+        out.raw("latency", lat.done());
+        out.raw("engine", engine_stats_json(engine));
+
+        FILE *f = fopen(cfg.json.c_str(), "w");
+        if (f == NULL) {
+            perror(cfg.json.c_str());
+        } else {
+            fprintf(f, "%s\n", out.done().c_str());
+            fclose(f);
+        }
+    }
+
+    delete engine;
+
+    if (cfg.path.empty()) {
+        system((std::string("rm -rf ") + engine_path + "*").c_str());
+    }
+
+    return 0;
+}
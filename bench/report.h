@@ -0,0 +1,149 @@
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "include/engine.h"
+#include "include/histogram.h"
+#include "workload.h"
+
+using polar_race::Histogram;
+
+inline uint64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Sleeps through most of the gap and yields for the rest
+inline void wait_until(uint64_t t) {
+    for (uint64_t now = now_ns(); now < t; now = now_ns()) {
+        if (t - now > 200000) {
+            usleep((t - now - 100000) / 1000);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+// Latency histograms of one thread, merged into a total at the end
+struct OpLatency {
+    Histogram op[OP_NR];
+
+    void merge(const OpLatency &o) {
+        for (int i = 0; i < OP_NR; ++i) op[i].Merge(o.op[i]);
+    }
+
+    // Every operation type together
+    Histogram all() const {
+        Histogram h;
+        for (int i = 0; i < OP_NR; ++i) h.Merge(op[i]);
+        return h;
+    }
+};
+
+// Accumulates a JSON object; values are appended in call order
+class JsonWriter {
+public:
+    JsonWriter() : first_(true) { out_ = "{"; }
+
+    void key(const std::string &k) {
+        out_ += first_ ? "\n" : ",\n";
+        first_ = false;
+        out_ += "\"" + k + "\": ";
+    }
+    void num(const std::string &k, double v) {
+        char buf[64];
+        if (v == (double)(int64_t)v) {
+            snprintf(buf, sizeof(buf), "%lld", (long long)v);
+        } else {
+            snprintf(buf, sizeof(buf), "%.6g", v);
+        }
+        key(k);
+        out_ += buf;
+    }
+    void str(const std::string &k, const std::string &v) {
+        key(k);
+        out_ += "\"" + v + "\"";
+    }
+    void raw(const std::string &k, const std::string &json) {
+        key(k);
+        out_ += json;
+    }
+    std::string done() { return out_ + "\n}"; }
+
+private:
+    bool first_;
+    std::string out_;
+};
+
+inline std::string hist_json(const Histogram &h) {
+    JsonWriter j;
+    j.num("count", h.count());
+    j.num("mean_ns", h.mean());
+    j.num("p50_ns", h.Percentile(0.5));
+    j.num("p90_ns", h.Percentile(0.9));
+    j.num("p99_ns", h.Percentile(0.99));
+    j.num("p999_ns", h.Percentile(0.999));
+    j.num("max_ns", h.max());
+    return j.done();
+}
+
+inline void print_hist(const char *name, const Histogram &h) {
+    if (h.count() == 0) return;
+    printf("%-8s %10lu ops  mean %9.0f  p50 %9lu  p99 %9lu  p999 %9lu  "
+           "max %9lu ns\n",
+           name, (unsigned long)h.count(), h.mean(),
+           (unsigned long)h.Percentile(0.5), (unsigned long)h.Percentile(0.99),
+           (unsigned long)h.Percentile(0.999), (unsigned long)h.max());
+}
+
+inline std::string timeline_json(const std::vector<uint64_t> &t) {
+    std::string s = "[";
+    for (size_t i = 0; i < t.size(); ++i) {
+        s += (i ? ", " : "") + std::to_string(t[i]);
+    }
+    return s + "]";
+}
+
+// Engine side view, when the engine reports statistics
+inline std::string engine_stats_json(polar_race::Engine *engine) {
+    polar_race::Stats st;
+    if (engine->GetStats(&st) != polar_race::kSucc) return "null";
+    JsonWriter j;
+    j.raw("flush", hist_json(st.flush));
+    j.raw("chunk_load", hist_json(st.chunk_load));
+    j.num("flushed_records", st.flushed_records);
+    j.num("hot_cache_hits", st.hot_cache_hits);
+    j.num("keys", st.keys);
+    j.num("index_bytes", st.index_bytes);
+    j.num("meta_bytes", st.meta_bytes);
+    j.num("chunk_cache_bytes", st.chunk_cache_bytes);
+    j.num("hot_cache_bytes", st.hot_cache_bytes);
+    j.num("journal_bytes", st.journal_bytes);
+    j.num("stalls", st.stalls);
+    return j.done();
+}
+
+// Revision of the tree the benchmark was built from, so results can be
+// lined up across commits
+inline std::string git_revision() {
+    FILE *p = popen("git rev-parse --short HEAD 2>/dev/null", "r");
+    if (p == NULL) return "unknown";
+    char buf[64] = {0};
+    if (fgets(buf, sizeof(buf), p) == NULL) buf[0] = 0;
+    pclose(p);
+    std::string s(buf);
+    while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.pop_back();
+    return s.empty() ? "unknown" : s;
+}
+
+#endif /* __REPORT_H__ */
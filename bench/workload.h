@@ -0,0 +1,124 @@
+#ifndef __WORKLOAD_H__
+#define __WORKLOAD_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+
+#include "zipf.h"
+
+enum OpType { OP_READ, OP_UPDATE, OP_INSERT, OP_SCAN, OP_RMW, OP_NR };
+
+enum KeyDist { DIST_UNIFORM, DIST_ZIPF, DIST_LATEST };
+
+// Fraction of each operation, YCSB style
+struct Mix {
+    double ratio[OP_NR];
+    KeyDist dist;
+};
+
+// Core YCSB workloads A-F
+inline bool ycsb_mix(char w, Mix *mix) {
+    memset(mix, 0, sizeof(*mix));
+    mix->dist = DIST_ZIPF;
+    switch (w) {
+    case 'a': mix->ratio[OP_READ] = 0.5; mix->ratio[OP_UPDATE] = 0.5; break;
+    case 'b': mix->ratio[OP_READ] = 0.95; mix->ratio[OP_UPDATE] = 0.05; break;
+    case 'c': mix->ratio[OP_READ] = 1; break;
+    case 'd':
+        mix->ratio[OP_READ] = 0.95;
+        mix->ratio[OP_INSERT] = 0.05;
+        mix->dist = DIST_LATEST;
+        break;
+    case 'e': mix->ratio[OP_SCAN] = 0.95; mix->ratio[OP_INSERT] = 0.05; break;
+    case 'f': mix->ratio[OP_READ] = 0.5; mix->ratio[OP_RMW] = 0.5; break;
+    default: return false;
+    }
+    return true;
+}
+
+// A size that is either fixed ("4096") or uniform in a range ("16-64")
+struct SizeDist {
+    uint32_t lo, hi;
+
+    bool parse(const char *s) {
+        unsigned a, b;
+        if (sscanf(s, "%u-%u", &a, &b) == 2 && a <= b) {
+            lo = a, hi = b;
+        } else if (sscanf(s, "%u", &a) == 1) {
+            lo = hi = a;
+        } else {
+            return false;
+        }
+        return lo > 0;
+    }
+
+    uint32_t pick(uint64_t r) const {
+        return lo == hi ? lo : lo + r % (hi - lo + 1);
+    }
+
+    std::string str() const {
+        return lo == hi ? std::to_string(lo)
+                        : std::to_string(lo) + "-" + std::to_string(hi);
+    }
+};
+
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// Key id -> key bytes. The id is stored big-endian in front so keys sort
+// in id order, and the length is a function of the id so a key reads
+// back the same way it was written.
+inline size_t make_key(uint64_t id, const SizeDist &ks, char *out) {
+    size_t len = ks.pick(mix64(id));
+    for (size_t i = 0; i < len; ++i) {
+        if (i < 8) {
+            out[i] = len < 8 ? (char)(id >> (8 * (len - 1 - i)))
+                             : (char)(id >> (8 * (7 - i)));
+        } else {
+            out[i] = 'a' + (mix64(id + i) % 26);
+        }
+    }
+    return len;
+}
+
+// Picks key ids for one thread. Inserts extend the key space through a
+// shared counter; the "latest" distribution favours recent inserts.
+class KeyChooser {
+public:
+    KeyChooser(KeyDist dist, double theta, std::atomic<uint64_t> *n_keys,
+               uint64_t seed)
+        : dist_(dist), n_keys_(n_keys) {
+        mehcached_zipf_init(&zipf_, n_keys->load(),
+                            dist == DIST_UNIFORM ? 0 : theta,
+                            seed & ((1ull << 48) - 1));
+    }
+
+    uint64_t next() {
+        uint64_t n = n_keys_->load(std::memory_order_relaxed);
+        mehcached_zipf_change_n(&zipf_, n);
+        uint64_t r = mehcached_zipf_next(&zipf_);
+        if (r >= n) r = n - 1;
+        if (dist_ == DIST_LATEST) return n - 1 - r;
+        // Spread the hot ranks over the key space
+        return dist_ == DIST_ZIPF ? mix64(r) % n : r;
+    }
+
+    uint64_t insert() { return n_keys_->fetch_add(1); }
+
+private:
+    KeyDist dist_;
+    std::atomic<uint64_t> *n_keys_;
+    zipf_gen_state zipf_;
+};
+
+#endif /* __WORKLOAD_H__ */
@@ -16,7 +16,7 @@ static const uint32_t kMaxDoorCnt = 1024 * 1024 * 32;
 static const char kMetaFileName[] = "META";
 static const int kMaxRangeBufCount = kMaxDoorCnt;
 
-static bool ItemKeyMatch(const Item &item, const std::string& target) {
+static bool ItemKeyMatch(const PlateItem &item, const std::string& target) {
   if (target.size() != item.key_size
       || memcmp(item.key, target.data(), item.key_size) != 0) {
     // Conflict
@@ -25,7 +25,7 @@ static bool ItemKeyMatch(const Item &item, const std::string& target) {
   return true;
 }
 
-static bool ItemTryPlace(const Item &item, const std::string& target) {
+static bool ItemTryPlace(const PlateItem &item, const std::string& target) {
   if (item.in_use == 0) {
     return true;
   }
@@ -40,7 +40,7 @@ DoorPlate::DoorPlate(const std::string& path)
 
 RetCode DoorPlate::Init() {
   bool new_create = false;
-  const int map_size = kMaxDoorCnt * sizeof(Item);
+  const int map_size = kMaxDoorCnt * sizeof(PlateItem);
 
   if (!FileExists(dir_)
       && 0 != mkdir(dir_.c_str(), 0755)) {
@@ -77,13 +77,13 @@ RetCode DoorPlate::Init() {
     memset(ptr, 0, map_size);
   }
 
-  items_ = reinterpret_cast<Item*>(ptr);
+  items_ = reinterpret_cast<PlateItem*>(ptr);
   return kSucc;
 }
 
 DoorPlate::~DoorPlate() {
   if (fd_ > 0) {
-    const int map_size = kMaxDoorCnt * sizeof(Item);
+    const int map_size = kMaxDoorCnt * sizeof(PlateItem);
     munmap(items_, map_size);
     close(fd_);
   }
@@ -115,7 +115,7 @@ RetCode DoorPlate::AddOrUpdate(const std::string& key, const Location& l) {
     return kFull;
   }
 
-  Item* iptr = items_ + index;
+  PlateItem* iptr = items_ + index;
   if (iptr->in_use == 0) {
     // new item
     memcpy(iptr->key, key.data(), key.size());
@@ -141,7 +141,7 @@ RetCode DoorPlate::GetRangeLocation(const std::string& lower,
     const std::string& upper,
     std::map<std::string, Location> *locations) {
   int count = 0;
-  for (Item *it = items_ + kMaxDoorCnt - 1; it >= items_; it--) {
+  for (PlateItem *it = items_ + kMaxDoorCnt - 1; it >= items_; it--) {
     if (!it->in_use) {
       continue;
     }
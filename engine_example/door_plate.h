@@ -12,8 +12,8 @@ namespace polar_race {
 
 static const uint32_t kMaxKeyLen = 32;
 
-struct Item {
-  Item() : key_size(0), in_use(0) {
+struct PlateItem {
+  PlateItem() : key_size(0), in_use(0) {
   }
   Location location;
   char key[kMaxKeyLen];
@@ -39,7 +39,7 @@ class DoorPlate  {
  private:
     std::string dir_;
     int fd_;
-    Item *items_;
+    PlateItem *items_;
 
     int CalcIndex(const std::string& key);
 };
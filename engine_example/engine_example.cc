@@ -10,13 +10,15 @@ namespace polar_race {
 
 static const char kLockFile[] = "LOCK";
 
-RetCode Engine::Open(const std::string& name, Engine** eptr) {
+RetCode EngineExample::Open(const std::string& name, const Options& options,
+    Engine** eptr) {
+  if (options.read_only) {
+    *eptr = NULL;
+    return kNotSupported;
+  }
   return EngineExample::Open(name, eptr);
 }
 
-Engine::~Engine() {
-}
-
 RetCode EngineExample::Open(const std::string& name, Engine** eptr) {
   *eptr = NULL;
   EngineExample *engine_example = new EngineExample(name);
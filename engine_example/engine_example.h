@@ -14,6 +14,10 @@ class EngineExample : public Engine  {
  public:
   static RetCode Open(const std::string& name, Engine** eptr);
 
+  // Registered as "example"; the example takes no options
+  static RetCode Open(const std::string& name, const Options& options,
+      Engine** eptr);
+
   explicit EngineExample(const std::string& dir)
     : mu_(PTHREAD_MUTEX_INITIALIZER),
     db_lock_(NULL), plate_(dir), store_(dir) {
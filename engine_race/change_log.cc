@@ -0,0 +1,100 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include <algorithm>
+#include <chrono>
+
+#include "change_log.h"
+
+namespace polar_race {
+
+ChangeLog::ChangeLog(size_t capacity, size_t shards)
+	: capacity(capacity ? capacity : 1), rings(new Ring[shards]), n_rings(shards),
+	next(0), committed(0), waiters(0) {}
+
+ChangeLog::~ChangeLog() {
+	delete [] rings;
+}
+
+// Records committed past the latest capacity are dropped first, so every
+// one a reader may still be given stays
+void ChangeLog::push(Ring* r, const ChangeEntry& e) {
+	size_t mask(r->entries.size() - 1);
+	uint64_t c(committed.load(std::memory_order_acquire));
+	while (r->n && r->entries[r->first].seq + capacity <= c) {
+		r->first = (r->first + 1) & mask;
+		--r->n;
+	}
+	if (r->n == r->entries.size()) {
+		std::vector<ChangeEntry> grown(r->entries.size() * 2);
+		for (size_t i = 0; i < r->n; ++i) {
+			grown[i] = r->entries[(r->first + i) & mask];
+		}
+		r->entries.swap(grown);
+		r->first = 0;
+		mask = r->entries.size() - 1;
+	}
+	r->entries[(r->first + r->n++) & mask] = e;
+}
+
+// A tail either sees the new sequence when it checks under mtx, or is
+// counted in waiters by then and woken
+void ChangeLog::commit(uint64_t seq) {
+	committed.store(seq, std::memory_order_seq_cst);
+	if (waiters.load(std::memory_order_seq_cst)) {
+		std::lock_guard<std::mutex> lck(mtx);
+		cv.notify_all();
+	}
+}
+
+RetCode ChangeLog::get(uint64_t after, size_t max, uint64_t timeout_ms,
+		std::vector<ChangeEntry>* out) {
+	out->clear();
+	uint64_t c(committed.load(std::memory_order_acquire));
+	if (c <= after) {
+		waiters.fetch_add(1, std::memory_order_seq_cst);
+		{
+			std::unique_lock<std::mutex> lck(mtx);
+			cv.wait_for(lck, std::chrono::milliseconds(timeout_ms), [this, after, &c] {
+				c = committed.load(std::memory_order_seq_cst);
+				return c > after;
+			});
+		}
+		waiters.fetch_sub(1, std::memory_order_relaxed);
+		if (c <= after) {
+			return kTimedOut;
+		}
+	}
+	if (c - after > capacity) {
+		return kNotFound;
+	}
+	// Each ring is in sequence order, so its records from after on are
+	// found by bisection and copied while under end
+	uint64_t end(std::min(c, after + max));
+	for (size_t i = 0; i < n_rings; ++i) {
+		Ring& r(rings[i]);
+		std::lock_guard<std::mutex> lck(r.mtx);
+		size_t mask(r.entries.size() - 1);
+		size_t lo(0), hi(r.n);
+		while (lo < hi) {
+			size_t mid((lo + hi) / 2);
+			if (r.entries[(r.first + mid) & mask].seq <= after) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		for (; lo < r.n && r.entries[(r.first + lo) & mask].seq <= end; ++lo) {
+			out->push_back(r.entries[(r.first + lo) & mask]);
+		}
+	}
+	std::sort(out->begin(), out->end(),
+			[](const ChangeEntry& a, const ChangeEntry& b) { return a.seq < b.seq; });
+	// A push after the check above may have dropped the oldest of them,
+	// as the records committed meanwhile moved the retention on
+	if (out->size() != end - after) {
+		out->clear();
+		return kNotFound;
+	}
+	return kSucc;
+}
+
+}  // namespace polar_race
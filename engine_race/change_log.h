@@ -0,0 +1,118 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_CHANGE_LOG_H_
+#define ENGINE_RACE_CHANGE_LOG_H_
+
+#include <sched.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "include/engine.h"
+
+namespace polar_race {
+
+// Where a record of the change stream lies: p, szKey and szVal of its
+// Item in shard's log. The log is never rewritten, so the bytes stay
+// there after the key is overwritten.
+struct ChangeEntry {
+	uint64_t seq;
+	uint64_t p;
+	uint32_t szKey, szVal;
+	uint32_t shard;
+};
+
+// The latest capacity records committed across the shards of an engine,
+// numbered from 1 in commit order. Every shard appends to a ring of its
+// own under its own mutex, so flushes of different shards do not wait on
+// each other's copies; a batch takes its sequences from one counter and
+// only waits for the batches numbered before it to be committed, so
+// commits stay in sequence order. Readers merge the rings by sequence.
+// A ring grows as needed and drops the records that fell out of the
+// latest capacity, so the rings hold about capacity records together.
+class ChangeLog {
+	// The records of one shard, oldest first, from first on in a buffer
+	// of a power of two entries
+	struct Ring {
+		Ring() : entries(64), first(0), n(0) {}
+
+		std::mutex mtx;
+		std::vector<ChangeEntry> entries;
+		size_t first, n;
+	};
+
+public:
+	ChangeLog(size_t capacity, size_t shards);
+	~ChangeLog();
+
+	// Holds shard's ring over a batch of n records, which get consecutive
+	// sequences, and commits them and wakes the tails when done
+	class Appender {
+	public:
+		Appender(ChangeLog* log, uint32_t shard, size_t n)
+			: log(log), ring(&log->rings[shard]), shard(shard), lck(ring->mtx),
+			first(log->next.fetch_add(n)), seq(first) {}
+
+		~Appender() {
+			lck.unlock();
+			while (log->committed.load(std::memory_order_acquire) != first) {
+				sched_yield();
+			}
+			log->commit(seq);
+		}
+
+		inline void add(uint64_t p, uint32_t szKey, uint32_t szVal) {
+			ChangeEntry e;
+			e.seq = ++seq;
+			e.p = p;
+			e.szKey = szKey;
+			e.szVal = szVal;
+			e.shard = shard;
+			log->push(ring, e);
+		}
+
+	private:
+		ChangeLog* log;
+		Ring* ring;
+		uint32_t shard;
+		std::unique_lock<std::mutex> lck;
+		uint64_t first, seq;
+	};
+
+	// Up to max records after sequence after, waiting up to timeout_ms
+	// for one. kTimedOut if none came, kNotFound if the next one was
+	// dropped already.
+	RetCode get(uint64_t after, size_t max, uint64_t timeout_ms,
+			std::vector<ChangeEntry>* out);
+
+	// Sequence of the latest record, 0 before the first
+	inline uint64_t last() const {
+		return committed.load(std::memory_order_acquire);
+	}
+
+private:
+	ChangeLog(const ChangeLog&) = delete;
+	ChangeLog& operator=(const ChangeLog&) = delete;
+
+	// Appends e to r, held by the caller
+	void push(Ring* r, const ChangeEntry& e);
+	// Makes the records up to seq visible, their batch being next in line
+	void commit(uint64_t seq);
+
+	size_t capacity;
+	Ring* rings;
+	size_t n_rings;
+	std::atomic<uint64_t> next;	// sequences handed out
+	std::atomic<uint64_t> committed;
+
+	// Only taken to wake tails, when some wait
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::atomic<size_t> waiters;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_CHANGE_LOG_H_
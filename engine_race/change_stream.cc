@@ -0,0 +1,22 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "change_stream.h"
+
+namespace polar_race {
+
+RetCode ShardedChangeStream::Next(ChangeVisitor& visitor, size_t max, uint64_t timeout_ms) {
+	RetCode ret(log->get(pos, max, timeout_ms, &batch));
+	if (ret != kSucc) {
+		return ret;
+	}
+	for (auto& e : batch) {
+		Item item;
+		item.p = e.p;
+		item.szKey = e.szKey;
+		item.szVal = e.szVal;
+		pos = e.seq;
+		shards[e.shard]->visitChange(e.seq, item, visitor);
+	}
+	return kSucc;
+}
+
+}  // namespace polar_race
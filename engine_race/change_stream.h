@@ -0,0 +1,37 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_CHANGE_STREAM_H_
+#define ENGINE_RACE_CHANGE_STREAM_H_
+
+#include <vector>
+
+#include "include/engine.h"
+#include "engine_race.h"
+
+namespace polar_race {
+
+// Follows the ChangeLog of a ShardedEngine. Positions are taken from the
+// rings under their mutexes; the bytes are then read from each record's
+// shard with them released, so writers only wait for the copy of the
+// positions.
+class ShardedChangeStream : public ChangeStream {
+public:
+	ShardedChangeStream(const std::vector<EngineRace*>& shards, ChangeLog* log,
+			uint64_t after)
+		: shards(shards), log(log), pos(after) {}
+
+	RetCode Next(ChangeVisitor& visitor, size_t max, uint64_t timeout_ms) override;
+
+	uint64_t sequence() const override {
+		return pos;
+	}
+
+private:
+	const std::vector<EngineRace*>& shards;
+	ChangeLog* log;
+	uint64_t pos;
+	std::vector<ChangeEntry> batch;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_CHANGE_STREAM_H_
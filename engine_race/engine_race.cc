@@ -3,12 +3,13 @@
 
 namespace polar_race {
 
-RetCode Engine::Open(const std::string& name, Engine** eptr) {
-  return EngineRace::Open(name, eptr);
-}
+namespace {
 
-Engine::~Engine() {
-}
+// Left by getPtrSafe for the stall detector in Read
+thread_local bool chunk_loaded(false);
+thread_local uint64_t disk_wait_ns(0);
+
+}  // namespace
 
 unsigned long long hashPolar(const char* s, int n) {
 	unsigned long long a(0);
@@ -26,13 +27,36 @@ unsigned long long hashPolar(const char* s, int n) {
 RetCode EngineRace::Open(const std::string& name, Engine** eptr) {
   *eptr = NULL;
   EngineRace *engine_race = new EngineRace(name);
-  engine_race->init(name);
+  RetCode ret = engine_race->init(name);
+  if (ret != kSucc) {
+    delete engine_race;
+    return ret;
+  }
   *eptr = engine_race;
   return kSucc;
 }
 
-void EngineRace::init(const std::string& name) {
-	std::ifstream meta_in(name + ".meta", std::ios::binary);
+RetCode EngineRace::init(const std::string& name) {
+	std::string meta_file(meta_path.size() ? meta_path : name + ".meta");
+	if (data_paths.empty()) {
+		data_paths.push_back(name + ".data");
+	}
+	if (read_only) {
+		meta_path = meta_file;
+		for (auto& path : data_paths) {
+			LogFile l;
+			l.fd = open(path.c_str(), O_RDONLY);
+			l.p_disk = 0;
+			l.fsz = 0;
+			l.msz = 0;
+			logs.push_back(l);
+		}
+		segs.reserve(max_segments);
+		return refresh();
+	}
+
+	std::vector<Item> meta;
+	std::ifstream meta_in(meta_file, std::ios::binary);
 	if (meta_in.is_open()) {
 		meta_in.seekg(0, meta_in.end);
 		n_items = meta_in.tellg() / sizeof(Item);
@@ -44,69 +68,137 @@ void EngineRace::init(const std::string& name) {
 		n_items = 0;
 	}
 
-	fd = open((name + ".data").c_str(), O_CREAT | O_RDWR | O_NOATIME, 0644);
-	if (fd == -1) {
-		fprintf(stderr, "Error %d\n", errno);
+	// Chunks are striped round-robin, chunk blk living in log file
+	// blk % logs.size(), so the highest chunk index is decided by
+	// whichever file reaches furthest.
+	size_t n_blks(0);
+	for (size_t f = 0; f < data_paths.size(); ++f) {
+		LogFile l;
+		l.fd = open(data_paths[f].c_str(), O_CREAT | O_RDWR | O_NOATIME, 0644);
+		l.p_disk = 0;
+		l.fsz = 0;
+		if (l.fd == -1) {
+			return kIOError;
+		}
+		if (meta.size()) {
+			struct stat st;
+			fstat(l.fd, &st);
+			l.fsz = st.st_size;
+			if (l.fsz & (chunk_size - 1)) {
+				l.fsz = (l.fsz & ~(chunk_size - 1)) + chunk_size;
+				ftruncate(l.fd, l.fsz);
+			}
+			if (l.fsz) {
+				l.p_disk = (char*)mmap(0, l.fsz, PROT_READ | PROT_WRITE, MAP_SHARED, l.fd, 0);
+				if (l.p_disk == MAP_FAILED) {
+					l.p_disk = 0;
+					logs.push_back(l);
+					return kIOError;
+				}
+				n_blks = std::max(n_blks, (l.fsz / chunk_size - 1) * data_paths.size() + f + 1);
+			}
+		}
+		logs.push_back(l);
 	}
-	if (meta.size()) {
-
-		std::ifstream data_in(name + ".data", std::ios::binary);
-		data_in.seekg(0, data_in.end);
-		fsz = data_in.tellg();
-		data_in.close();
+	datablks.resize(n_blks);
+	loaded_size = datablks.size();
+	p_synced = p_current = datablks.size();
 
-		if (fsz & (chunk_size - 1)) {
-			fsz = (fsz & chunk_size) + chunk_size;
-			ftruncate(fd, fsz);
+	segs.reserve(max_segments);
+	for (size_t k = 1; k <= std::min(max_segments, committed); ++k) {
+		Segment s;
+		if (access(segPath(k).c_str(), F_OK) != 0 || mapSegment(segPath(k), &s) != kSucc) {
+			break;
 		}
+		segs.push_back(s);
+	}
+	if (committed != -1u) {
+		if (segs.size() < committed) {
+			return kCorruption;
+		}
+		// Linked by an ingest that stopped before it was committed
+		for (size_t k = committed + 1; unlink(segPath(k).c_str()) == 0; ++k) {
+		}
+	}
 
-		p_disk = (char*)mmap(0, fsz, PROT_READ, MAP_SHARED, fd, 0);
+	// A log or segment shorter than meta says was lost or cut
+	for (size_t i = 0; i < meta.size(); ++i) {
+		size_t k(meta[i].p >> seg_shift);
+		if (k ? k > segs.size() : meta[i].p / chunk_size >= n_blks) {
+			return kCorruption;
+		}
+	}
 
-		for (size_t offset = 0; offset < fsz; offset += chunk_size) {
-			datablks.push_back(DataBlk());
+	// Rebuilding the lookup maps touches the key of every item. Load the
+	// chunks holding them first, one reader per log file, so the files
+	// are read in parallel.
+	std::vector<bool> needed(n_blks, false);
+	for (size_t i = 0; i < meta.size(); ++i) {
+		if ((meta[i].p >> seg_shift) == 0) {
+			needed[meta[i].p / chunk_size] = true;
 		}
-		loaded_size = datablks.size();
-		p_synced = p_current = datablks.size();
-	} else {
-		p_disk = 0;
-		fsz = 0;
-		p_synced = p_current = 0;
+	}
+	std::vector<std::thread> loaders;
+	for (size_t f = 0; f < logs.size() && f < n_blks; ++f) {
+		loaders.push_back(std::thread([this, f, &needed] {
+			for (size_t blk = f; blk < needed.size(); blk += logs.size()) {
+				if (needed[blk]) {
+					getPtrSafe(blk, false);
+				}
+			}
+		}));
+	}
+	for (auto& t : loaders) {
+		t.join();
 	}
 
 	for (size_t i = 0; i < meta.size(); ++i) {
 		if (meta[i].szKey > 8) {
-			lookup_long[std::string(getMemory(meta[i].p), meta[i].szKey)] = i;
+			lookup_long.insert(getMemory(meta[i].p), meta[i].szKey, i);
 		} else {
 			lookup_short[hashPolar(getMemory(meta[i].p), meta[i].szKey)] = i;
 		}
 	}
+	// Each meta entry is a distinct key
+	for (size_t i = 0; i < meta.size(); ++i) {
+		versions.push(meta[i], 0, inlineValue(meta[i]));
+		unordered.push_back(i);
+	}
 
 	sz_current = 0;
 	sz_synced = 0;
 
-	ou_meta.open(name + ".meta", std::ios::binary);
+	// Opening for output alone would truncate the file, while flush() only
+	// rewrites the blocks it touched
+	std::ofstream(meta_file, std::ios::binary | std::ios::app).close();
+	ou_meta.open(meta_file, std::ios::binary | std::ios::in | std::ios::out);
+	if (redo_from != -1u && segs.size()) {
+		redoSegment(redo_from);
+	}
 
 	alive = true;
 	flushing = false;
 	this->p_daemon = new std::thread(&EngineRace::daemon, this);
 	this->p_recyc = new std::thread(&EngineRace::recycle, this);
-	this->p_monitor = new std::thread(&EngineRace::monitor, this);
+	return kSucc;
 }
 
 // 2. Close engine
 EngineRace::~EngineRace() {
-	journal_mtx.lock();
-	flush();
-	journal_mtx.unlock();
+	// Nothing was written unless init got as far as starting the threads
+	if (p_daemon) {
+		journal_mtx.lock();
+		flush();
+		journal_mtx.unlock();
 
-	alive = false;
-	this->p_daemon->join();
-	this->p_recyc->join();
-	this->p_monitor->join();
+		alive = false;
+		this->p_daemon->join();
+		this->p_recyc->join();
+	}
 
 	for (auto& b : datablks) {
 		if (b.pmem) {
-			delete [] b.pmem;
+			freeChunk(b.pmem);
 		}
 	}
 	datablks.resize(0);
@@ -115,31 +207,80 @@ EngineRace::~EngineRace() {
 	delete [] idxs;
 	delete [] ready;
 
-	if (p_disk) {
-		munmap(p_disk, fsz);
+	for (auto& l : logs) {
+		if (l.p_disk) {
+			munmap(l.p_disk, read_only ? l.msz : l.fsz);
+		}
+		close(l.fd);
 	}
-	close(fd);
+	for (auto& m : old_maps) {
+		munmap(m.first, m.second);
+	}
+	for (auto& s : segs) {
+		munmap(s.p, s.size);
+	}
+	for (auto b : key_blocks) {
+		delete [] b;
+	}
+	delete hot;
 }
 
 // 3. Write a key-value pair into engine
 RetCode EngineRace::Write(const PolarString& key, const PolarString& value) {
-	journal_mtx.lock();
+	if (read_only) {
+		return kNotSupported;
+	}
+	uint64_t start(stalls ? nowNs() : 0);
+	size_t flushes(n_flushes.load());
+	{
+		TraceScope t(tracer, kTraceJournalLock);
+		journal_mtx.lock();
+	}
+	if (stalls) {
+		// A flush that ran meanwhile held the lock for most of the wait
+		uint64_t ns(nowNs() - start);
+		if (stalls->isStall(ns)) {
+			if (n_flushes.load() != flushes) {
+				reportStall("write", ns, last_flush);
+			} else {
+				reportStall("write", ns, "journal_mtx", 0, false);
+			}
+		}
+	}
 	size_t idx(n_journal++);
 	journal[idx].szKey = key.size();
 	journal[idx].szVal = value.size();
 	journal[idx].p = this->allocMemory(key.size() + value.size());
 
 	if (n_journal < max_journal) {
+		size_t gen(flush_gen);
 		ready[idx].lock();
 		journal_mtx.unlock();
 		this->copyToMemory(idx, journal[idx].p, key, value);
 		ready[idx].unlock();
 
-		std::unique_lock<std::mutex> lck(ret_mtx);
-		ret_cv.wait(lck);
+		// The flush covering idx may finish before we get here
+		TraceScope t(tracer, kTraceRetWait);
+		start = stalls ? nowNs() : 0;
+		ret_mtx.lock();
+		ret_mtx.wait(ret_cv, [this, gen] { return flush_gen != gen; });
+		ret_mtx.unlock();
+		if (stalls) {
+			uint64_t ns(nowNs() - start);
+			if (stalls->isStall(ns)) {
+				reportStall("write", ns, last_flush);
+			}
+		}
 	} else {
 		this->copyToMemory(idx, journal[idx].p, key, value);
+		start = stalls ? nowNs() : 0;
 		this->flush();
+		if (stalls) {
+			uint64_t ns(nowNs() - start);
+			if (stalls->isStall(ns)) {
+				reportStall("write", ns, last_flush);
+			}
+		}
 		journal_mtx.unlock();
 	}
 	return kSucc;
@@ -150,7 +291,7 @@ size_t EngineRace::allocMemory(size_t totsz) {
 		++p_current;
 	}
 	if (datablks.size() <= p_current) {
-		DataBlk ptr(new char[chunk_size]);
+		DataBlk ptr(allocChunk());
 		datablks.push_back(ptr);
 		sz_current = 0;
 	}
@@ -167,90 +308,424 @@ void EngineRace::copyToMemory(size_t idx, size_t ptr, const PolarString& key, co
 }
 
 void EngineRace::flush() {
+	ScopedLatency lat(stats, StatsRecorder::kFlush);
+	TraceScope op(tracer, kTraceFlush);
+	// The index grows here, on whichever writer filled the journal
+	Numa::PreferScope prefer(numa_node);
 	flushing = true;
-	static const size_t blk_upd_chk = 5;
 	std::unordered_set<size_t> blk_to_upd;
+	static const char* phase_names[] = {
+		"flush_index", "file_grow", "flush_copy", "meta_write",
+	};
+	uint64_t phase_end[5] = { nowNs() };
+	bool grew(false);
+	// Taken under journal_mtx, which GetSnapshot holds on every shard
+	uint64_t seq(snapshots ? snapshots->next() : 0);
+	bool keep(snapshots && snapshots->live());
 
-	for (size_t i = 0; i < n_journal; ++i) {
-		ready[i].lock();
-		ready[i].unlock();
-		size_t idx(idxs[i]);
-		if (idx == -1u) {
-			idx = meta.size();
-			if (journal[i].szKey > 8) {
-				lookup_long[std::string(getMemory(journal[i].p), journal[i].szKey)] = idx;
-			} else {
-				lookup_short[hashPolar(getMemory(journal[i].p), journal[i].szKey)] = idx;
+	{
+		TraceScope t(tracer, kTraceFlushIndex);
+		for (size_t i = 0; i < n_journal; ++i) {
+			ready[i].lock();
+			ready[i].unlock();
+			size_t idx(idxs[i]);
+			if (idx == -1u) {
+				// An earlier record of this batch may have added the key
+				idx = find(PolarString(getMemory(journal[i].p), journal[i].szKey));
 			}
-			meta.push_back(journal[i]);
-		} else {
-			meta[idx] = journal[i];
+			putItem(journal[i], idx, seq, keep, &blk_to_upd);
 		}
-
-		blk_to_upd.insert(idx >> blk_upd_chk);
 	}
+	phase_end[1] = nowNs();
 
-	if (fsz < (p_current + 1) * chunk_size) {
-        auto old_fsz(fsz);
-		if (fsz == 0) {
-			fsz = (p_current + 1) * chunk_size;
+	for (size_t f = 0; f < logs.size() && f <= p_current; ++f) {
+		LogFile& l(logs[f]);
+		size_t need((p_current - f) / logs.size() + 1);
+		if (l.fsz >= need * chunk_size) {
+			continue;
+		}
+		TraceScope t(tracer, kTraceFileGrow);
+		auto old_fsz(l.fsz);
+		if (l.fsz == 0) {
+			l.fsz = need * chunk_size;
 		} else {
-			fsz = fsz * 2;
-		}
-		ftruncate(fd, fsz);
-		char* new_p_disk = (char*)mmap(0, fsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-		if (p_disk != 0) {
-            p_disk_mtx.lock();
-			munmap(p_disk, old_fsz);
-            p_disk = new_p_disk;
-            p_disk_mtx.unlock();
-        } else {
-            p_disk = new_p_disk;
-        }
-    }
+			l.fsz = std::max(l.fsz * 2, need * chunk_size);
+		}
+		ftruncate(l.fd, l.fsz);
+		char* new_p_disk = (char*)mmap(0, l.fsz, PROT_READ | PROT_WRITE, MAP_SHARED, l.fd, 0);
+		if (l.p_disk != 0) {
+			p_disk_mtx.lock();
+			munmap(l.p_disk, old_fsz);
+			l.p_disk = new_p_disk;
+			p_disk_mtx.unlock();
+		} else {
+			l.p_disk = new_p_disk;
+		}
+		grew = true;
+		++n_grows;
+	}
+	phase_end[2] = nowNs();
 
-	for (size_t i = p_synced; i < p_current; ++i) {
-		memcpy(getDiskPtr(i), datablks[i].pmem, chunk_size);
+	{
+		TraceScope t(tracer, kTraceFlushCopy);
+		for (size_t i = p_synced; i < p_current; ++i) {
+			memcpy(getDiskPtr(i), datablks[i].pmem, chunk_size);
+		}
+		if (p_synced == p_current) {
+			if (sz_current > sz_synced) {
+				char* pdisk(getDiskPtr(p_synced) + sz_synced);
+				char* p_mem(datablks[p_synced].pmem + sz_synced);
+				memcpy(pdisk, p_mem, sz_current - sz_synced); 
+			}
+		} else if (sz_current > 0) {
+			memcpy(getDiskPtr(p_current), datablks[p_current].pmem, sz_current);
+		}
+	}
+	phase_end[3] = nowNs();
+
+	{
+		TraceScope t(tracer, kTraceMetaWrite);
+		writeMeta(blk_to_upd);
 	}
-	if (p_synced == p_current) {
-		if (sz_current > sz_synced) {
-            char* pdisk(getDiskPtr(p_synced) + sz_synced);
-            char* p_mem(datablks[p_synced].pmem + sz_synced);
-			memcpy(pdisk, p_mem, sz_current - sz_synced); 
+	phase_end[4] = nowNs();
+
+	// Before any writer of the batch returns, so the stream follows the
+	// order writes were acknowledged in
+	if (changes && n_journal) {
+		ChangeLog::Appender a(changes, shard, n_journal);
+		for (size_t i = 0; i < n_journal; ++i) {
+			a.add(journal[i].p, journal[i].szKey, journal[i].szVal);
 		}
-	} else if (sz_current > 0) {
-		memcpy(getDiskPtr(p_current), datablks[p_current].pmem, sz_current);
 	}
 
-	for (size_t p : blk_to_upd) {
-		p <<= blk_upd_chk;
-		ou_meta.seekp(p * sizeof(Item));
-		ou_meta.write((char*)meta.data() + p * sizeof(Item),
-				std::min(meta.size() - p, (size_t)(1lu << blk_upd_chk)) * sizeof(Item));
+	size_t longest(0);
+	for (size_t i = 1; i < 4; ++i) {
+		if (phase_end[i + 1] - phase_end[i] > phase_end[longest + 1] - phase_end[longest]) {
+			longest = i;
+		}
 	}
-	ou_meta.flush();
 
 	p_synced = p_current;
 	sz_synced = sz_current;
-    n_ops += n_journal;
+	if (stats) {
+		stats->add(StatsRecorder::kFlushedRecords, n_journal);
+	}
+	size_t batch(n_journal);
 	n_journal = 0;
+	ret_mtx.lock();
+	last_flush.batch = batch;
+	last_flush.grew = grew;
+	last_flush.phase = phase_names[longest];
+	++flush_gen;
+	ret_mtx.unlock();
+	++n_flushes;
 	ret_cv.notify_all();
 	flushing = false;
 }
 
+// Makes item the version of its key, idx, or a new key if idx is -1u.
+// Needs journal_mtx.
+size_t EngineRace::putItem(const Item& item, size_t idx, uint64_t seq, bool keep,
+		std::unordered_set<size_t>* blk_to_upd) {
+	if (idx == -1u) {
+		idx = versions.size();
+		if (item.szKey > 8) {
+			lookup_long.insert(getMemory(item.p), item.szKey, idx);
+		} else {
+			lookup_short[hashPolar(getMemory(item.p), item.szKey)] = idx;
+		}
+		versions.push(item, seq, inlineValue(item));
+		unordered.push_back(idx);
+	} else {
+		// Until an ingest is revealed, everyone reads what it replaced
+		uint64_t born;
+		Item old(versions.latest(idx, &born));
+		keep = seq == VersionTable::pending || (keep && snapshots->pinned(born, seq));
+		versions.set(idx, item, seq, keep, inlineValue(item));
+		if (hot) {
+			hot->invalidate(idx, old.szVal);
+		}
+	}
+	blk_to_upd->insert(idx >> blk_upd_chk);
+	return idx;
+}
+
+void EngineRace::writeMeta(const std::unordered_set<size_t>& blk_to_upd) {
+	Item blk[1 << blk_upd_chk];
+	size_t n(versions.size());
+	for (size_t p : blk_to_upd) {
+		p <<= blk_upd_chk;
+		size_t m(std::min(n - p, (size_t)(1lu << blk_upd_chk)));
+		for (size_t i = 0; i < m; ++i) {
+			blk[i] = versions.latest(p + i);
+		}
+		ou_meta.seekp(p * sizeof(Item));
+		ou_meta.write((char*)blk, m * sizeof(Item));
+	}
+	ou_meta.flush();
+}
+
+std::string EngineRace::segPath(size_t k) {
+	return data_paths[0] + ".seg" + std::to_string(k);
+}
+
+RetCode EngineRace::mapSegment(const std::string& path, Segment* s) {
+	int fd(open(path.c_str(), O_RDONLY));
+	if (fd == -1) {
+		return kIOError;
+	}
+	struct stat st;
+	fstat(fd, &st);
+	s->size = st.st_size;
+	s->p = s->size < sizeof(SegmentFooter) ? (char*)MAP_FAILED :
+		(char*)mmap(0, s->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (s->p == MAP_FAILED) {
+		return kCorruption;
+	}
+	const SegmentFooter* f((const SegmentFooter*)(s->p + s->size - sizeof(SegmentFooter)));
+	if (memcmp(f->magic, kSegmentMagic, sizeof(f->magic)) != 0 ||
+			f->version != kSegmentVersion ||
+			f->index_offset + f->records * sizeof(SegmentEntry) + sizeof(SegmentFooter) != s->size) {
+		munmap(s->p, s->size);
+		return kCorruption;
+	}
+	return kSucc;
+}
+
+// A hard link shares the bytes; across file systems they are copied.
+RetCode EngineRace::openSegment(const std::string& path, uint32_t shard, uint32_t shards) {
+	if (segs.size() == max_segments) {
+		return kFull;
+	}
+	std::string dest(segPath(segs.size() + 1));
+	RetCode ret(linkOrCopy(path, dest));
+	if (ret != kSucc) {
+		return ret;
+	}
+	Segment s;
+	ret = mapSegment(dest, &s);
+	if (ret == kSucc) {
+		const SegmentFooter* f((const SegmentFooter*)(s.p + s.size - sizeof(SegmentFooter)));
+		if (f->shard != shard || f->shards != shards) {
+			munmap(s.p, s.size);
+			ret = kInvalidArgument;
+		}
+	}
+	if (ret != kSucc) {
+		unlink(dest.c_str());
+		return ret;
+	}
+	segs.push_back(s);
+	return kSucc;
+}
+
+void EngineRace::dropSegment() {
+	Segment& s(segs.back());
+	munmap(s.p, s.size);
+	unlink(segPath(segs.size()).c_str());
+	segs.pop_back();
+}
+
+// A slot looked up ahead may have been added since, by a flush or an
+// earlier record
+void EngineRace::applySegment(uint64_t after) {
+	size_t k(segs.size());
+	const Segment& s(segs.back());
+	const SegmentFooter* f((const SegmentFooter*)(s.p + s.size - sizeof(SegmentFooter)));
+	const SegmentEntry* e((const SegmentEntry*)(s.p + f->index_offset));
+	std::vector<size_t> found(f->records);
+	for (size_t i = 0; i < f->records; ++i) {
+		found[i] = find(PolarString(s.p + e[i].offset, e[i].key_len));
+	}
+	ingested.clear();
+	std::vector<size_t> applied;
+	for (size_t b = 0; b < f->records; b += ingest_batch) {
+		size_t end(std::min<size_t>(f->records, b + ingest_batch));
+		std::unordered_set<size_t> blk_to_upd;
+		applied.clear();
+		std::lock_guard<ProfiledMutex> lck(journal_mtx);
+		for (size_t i = b; i < end; ++i) {
+			size_t idx(found[i]);
+			if (idx == -1u) {
+				idx = find(PolarString(s.p + e[i].offset, e[i].key_len));
+			}
+			uint64_t born(0);
+			if (idx != -1u) {
+				versions.latest(idx, &born);
+			}
+			if (born > after) {
+				continue;
+			}
+			Item item;
+			item.p = k << seg_shift | e[i].offset;
+			item.szKey = e[i].key_len;
+			item.szVal = e[i].value_len;
+			ingested.push_back(putItem(item, idx, VersionTable::pending, true, &blk_to_upd));
+			applied.push_back(i);
+		}
+		writeMeta(blk_to_upd);
+		// In step with the versions, so a write after a record follows it
+		if (changes && applied.size()) {
+			ChangeLog::Appender a(changes, shard, applied.size());
+			for (size_t i : applied) {
+				a.add(k << seg_shift | e[i].offset, e[i].key_len, e[i].value_len);
+			}
+		}
+	}
+}
+
+void EngineRace::settleSegment() {
+	for (size_t b = 0; b < ingested.size(); b += ingest_batch) {
+		std::lock_guard<ProfiledMutex> lck(journal_mtx);
+		for (size_t i = b; i < std::min(ingested.size(), b + ingest_batch); ++i) {
+			versions.settle(ingested[i]);
+		}
+	}
+	std::lock_guard<ProfiledMutex> lck(journal_mtx);
+	versions.settled();
+	std::vector<size_t>().swap(ingested);
+}
+
+// Every record is in the log or a segment, and the log only grows, so
+// Item::p tells whether the ingest or a write came last
+void EngineRace::redoSegment(size_t log_end) {
+	size_t k(segs.size());
+	const Segment& s(segs.back());
+	const SegmentFooter* f((const SegmentFooter*)(s.p + s.size - sizeof(SegmentFooter)));
+	const SegmentEntry* e((const SegmentEntry*)(s.p + f->index_offset));
+	std::unordered_set<size_t> blk_to_upd;
+	for (size_t i = 0; i < f->records; ++i) {
+		size_t idx(find(PolarString(s.p + e[i].offset, e[i].key_len)));
+		if (idx != -1u) {
+			Item cur(versions.latest(idx));
+			size_t in(cur.p >> seg_shift);
+			if (in == k || (in == 0 && cur.p >= log_end)) {
+				continue;
+			}
+		}
+		Item item;
+		item.p = k << seg_shift | e[i].offset;
+		item.szKey = e[i].key_len;
+		item.szVal = e[i].value_len;
+		putItem(item, idx, 0, false, &blk_to_upd);
+	}
+	writeMeta(blk_to_upd);
+}
+
 // 4. Read value of a key
+// refresh adds keys to the index under journal_mtx, and a read-only
+// instance has no journal to contend for it
 RetCode EngineRace::Read(const PolarString& key, std::string* value) {
-	size_t idx(find(key));
-	if (idx != -1u) {
-		value->resize(meta[idx].szVal);
-        size_t ptr(meta[idx].p + meta[idx].szKey);
-        char* dataptr(getMemory(ptr, true));
-		memcpy((char*)value->data(), dataptr, meta[idx].szVal);
-        relieveMemory(ptr);
-        return kSucc;
+	size_t idx;
+	if (read_only) {
+		std::lock_guard<ProfiledMutex> lck(journal_mtx);
+		idx = find(key);
 	} else {
+		idx = find(key);
+	}
+	if (idx == -1u) {
+		return kNotFound;
+	}
+	uint64_t start(stalls ? nowNs() : 0);
+	size_t grows(n_grows.load());
+	if (!readItem(idx, value)) {
 		return kNotFound;
 	}
+	if (stalls) {
+		uint64_t ns(nowNs() - start);
+		if (stalls->isStall(ns)) {
+			const char* cause(disk_wait_ns * 2 > ns ? "p_disk_mtx" :
+					chunk_loaded ? "chunk_load" : "DataBlk::op");
+			reportStall("read", ns, cause, 0, n_grows.load() != grows);
+		}
+	}
+	return kSucc;
+}
+
+void EngineRace::reportStall(const char* op, uint64_t ns, const char* cause,
+		size_t batch, bool grew) {
+	StallEvent e;
+	e.time_ns = realtimeNs() - ns;
+	e.duration_ns = ns;
+	e.op = op;
+	e.cause = cause;
+	e.flush_batch = batch;
+	e.file_grew = grew;
+	stalls->add(e);
+}
+
+bool EngineRace::readItem(size_t idx, std::string* value) {
+	uint64_t inlined;
+	Item item;
+	if (!versions.resolve(idx, latest, &item, &inlined)) {
+		return false;
+	}
+	if (item.szVal <= max_inline) {
+		value->assign((const char*)&inlined, item.szVal);
+		return true;
+	}
+	if (hot == 0) {
+		readItem(item, value);
+	} else if (hot->lookup(idx, item.p, item.szVal, value)) {
+		if (stats) {
+			stats->add(StatsRecorder::kHotCacheHits, 1);
+		}
+	} else {
+		readItem(item, value);
+		// A write may have come and invalidated the slot meanwhile
+		if (hot->admit(idx, item.p, value->data(), value->size()) &&
+				versions.latest(idx).p != item.p) {
+			hot->invalidate(idx, item.szVal);
+		}
+	}
+	return true;
+}
+
+void EngineRace::readItem(const Item& item, uint64_t inlined, std::string* value) {
+	if (item.szVal <= max_inline) {
+		value->assign((const char*)&inlined, item.szVal);
+	} else {
+		readItem(item, value);
+	}
+}
+
+void EngineRace::readItem(const Item& item, std::string* value) {
+	value->resize(item.szVal);
+	size_t ptr(item.p + item.szKey);
+	char* dataptr(getMemory(ptr, true));
+	memcpy((char*)value->data(), dataptr, item.szVal);
+	relieveMemory(ptr);
+}
+
+void EngineRace::visitChange(uint64_t sequence, const Item& item, ChangeVisitor& visitor) {
+	const char* p(getMemory(item.p, true));
+	visitor.Visit(sequence, PolarString(p, item.szKey), PolarString(p + item.szKey, item.szVal));
+	relieveMemory(item.p);
+}
+
+// Only the index probe needs journal_mtx. The version is resolved
+// without it, and its bytes never change.
+RetCode EngineRace::readAt(const PolarString& key, uint64_t seq, std::string* value) {
+	journal_mtx.lock();
+	size_t idx(find(key));
+	journal_mtx.unlock();
+	Item item;
+	uint64_t inlined;
+	if (idx == -1u || !versions.resolve(idx, seq, &item, &inlined)) {
+		return kNotFound;
+	}
+	readItem(item, inlined, value);
+	return kSucc;
+}
+
+// Keeps flush() out, as the only other writer of versions
+void EngineRace::pruneVersions() {
+	if (snapshots == 0) {
+		return;
+	}
+	std::lock_guard<ProfiledMutex> lck(journal_mtx);
+	versions.prune(snapshots);
 }
 
 template<class T>
@@ -265,7 +740,7 @@ size_t t_find(std::unordered_map<T, size_t>& lookup, T key) {
 
 size_t EngineRace::find(const PolarString& key) {
 	if (key.size() > 8) {
-		return t_find(lookup_long, key.ToString());
+		return lookup_long.find(key.data(), key.size());
 	} else {
 		return t_find(lookup_short, hashPolar(key.data(), key.size()));
 	}
@@ -284,9 +759,406 @@ size_t EngineRace::find(const PolarString& key) {
 //   Range("", "", visitor)
 RetCode EngineRace::Range(const PolarString& lower, const PolarString& upper,
 		Visitor &visitor) {
+	static const size_t batch = 256;
+	sortKeys();
+	std::vector<std::pair<std::string, size_t> > keys;
+	std::string from, value;
+	bool more(orderedKeys(NULL, true, true, lower, upper, batch, &keys));
+	for (;;) {
+		for (auto& k : keys) {
+			if (readItem(k.second, &value)) {
+				visitor.Visit(k.first, value);
+			}
+		}
+		if (!more) {
+			break;
+		}
+		from.swap(keys.back().first);
+		more = orderedKeys(&from, false, true, lower, upper, batch, &keys);
+	}
 	return kSucc;
 }
 
+void EngineRace::sortKeys() {
+	mergeOrdered();
+}
+
+bool EngineRace::orderedKeys(const std::string* from, bool inclusive, bool forward,
+		const PolarString& lower, const PolarString& upper, size_t max,
+		std::vector<std::pair<std::string, size_t> >* keys) {
+	keys->clear();
+	auto less = [](const OrderedKey& a, const PolarString& b) {
+		return PolarString(a.key, a.szKey).compare(b) < 0;
+	};
+	auto greater = [](const PolarString& a, const OrderedKey& b) {
+		return a.compare(PolarString(b.key, b.szKey)) < 0;
+	};
+	size_t b, e;
+	std::shared_ptr<const Ordered> o(boundedRange(lower, upper, &b, &e));
+	const std::vector<OrderedKey>& ks(o->keys);
+	// Keys [i, j) go up from i; going down, they end at j
+	size_t i(b), j(e);
+	if (from && forward) {
+		PolarString f(*from);
+		i = (inclusive ? std::lower_bound(ks.begin() + b, ks.begin() + e, f, less) :
+				std::upper_bound(ks.begin() + b, ks.begin() + e, f, greater)) - ks.begin();
+		j = std::min(e, i + max);
+	} else if (from) {
+		PolarString f(*from);
+		j = (inclusive ? std::upper_bound(ks.begin() + b, ks.begin() + e, f, greater) :
+				std::lower_bound(ks.begin() + b, ks.begin() + e, f, less)) - ks.begin();
+		i = j - std::min(j - b, max);
+	} else if (forward) {
+		j = std::min(e, i + max);
+	} else {
+		i = j - std::min(j - b, max);
+	}
+	keys->reserve(j - i);
+	if (forward) {
+		for (size_t k = i; k < j; ++k) {
+			keys->push_back(std::make_pair(std::string(ks[k].key, ks[k].szKey), ks[k].idx));
+		}
+		return j < e;
+	}
+	for (size_t k = j; k > i; --k) {
+		keys->push_back(std::make_pair(std::string(ks[k - 1].key, ks[k - 1].szKey),
+					ks[k - 1].idx));
+	}
+	return i > b;
+}
+
+uint64_t EngineRace::approximateSize(const PolarString& lower,
+		const PolarString& upper) {
+	size_t b, e;
+	std::shared_ptr<const Ordered> o(orderedRange(lower, upper, &b, &e));
+	return o->bytes[e] - o->bytes[b];
+}
+
+void EngineRace::sampleKeys(const PolarString& lower, const PolarString& upper,
+		size_t m, std::vector<std::pair<std::string, uint64_t> >* samples) {
+	size_t b, e;
+	std::shared_ptr<const Ordered> o(orderedRange(lower, upper, &b, &e));
+	if (b == e || m == 0) {
+		return;
+	}
+	const std::vector<uint64_t>& by(o->bytes);
+	uint64_t base(by[b]), bytes(by[e] - base);
+	size_t last(e);
+	for (size_t j = 0; j < m; ++j) {
+		// The key whose bytes hold offset base + bytes * j / m
+		size_t i(std::upper_bound(by.begin() + b, by.begin() + e,
+					base + bytes * j / m) - by.begin() - 1);
+		if (i == last) {
+			continue;
+		}
+		if (last != e) {
+			samples->back().second = by[i] - by[last];
+		}
+		samples->push_back(std::make_pair(std::string(o->keys[i].key, o->keys[i].szKey),
+					by[e] - by[i]));
+		last = i;
+	}
+}
+
+// [*b, *e) of the ordered keys returned holds the keys of [lower, upper)
+std::shared_ptr<const EngineRace::Ordered> EngineRace::orderedRange(
+		const PolarString& lower, const PolarString& upper, size_t* b, size_t* e) {
+	mergeOrdered();
+	return boundedRange(lower, upper, b, e);
+}
+
+// Like orderedRange, leaving out the keys not sorted in yet
+std::shared_ptr<const EngineRace::Ordered> EngineRace::boundedRange(
+		const PolarString& lower, const PolarString& upper, size_t* b, size_t* e) {
+	std::shared_ptr<const Ordered> o;
+	{
+		std::lock_guard<std::mutex> lck(ordered_mtx);
+		o = ordered;
+	}
+	auto less = [](const OrderedKey& a, const PolarString& b) {
+		return PolarString(a.key, a.szKey).compare(b) < 0;
+	};
+	const std::vector<OrderedKey>& ks(o->keys);
+	*b = lower.empty() ? 0 :
+		std::lower_bound(ks.begin(), ks.end(), lower, less) - ks.begin();
+	*e = upper.empty() ? ks.size() :
+		std::lower_bound(ks.begin() + *b, ks.end(), upper, less) - ks.begin();
+	*e = std::max(*b, *e);
+	return o;
+}
+
+// Copies sz bytes of key into key_blocks. A key longer than a block
+// gets one of its own. Needs merge_mtx.
+const char* EngineRace::internKey(const char* key, size_t sz) {
+	if (key_blocks.empty() || key_block_used + sz > key_block_size) {
+		size_t block(std::max(sz, key_block_size));
+		key_blocks.push_back(new char[block]);
+		ordered_key_bytes.fetch_add(block, std::memory_order_relaxed);
+		key_block_used = 0;
+	}
+	char* p(key_blocks.back() + key_block_used);
+	memcpy(p, key, sz);
+	key_block_used += sz;
+	return p;
+}
+
+// Short keys are only known by hash, so every new key is read back from
+// the data. journal_mtx is only held to take the new keys, and scans keep
+// the ordered keys they took while the merged copy is built; the bytes
+// of the keys there already are carried over from it rather than looked
+// up again.
+void EngineRace::mergeOrdered() {
+	std::lock_guard<std::mutex> merge_lck(merge_mtx);
+	std::vector<size_t> added;
+	{
+		std::lock_guard<ProfiledMutex> lck(journal_mtx);
+		added.swap(unordered);
+	}
+	if (added.empty()) {
+		return;
+	}
+	// The new keys with their key and value bytes
+	std::vector<std::pair<OrderedKey, uint64_t> > run(added.size());
+	for (size_t i = 0; i < added.size(); ++i) {
+		Item item(versions.latest(added[i]));
+		run[i].first.key = internKey(getMemory(item.p, true), item.szKey);
+		run[i].first.szKey = item.szKey;
+		run[i].first.idx = added[i];
+		run[i].second = item.szKey + item.szVal;
+		relieveMemory(item.p);
+	}
+	auto before = [](const OrderedKey& a, const OrderedKey& b) {
+		return PolarString(a.key, a.szKey).compare(PolarString(b.key, b.szKey)) < 0;
+	};
+	std::sort(run.begin(), run.end(), [&before](const std::pair<OrderedKey, uint64_t>& a,
+				const std::pair<OrderedKey, uint64_t>& b) {
+		return before(a.first, b.first);
+	});
+
+	std::shared_ptr<const Ordered> old;
+	{
+		std::lock_guard<std::mutex> lck(ordered_mtx);
+		old = ordered;
+	}
+	std::shared_ptr<Ordered> merged(new Ordered);
+	const std::vector<OrderedKey>& ks(old->keys);
+	merged->keys.reserve(ks.size() + run.size());
+	merged->bytes.reserve(ks.size() + run.size() + 1);
+	size_t i(0), j(0);
+	while (i < ks.size() || j < run.size()) {
+		uint64_t sz;
+		if (j == run.size() || (i < ks.size() && before(ks[i], run[j].first))) {
+			merged->keys.push_back(ks[i]);
+			sz = old->bytes[i + 1] - old->bytes[i];
+			++i;
+		} else {
+			merged->keys.push_back(run[j].first);
+			sz = run[j].second;
+			++j;
+		}
+		merged->bytes.push_back(merged->bytes.back() + sz);
+	}
+	std::lock_guard<std::mutex> lck(ordered_mtx);
+	ordered = merged;
+}
+
+void EngineRace::prefetch(const Item& item, size_t* last) {
+	if ((item.p >> seg_shift) || read_only) {
+		size_t page(sysconf(_SC_PAGESIZE));
+		uintptr_t b((uintptr_t)getMemory(item.p + item.szKey));
+		madvise((void*)(b & ~(page - 1)), b % page + item.szVal, MADV_WILLNEED);
+		return;
+	}
+	size_t blk((item.p + item.szKey) / chunk_size);
+	if (blk == *last || blk >= p_synced || datablks[blk].pmem) {
+		return;
+	}
+	*last = blk;
+	p_disk_mtx.lock();
+	madvise(getDiskPtr(blk), chunk_size, MADV_WILLNEED);
+	p_disk_mtx.unlock();
+}
+
+// Chunks up to p_synced hold everything flushed
+void EngineRace::checkpointState(CheckpointState* st) {
+	st->meta.resize(versions.size());
+	for (size_t i = 0; i < st->meta.size(); ++i) {
+		st->meta[i] = versions.latest(i);
+	}
+	st->log_ends.assign(logs.size(), 0);
+	for (size_t f = 0; f < logs.size() && f <= p_synced; ++f) {
+		st->log_ends[f] = std::min(((p_synced - f) / logs.size() + 1) * chunk_size, logs[f].fsz);
+	}
+	st->segments = segs.size();
+}
+
+RetCode EngineRace::writeCheckpoint(const CheckpointState& st, const std::string& name,
+		const Config& conf, const std::map<std::string, uint64_t>& copied,
+		std::map<std::string, uint64_t>* lens) {
+	std::vector<std::string> paths(conf.data_paths);
+	if (paths.empty()) {
+		paths.push_back(name + ".data");
+	}
+	if (paths.size() != logs.size()) {
+		return kInvalidArgument;
+	}
+	for (size_t f = 0; f < logs.size(); ++f) {
+		auto it(copied.find(paths[f]));
+		uint64_t done(it == copied.end() ? 0 : it->second);
+		int out(open(paths[f].c_str(), O_WRONLY | O_CREAT, 0644));
+		if (out == -1) {
+			return kIOError;
+		}
+		// The last chunk copied before may have been filled since
+		struct stat o;
+		size_t from(fstat(out, &o) == 0 && (uint64_t)o.st_size >= done && done <= st.log_ends[f] ?
+				done - std::min<uint64_t>(done, chunk_size) : 0);
+		RetCode ret(ftruncate(out, st.log_ends[f]) == 0 ?
+				copyRange(logs[f].fd, out, from, st.log_ends[f] - from) : kIOError);
+		if (ret == kSucc && fdatasync(out) != 0) {
+			ret = kIOError;
+		}
+		close(out);
+		if (ret != kSucc) {
+			return ret;
+		}
+		(*lens)[paths[f]] = st.log_ends[f];
+	}
+
+	// Segments never change, so they are shared
+	for (size_t k = 1; k <= st.segments; ++k) {
+		RetCode ret(linkOrCopy(segPath(k), paths[0] + ".seg" + std::to_string(k)));
+		if (ret != kSucc) {
+			return ret;
+		}
+	}
+	for (size_t k = st.segments + 1; unlink((paths[0] + ".seg" + std::to_string(k)).c_str()) == 0; ++k) {
+	}
+
+	std::string meta_file(conf.meta_path.size() ? conf.meta_path : name + ".meta");
+	std::ofstream ou(meta_file, std::ios::binary | std::ios::trunc);
+	ou.write((const char*)st.meta.data(), st.meta.size() * sizeof(Item));
+	ou.close();
+	if (!ou) {
+		return kIOError;
+	}
+	RetCode ret(syncFile(meta_file));
+	return ret == kSucc ? syncDir(meta_file) : ret;
+}
+
+// Meta is read before the files are mapped: the writer puts the bytes
+// in the log and links segments before writing the items naming them.
+RetCode EngineRace::refresh() {
+	std::vector<Item> fresh;
+	std::ifstream meta_in(meta_path, std::ios::binary);
+	if (meta_in.is_open()) {
+		meta_in.seekg(0, meta_in.end);
+		fresh.resize(meta_in.tellg() / sizeof(Item));
+		meta_in.seekg(0, meta_in.beg);
+		meta_in.read((char*)fresh.data(), fresh.size() * sizeof(Item));
+		fresh.resize(meta_in.gcount() / sizeof(Item));
+	}
+
+	for (size_t f = 0; f < logs.size(); ++f) {
+		LogFile& l(logs[f]);
+		if (l.fd == -1) {
+			l.fd = open(data_paths[f].c_str(), O_RDONLY);
+		}
+		struct stat st;
+		if (l.fd == -1 || fstat(l.fd, &st) != 0 || (size_t)st.st_size <= l.fsz) {
+			continue;
+		}
+		// Mapped twice as far as needed, so the file mostly grows into
+		// the mapping. One outgrown stays until the instance closes, as
+		// a read may be in it; they add up to less than the last one.
+		if ((size_t)st.st_size > l.msz) {
+			size_t msz(std::max<size_t>(st.st_size, l.msz * 2));
+			char* p((char*)mmap(0, msz, PROT_READ, MAP_SHARED, l.fd, 0));
+			if (p == MAP_FAILED) {
+				return kIOError;
+			}
+			if (l.p_disk) {
+				old_maps.push_back(std::make_pair(l.p_disk, l.msz));
+			}
+			l.p_disk = p;
+			l.msz = msz;
+		}
+		l.fsz = st.st_size;
+	}
+	for (size_t k = segs.size() + 1; k <= max_segments; ++k) {
+		Segment s;
+		if (access(segPath(k).c_str(), F_OK) != 0 || mapSegment(segPath(k), &s) != kSucc) {
+			break;
+		}
+		segs.push_back(s);
+	}
+
+	// An item the writer is rewriting may be torn; it is skipped, or
+	// ends the new keys, until the next refresh
+	std::lock_guard<ProfiledMutex> lck(journal_mtx);
+	size_t known(versions.size());
+	for (size_t i = 0; i < fresh.size(); ++i) {
+		const Item& item(fresh[i]);
+		if (!mapped(item)) {
+			if (i < known) {
+				continue;
+			}
+			break;
+		}
+		if (i < known) {
+			Item old(versions.latest(i));
+			if (memcmp(&old, &item, sizeof(Item)) != 0) {
+				versions.set(i, item, 0, false, inlineValue(item));
+			}
+			continue;
+		}
+		if (item.szKey > 8) {
+			lookup_long.insert(getMemory(item.p), item.szKey, i);
+		} else {
+			lookup_short[hashPolar(getMemory(item.p), item.szKey)] = i;
+		}
+		versions.push(item, 0, inlineValue(item));
+		unordered.push_back(i);
+	}
+	return kSucc;
+}
+
+// Whether the bytes of item lie in what is mapped
+bool EngineRace::mapped(const Item& item) {
+	size_t end(item.szKey + (size_t)item.szVal);
+	if (item.p >> seg_shift) {
+		size_t k(item.p >> seg_shift);
+		return k <= segs.size() && (item.p & ((1ul << seg_shift) - 1)) + end <= segs[k - 1].size;
+	}
+	size_t blk(item.p / chunk_size), off(item.p % chunk_size);
+	if (off + end > chunk_size) {
+		return false;
+	}
+	return blk / logs.size() * chunk_size + off + end <= logs[blk % logs.size()].fsz;
+}
+
+// Chunks of a NUMA instance are mapped on their own, so their pages can
+// be placed on its node
+char* EngineRace::allocChunk() {
+	if (numa_node < 0) {
+		return new char[chunk_size];
+	}
+	void* p(mmap(0, chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (p == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+	Numa::bindMemory(p, chunk_size, numa_node);
+	return (char*)p;
+}
+
+void EngineRace::freeChunk(char* p) {
+	if (numa_node < 0) {
+		delete [] p;
+	} else {
+		munmap(p, chunk_size);
+	}
+}
+
 size_t EngineRace::recycleMemory() {
 	size_t n = p_synced;
 	std::vector<std::pair<clock_t, size_t> > clks;
@@ -302,7 +1174,7 @@ size_t EngineRace::recycleMemory() {
 			size_t j = clks[i].second;
 			datablks[j].op->lock();
 			if (datablks[j].usecnt == 0) {
-				delete [] datablks[j].pmem;
+				freeChunk(datablks[j].pmem);
 				datablks[j].pmem = 0;
 				++recycled;
 			}
@@ -314,6 +1186,7 @@ size_t EngineRace::recycleMemory() {
 }
 
 void EngineRace::daemon() {
+	Numa::pinThread(numa_node);
 	size_t interval(1 << 3);
 	size_t mem_recycled(0);
 	while (alive) {
@@ -336,6 +1209,7 @@ void EngineRace::daemon() {
 }
 
 void EngineRace::recycle() {
+	Numa::pinThread(numa_node);
 	size_t mem_recycled(0);
     while (alive) {
 		mem_recycled = recycleMemory();
@@ -343,34 +1217,42 @@ void EngineRace::recycle() {
     }
 }
 
-void EngineRace::monitor() {
-    size_t last_ops(0);
-    size_t last_loads(0);
-    while (alive) {
-        size_t activeblk(0);
-        for (auto& i : datablks) {
-            if (i.pmem) {
-                ++activeblk;
-                // fprintf(stderr, "%3d", i.usecnt);
-            } else {
-                //fprintf(stderr, "---");
-            }
-        }
-        n_ops += n_journal;
-        fprintf(stderr, "SS %lu SL %lu ", lookup_short.size(), lookup_long.size());
-        fprintf(stderr, " %lu / %lu blks %lu lps %lu datas %lu wps\n", 
-                activeblk, datablks.size(),
-                n_load - last_loads,
-                n_ops,
-                n_ops - last_ops);
-        last_ops = n_ops;
-        last_loads = n_load;
-        sleep(1);
-    }
+// Sizes of the lookup_short nodes follow the libstdc++ layout: a next
+// pointer and the stored pair.
+void EngineRace::memoryUsage(Stats* st) {
+	std::shared_ptr<const Ordered> o;
+	{
+		std::lock_guard<std::mutex> lck(ordered_mtx);
+		o = ordered;
+	}
+	std::lock_guard<ProfiledMutex> lck(journal_mtx);
+	size_t active(0);
+	for (auto& i : datablks) {
+		if (i.pmem) {
+			++active;
+		}
+	}
+	st->keys += lookup_short.size() + lookup_long.size();
+	st->index_bytes += lookup_short.bucket_count() * sizeof(void*) +
+		lookup_short.size() * (sizeof(void*) + sizeof(std::pair<unsigned long long, size_t>)) +
+		lookup_long.bytes() + o->keys.capacity() * sizeof(OrderedKey) +
+		o->bytes.capacity() * sizeof(uint64_t) + ordered_key_bytes.load() +
+		unordered.capacity() * sizeof(size_t);
+	st->meta_bytes += versions.bytes() +
+		datablks.capacity() * sizeof(DataBlk) + datablks.size() * sizeof(ProfiledMutex);
+	st->versions += versions.versions();
+	st->chunk_cache_bytes += active * chunk_size;
+	st->hot_cache_bytes += hot ? hot->bytes() : 0;
+	st->journal_bytes += max_journal * (sizeof(Item) + sizeof(size_t) + sizeof(std::mutex));
 }
 
 char* EngineRace::getPtrSafe(size_t blk, bool safe) {
+    if (read_only) {
+        return getDiskPtr(blk);
+    }
     if (safe) {
+        chunk_loaded = false;
+        disk_wait_ns = 0;
         char* ptr;
         datablks[blk].op->lock();
         ++datablks[blk].usecnt;
@@ -379,16 +1261,22 @@ char* EngineRace::getPtrSafe(size_t blk, bool safe) {
         if (ptr == 0) {
             datablks[blk].op->lock();
             if (datablks[blk].pmem == 0) {
-                datablks[blk].pmem = new char[chunk_size];
+                ScopedLatency lat(stats, StatsRecorder::kChunkLoad);
+                TraceScope t(tracer, kTraceChunkLoad);
+                datablks[blk].pmem = allocChunk();
+                uint64_t wait_start(stalls ? nowNs() : 0);
                 p_disk_mtx.lock();
-                ++n_load;
+                if (stalls) {
+                    disk_wait_ns = nowNs() - wait_start;
+                }
+                chunk_loaded = true;
                 memcpy(datablks[blk].pmem, getDiskPtr(blk), chunk_size);
                 p_disk_mtx.unlock();
             }
             datablks[blk].op->unlock();
         }
     } else if (datablks[blk].pmem == 0) {
-        datablks[blk].pmem = new char[chunk_size];
+        datablks[blk].pmem = allocChunk();
         memcpy(datablks[blk].pmem, getDiskPtr(blk), chunk_size);
     }
     datablks[blk].ts = clock();
@@ -9,12 +9,14 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 
 #include <iostream>
 #include <fstream>
 
 #include <algorithm>
 #include <string>
+#include <map>
 #include <set>
 #include <queue>
 #include <ctime>
@@ -26,76 +28,216 @@
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
+#include <memory>
+#include <new>
 
 #include "include/engine.h"
+#include "include/segment.h"
+#include "stats.h"
+#include "trace.h"
+#include "lock_profile.h"
+#include "stall_log.h"
+#include "snapshot_list.h"
+#include "change_log.h"
+#include "hot_cache.h"
+#include "long_key_index.h"
+#include "numa.h"
+#include "file_copy.h"
+#include "version_table.h"
 
 namespace polar_race {
 
-struct Item {
-	size_t p;
-	unsigned szKey, szVal;
-};
-
 unsigned long long hashPolar(const char* s, int n);
 
 class EngineRace : public Engine  {
+	// bench/micro_bench.cc times the private steps one at a time
+	friend class EngineRaceProbe;
+
 public:
+	struct Config {
+		size_t max_chunks;	// chunks this instance may keep in memory
+		StatsRecorder* stats;	// shared with the owner, may be null
+		Tracer* tracer;		// likewise
+		StallLog* stalls;	// likewise
+		SnapshotList* snapshots;	// likewise; null keeps no old versions
+		ChangeLog* changes;	// likewise; null streams no changes
+		unsigned shard;		// this instance's number in changes
+		size_t hot_cache_bytes;	// for a HotCache of read values, 0 for none
+		std::vector<std::string> data_paths;	// log files to stripe over
+		std::string meta_path;
+		// NUMA node for the chunks, index and threads of this instance;
+		// -1 leaves placement to the kernel
+		int numa_node;
+		// Map the files read-only and serve reads straight from the
+		// mappings, with no journal or background threads; see refresh()
+		bool read_only;
+		// Segments ingests committed; later ones are removed on opening.
+		// -1u maps every one there is.
+		size_t segments;
+		// Where the log ended when the last of them was committed, if it
+		// may not have been applied in full, else -1u; see redoSegment()
+		size_t redo_from;
+
+		Config() : max_chunks(max_cache / chunk_size), stats(0), tracer(0),
+			stalls(0), snapshots(0), changes(0), shard(0), hot_cache_bytes(0),
+			numa_node(-1), read_only(false), segments(-1u), redo_from(-1u) {}
+	};
+
+	struct LogFile {
+		int fd;
+		char* p_disk;
+		size_t fsz;
+		size_t msz;	// bytes mapped by a read-only instance, fsz on
+	};
+
 	struct DataBlk {
 		char *pmem, *pdisk;
-		std::mutex* op;
+		ProfiledMutex* op;
 		int usecnt;
 		clock_t ts;
 
 		DataBlk(char* _pmem=0, char* _pdisk=0) : pmem(_pmem), pdisk(_pdisk), usecnt(0), ts(0) {
-			op = new std::mutex();
+			op = new ProfiledMutex(kLockChunk);
 		}
 		~DataBlk() {
 			// delete op;
 		}
 	};
-private:
 	static const size_t max_journal = 32;
 	static const size_t chunk_size = 4 << 20; 
-	static const size_t max_chunks = (8ul << 30) / chunk_size;
+	static const size_t max_cache = 8ul << 30;
+	// Sequence of the newest version, for resolve and readAt
+	static const uint64_t latest = ~0ull;
+	// Item::p of a record in ingested segment k (from 1) is k << seg_shift
+	// plus its offset in the segment file
+	static const int seg_shift = 48;
+	static const size_t max_segments = 1024;
+	// Longest value versions keeps inline
+	static const size_t max_inline = VersionTable::max_inline;
+
+private:
+	size_t max_chunks;
+	StatsRecorder* stats;
+	Tracer* tracer;
+	StallLog* stalls;
+	SnapshotList* snapshots;
+	ChangeLog* changes;
+	unsigned shard;
+	HotCache* hot;
+	int numa_node;
+	bool read_only;
+	size_t committed, redo_from;
+
+	// What the last flush did, to blame the waits it caused on. Written
+	// by flush() holding both journal_mtx and ret_mtx.
+	struct FlushInfo {
+		size_t batch;
+		bool grew;
+		const char* phase;	// the longest one
+	};
+	FlushInfo last_flush;
+	std::atomic<size_t> n_flushes;
+	std::atomic<size_t> n_grows;
 
 	size_t n_items, n_journal, p_synced, p_current, sz_current, sz_synced;
-    size_t n_ops, n_load;
-	size_t fsz;
 	size_t loaded_size, last_chunk_sz;
 	size_t* idxs;
 
 	Item* journal;
 	std::mutex* ready;
-	std::vector<Item> meta; 
+	// Every key's Item with the flush sequence it was born at, 0 for what
+	// was on disk, and the replaced Items snapshots still read. The bytes
+	// stay in the log, so only the Item is kept. Resolved without a lock.
+	VersionTable versions;
+	static const size_t blk_upd_chk = 5;	// meta is rewritten 32 Items at a time
 	std::vector<DataBlk> datablks; 
 
-	std::unordered_map<std::string, size_t> lookup_long;
-	std::unordered_map<unsigned long long, size_t> lookup_short;
+	// Ingested segments, mapped read-only. Room for max_segments is
+	// reserved up front so readers never see the vector move.
+	struct Segment {
+		char* p;
+		size_t size;
+	};
+	std::vector<Segment> segs;
+	// Records of the last segment an applySegment indexed, for
+	// settleSegment
+	std::vector<size_t> ingested;
+	static const size_t ingest_batch = 4096;	// records indexed per journal_mtx hold
 
-	std::mutex journal_mtx;
+	LongKeyIndex lookup_long;	// keys over 8 bytes
+	std::unordered_map<unsigned long long, size_t> lookup_short;
 
-	std::mutex ret_mtx;
+	// A key of ordered, its bytes kept in key_blocks
+	struct OrderedKey {
+		const char* key;
+		size_t szKey;
+		size_t idx;
+	};
+	// Every key in order, for scans, and bytes[i] the key and value bytes
+	// of keys[0, i) as of their merge; later overwrites with another value
+	// size are not reflected. Never changed once published.
+	struct Ordered {
+		Ordered() : bytes(1, 0) {}
+
+		std::vector<OrderedKey> keys;
+		std::vector<uint64_t> bytes;
+	};
+	// Keys inserted since the last scan wait in unordered, under
+	// journal_mtx, and are sorted and merged in by the next one into a
+	// copy of ordered that replaces it. Readers hold on to the one they
+	// took, so ordered_mtx only covers taking and replacing it.
+	std::shared_ptr<const Ordered> ordered;
+	std::vector<size_t> unordered;
+	std::mutex ordered_mtx;
+	std::mutex merge_mtx;	// one merge at a time, over key_blocks too
+	// Keys of ordered, appended to and never moved
+	std::vector<char*> key_blocks;
+	size_t key_block_used;
+	static const size_t key_block_size = 1 << 20;
+	std::atomic<size_t> ordered_key_bytes;
+
+	ProfiledMutex journal_mtx;
+
+	ProfiledMutex ret_mtx;
 	std::condition_variable ret_cv;
+	size_t flush_gen;
 
 	std::ofstream ou_meta;
 
-	int fd;
-	char* p_disk;
-    std::mutex p_disk_mtx;
+	std::vector<std::string> data_paths;
+	std::string meta_path;
+	std::vector<LogFile> logs;
+	// Log mappings refresh replaced, which readers may still be in
+	std::vector<std::pair<char*, size_t> > old_maps;
+    ProfiledMutex p_disk_mtx;
 	
 	bool alive;
 	bool flushing;
 	std::thread* p_daemon;
 	std::thread* p_recyc;
-	std::thread* p_monitor;
 
 public:
 	static RetCode Open(const std::string& name, Engine** eptr);
 
-	explicit EngineRace(const std::string& dir) : n_journal(0), n_ops(0), n_load(0) {
+	explicit EngineRace(const std::string& dir, const Config& conf = Config())
+		: max_chunks(conf.max_chunks), stats(conf.stats), tracer(conf.tracer),
+		stalls(conf.stalls), snapshots(conf.snapshots), changes(conf.changes),
+		shard(conf.shard),
+		hot(conf.hot_cache_bytes ? new HotCache(conf.hot_cache_bytes) : 0),
+		numa_node(conf.numa_node),
+		read_only(conf.read_only), committed(conf.segments), redo_from(conf.redo_from),
+		n_flushes(0), n_grows(0), n_journal(0),
+		ordered(new Ordered), key_block_used(0),
+		ordered_key_bytes(0), journal_mtx(kLockJournal),
+		ret_mtx(kLockRet), flush_gen(0), data_paths(conf.data_paths),
+		meta_path(conf.meta_path), p_disk_mtx(kLockDisk) {
+		p_daemon = p_recyc = 0;
 		journal = new Item[max_journal];
 		idxs = new size_t[max_journal];
 		ready = new std::mutex[max_journal];
+		last_flush.batch = 0;
+		last_flush.grew = false;
+		last_flush.phase = "";
 	}
 
 	~EngineRace();
@@ -114,35 +256,185 @@ public:
 			const PolarString& upper,
 			Visitor &visitor) override;
 
-	void init(const std::string&);
+	RetCode init(const std::string&);
+
+	// Sorts the keys inserted so far in with the ordered ones, for
+	// orderedKeys
+	void sortKeys();
+
+	// Copies up to max of the ordered keys of [lower, upper) with their
+	// index slots, going up from from, or down with !forward; from itself
+	// only when inclusive, and null starts at the bound. Keys inserted
+	// since the last sortKeys are left out. Takes no lock but to pick up
+	// the ordered keys. Returns whether the bounds hold keys past those.
+	bool orderedKeys(const std::string* from, bool inclusive, bool forward,
+			const PolarString& lower, const PolarString& upper, size_t max,
+			std::vector<std::pair<std::string, size_t> >* keys);
+
+	// The version of slot idx newest as of sequence seq, if the key
+	// existed then, with its value in inlined if short enough. Takes no
+	// lock.
+	inline bool resolve(size_t idx, uint64_t seq, Item* item, uint64_t* inlined) {
+		return versions.resolve(idx, seq, item, inlined);
+	}
+
+	// The newest version of slot idx, if one is revealed
+	bool readItem(size_t idx, std::string* value);
+	void readItem(const Item& item, std::string* value);
+	// Takes the value from inlined, as resolve gave it, if it is there
+	void readItem(const Item& item, uint64_t inlined, std::string* value);
+
+	// Hands the key and value of item, a record of changes, to visitor
+	// in place, with its chunk pinned
+	void visitChange(uint64_t sequence, const Item& item, ChangeVisitor& visitor);
+
+	// Read as of sequence seq
+	RetCode readAt(const PolarString& key, uint64_t seq, std::string* value);
+
+	// Drops the old versions no live snapshot can see any more
+	void pruneVersions();
+
+	// What a checkpoint copies, taken by checkpointState under
+	// journal_mtx so the states of all shards are of one moment. The log
+	// is only appended to, so the bytes meta names stay as they are.
+	struct CheckpointState {
+		std::vector<Item> meta;
+		std::vector<size_t> log_ends;	// of each log file
+		size_t segments;
+	};
+
+	// Needs journal_mtx
+	void checkpointState(CheckpointState* st);
+
+	// Writes st as the files of a store opened with name and conf.
+	// copied holds the bytes of each file a previous checkpoint into the
+	// same place copied; all but the last chunk of them are kept rather
+	// than copied again. The bytes of this one are added to lens.
+	RetCode writeCheckpoint(const CheckpointState& st, const std::string& name,
+			const Config& conf, const std::map<std::string, uint64_t>& copied,
+			std::map<std::string, uint64_t>* lens);
+
+	// Catches a read-only instance up with what the writer has made
+	// durable: keys and versions meta now records, log files that grew
+	// and new segments. Reads may run alongside; one refresh at a time.
+	RetCode refresh();
+
+	// Links the segment at path, which must be of this shard, into the
+	// store next to the log and maps it, for applySegment
+	RetCode openSegment(const std::string& path, uint32_t shard, uint32_t shards);
+
+	// Undoes the last openSegment that was not applied
+	void dropSegment();
+
+	inline size_t segments() const {
+		return segs.size();
+	}
+
+	// Where the next record goes in the log: records with a lower Item::p
+	// were flushed by now. Needs journal_mtx.
+	inline size_t logEnd() const {
+		return n_journal ? journal[0].p : p_current * chunk_size + sz_current;
+	}
+
+	// Indexes the records of the segment opened last as pending versions,
+	// and writes meta, ingest_batch records at a time under journal_mtx.
+	// Their slots are looked up beforehand without it. A key a flush
+	// after sequence after wrote keeps that version.
+	void applySegment(uint64_t after);
+
+	// Makes what applySegment indexed born at seq. Needs journal_mtx.
+	inline void revealSegment(uint64_t seq) {
+		versions.reveal(seq);
+	}
+
+	// Settles the slots applySegment set, a batch at a time
+	void settleSegment();
+
+	// Keeps flush() out, for taking a snapshot across shards
+	inline void lockJournal() {
+		journal_mtx.lock();
+	}
+
+	inline void unlockJournal() {
+		journal_mtx.unlock();
+	}
+
+	// Key and value bytes of [lower, upper)
+	uint64_t approximateSize(const PolarString& lower, const PolarString& upper);
+
+	// Up to m keys of [lower, upper) at evenly spaced byte offsets, each
+	// with the bytes from it to the next one (or upper)
+	void sampleKeys(const PolarString& lower, const PolarString& upper,
+			size_t m, std::vector<std::pair<std::string, uint64_t> >* samples);
+
+	// Asks the kernel to read ahead the chunk holding the value of item,
+	// unless it is cached or is *last, the chunk prefetched before
+	void prefetch(const Item& item, size_t* last);
+
+	// Adds the key count and memory held by this instance to stats
+	void memoryUsage(Stats* stats);
 
 private: 
 	size_t allocMemory(size_t);
+	char* allocChunk();
+	void freeChunk(char* p);
+	bool mapped(const Item& item);
 
 	inline char* getDiskPtr(size_t blk) {
-		return p_disk + blk * chunk_size;
+		return logs[blk % logs.size()].p_disk + blk / logs.size() * chunk_size;
 	}
 
     char* getPtrSafe(size_t blk, bool safe);
 
     inline char* getMemory(size_t ptr, bool safe=false) {
+		if (ptr >> seg_shift) {
+			return segs[(ptr >> seg_shift) - 1].p + (ptr & ((1ul << seg_shift) - 1));
+		}
 		size_t blk(ptr / chunk_size), p(ptr % chunk_size);
         return getPtrSafe(blk, safe) + p;
     }
 
 	inline void relieveMemory(size_t ptr) {
+		if ((ptr >> seg_shift) || read_only) {
+			return;
+		}
 		size_t blk(ptr / chunk_size);
         datablks[blk].op->lock();
         --datablks[blk].usecnt;
         datablks[blk].op->unlock();
 	}
 
+	// The value bytes of item, for versions to keep if they are few
+	inline const char* inlineValue(const Item& item) {
+		return item.szVal <= max_inline ? getMemory(item.p) + item.szKey : NULL;
+	}
+
+	void reportStall(const char* op, uint64_t ns, const char* cause,
+			size_t batch, bool grew);
+	void reportStall(const char* op, uint64_t ns, const FlushInfo& f) {
+		reportStall(op, ns, f.phase, f.batch, f.grew);
+	}
+
 	void copyToMemory(size_t, size_t, const PolarString&, const PolarString&);
 	void flush();
+	void mergeOrdered();
+	size_t putItem(const Item& item, size_t idx, uint64_t seq, bool keep,
+			std::unordered_set<size_t>* blk_to_upd);
+	void writeMeta(const std::unordered_set<size_t>& blk_to_upd);
+	// Indexes the records of the last segment again, after an ingest that
+	// was committed but may have stopped partway. A key keeps a version
+	// already from it, or written to the log from, by Item::p, log_end on.
+	void redoSegment(size_t log_end);
+	std::string segPath(size_t k);
+	RetCode mapSegment(const std::string& path, Segment* s);
+	std::shared_ptr<const Ordered> orderedRange(const PolarString& lower,
+			const PolarString& upper, size_t* b, size_t* e);
+	std::shared_ptr<const Ordered> boundedRange(const PolarString& lower,
+			const PolarString& upper, size_t* b, size_t* e);
+	const char* internKey(const char* key, size_t sz);
 	size_t find(const PolarString& key);
 	void daemon();
 	void recycle();
-    void monitor();
 	size_t recycleMemory();
 };
 
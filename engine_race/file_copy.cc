@@ -0,0 +1,93 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "file_copy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace polar_race {
+
+RetCode copyRange(int in, int out, off_t off, size_t len) {
+	if (len == 0) {
+		return kSucc;
+	}
+	file_clone_range r;
+	r.src_fd = in;
+	r.src_offset = off;
+	r.src_length = len;
+	r.dest_offset = off;
+	if (ioctl(out, FICLONERANGE, &r) == 0) {
+		return kSucc;
+	}
+
+	off_t in_off(off), out_off(off);
+	size_t left(len);
+	while (left) {
+		ssize_t n(copy_file_range(in, &in_off, out, &out_off, left, 0));
+		if (n <= 0) {
+			break;
+		}
+		left -= n;
+	}
+
+	std::vector<char> buf(left ? 1 << 20 : 0);
+	while (left) {
+		ssize_t n(pread(in, buf.data(), std::min(left, buf.size()), in_off));
+		if (n <= 0 || pwrite(out, buf.data(), n, out_off) != n) {
+			return kIOError;
+		}
+		in_off += n;
+		out_off += n;
+		left -= n;
+	}
+	return kSucc;
+}
+
+RetCode linkOrCopy(const std::string& src, const std::string& dst) {
+	unlink(dst.c_str());
+	if (link(src.c_str(), dst.c_str()) == 0) {
+		return kSucc;
+	}
+	if (errno != EXDEV) {
+		return kIOError;
+	}
+	int in(open(src.c_str(), O_RDONLY));
+	int out(open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+	struct stat st;
+	RetCode ret(in == -1 || out == -1 || fstat(in, &st) != 0 ? kIOError :
+			copyRange(in, out, 0, st.st_size));
+	if (in != -1) {
+		close(in);
+	}
+	if (out != -1) {
+		close(out);
+	}
+	if (ret != kSucc) {
+		unlink(dst.c_str());
+	}
+	return ret;
+}
+
+RetCode syncFile(const std::string& path) {
+	int fd(open(path.c_str(), O_RDONLY));
+	if (fd == -1) {
+		return kIOError;
+	}
+	RetCode ret(fsync(fd) == 0 ? kSucc : kIOError);
+	close(fd);
+	return ret;
+}
+
+RetCode syncDir(const std::string& path) {
+	size_t slash(path.rfind('/'));
+	return syncFile(slash == std::string::npos ? "." :
+			slash == 0 ? "/" : path.substr(0, slash));
+}
+
+}  // namespace polar_race
@@ -0,0 +1,30 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_FILE_COPY_H_
+#define ENGINE_RACE_FILE_COPY_H_
+
+#include <sys/types.h>
+
+#include <string>
+
+#include "include/engine.h"
+
+namespace polar_race {
+
+// Copies [off, off + len) of in to the same offsets of out, sharing the
+// extents where the file system can reflink them, else copying in the
+// kernel, else through a buffer
+RetCode copyRange(int in, int out, off_t off, size_t len);
+
+// Hard-links src to dst, replacing dst, or copies it where they are on
+// different file systems. For files that are never modified.
+RetCode linkOrCopy(const std::string& src, const std::string& dst);
+
+// Flushes the file at path to the disk
+RetCode syncFile(const std::string& path);
+
+// Flushes the directory holding path, so entries made in it stick
+RetCode syncDir(const std::string& path);
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_FILE_COPY_H_
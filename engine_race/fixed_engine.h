@@ -0,0 +1,400 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_FIXED_ENGINE_H_
+#define ENGINE_RACE_FIXED_ENGINE_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "include/engine.h"
+#include "slot_index.h"
+#include "stats.h"
+
+namespace polar_race {
+
+// An engine for stores whose keys are all KeyBytes and values all
+// ValueBytes long, registered as "fixed" for 8-byte keys and 4 KB
+// values. Keys are packed big-endian into a uint64_t, so integer order
+// is key order, and a SlotIndex maps each to a 32-bit slot. The value of
+// slot s lives at s * ValueBytes of <name>.fixed.data and is overwritten
+// in place; <name>.fixed.keys records the key of every slot, 16 bytes
+// each, and is all that reopening reads. Keys or values of any other
+// length are rejected with kInvalidArgument.
+//
+// A stripe of the index is locked only to find a key's slot or assign a
+// new one; values are read and written outside it. Each slot has a
+// sequence word, odd while a writer is in its value, so writers of one
+// slot go one at a time and a read that overlapped a write retries.
+//
+// With Options::direct_io and page-sized values the data file is opened
+// O_DIRECT, falling back to the page cache where the file system has no
+// direct I/O.
+template <size_t KeyBytes, size_t ValueBytes>
+class FixedEngine : public Engine {
+	static_assert(KeyBytes >= 1 && KeyBytes <= 8, "keys are packed into 64 bits");
+	static_assert(ValueBytes > 0, "values can not be empty");
+
+public:
+	static RetCode Open(const std::string& name, const Options& options,
+			Engine** eptr) {
+		*eptr = NULL;
+		if (options.read_only) {
+			return kNotSupported;
+		}
+		FixedEngine* e(new FixedEngine());
+		RetCode ret(e->open(name, options));
+		if (ret != kSucc) {
+			delete e;
+			return ret;
+		}
+		*eptr = e;
+		return kSucc;
+	}
+
+	~FixedEngine() {
+		if (data_fd != -1) {
+			close(data_fd);
+		}
+		if (keys_fd != -1) {
+			close(keys_fd);
+		}
+		for (size_t i = 0; i < n_pages; ++i) {
+			delete [] seq_pages[i].load(std::memory_order_relaxed);
+		}
+		delete [] seq_pages;
+	}
+
+	RetCode Write(const PolarString& key,
+			const PolarString& value) override {
+		if (key.size() != KeyBytes || value.size() != ValueBytes) {
+			return kInvalidArgument;
+		}
+		ScopedLatency lat(&stats, StatsRecorder::kWrite);
+		uint64_t k(pack(key.data()));
+		SlotIndex::Stripe& s(index.stripeOf(k));
+		uint32_t slot;
+		bool fresh(false);
+		{
+			std::lock_guard<std::mutex> lck(s.mtx);
+			if (!s.find(k, &slot)) {
+				slot = next_slot.fetch_add(1);
+				if (slot >= max_slots) {
+					return kFull;
+				}
+				// Held by this writer from the start, so a read finding
+				// the key waits for its value
+				seqOf(slot).store(1, std::memory_order_relaxed);
+				s.insert(k, slot);
+				fresh = true;
+			}
+		}
+		std::atomic<uint32_t>& seq(seqOf(slot));
+		if (fresh) {
+			// The value goes down before the record naming it, so a
+			// record found on reopen always has its value
+			Record r = { k, slot, slot ^ record_check };
+			bool ok(writeValue(slot, value.data()) &&
+					pwrite(keys_fd, &r, sizeof(r), recordOffset(slot)) == sizeof(r));
+			seq.store(ok ? 2 : 0, std::memory_order_release);
+			if (!ok) {
+				return kIOError;
+			}
+		} else {
+			uint32_t v(seq.load(std::memory_order_relaxed));
+			while ((v & 1) || !seq.compare_exchange_weak(v, v + 1, std::memory_order_acquire)) {
+				sched_yield();
+				v = seq.load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_release);
+			Record r = { k, slot, slot ^ record_check };
+			// A slot without a value may lack its record too
+			bool ok(writeValue(slot, value.data()) && (v ||
+						pwrite(keys_fd, &r, sizeof(r), recordOffset(slot)) == sizeof(r)));
+			seq.store(ok || v ? v + 2 : 0, std::memory_order_release);
+			if (!ok) {
+				return kIOError;
+			}
+		}
+		stats.add(StatsRecorder::kBytesWritten, KeyBytes + ValueBytes);
+		return kSucc;
+	}
+
+	RetCode Read(const PolarString& key,
+			std::string* value) override {
+		if (key.size() != KeyBytes) {
+			return kInvalidArgument;
+		}
+		ScopedLatency lat(&stats, StatsRecorder::kRead);
+		uint64_t k(pack(key.data()));
+		SlotIndex::Stripe& s(index.stripeOf(k));
+		uint32_t slot;
+		bool found;
+		{
+			std::lock_guard<std::mutex> lck(s.mtx);
+			found = s.find(k, &slot);
+		}
+		RetCode ret(found ? readSlot(slot, value) : kNotFound);
+		if (ret == kNotFound) {
+			stats.add(StatsRecorder::kReadMisses, 1);
+		} else if (ret == kSucc) {
+			stats.add(StatsRecorder::kBytesRead, ValueBytes);
+		}
+		return ret;
+	}
+
+	RetCode Range(const PolarString& lower,
+			const PolarString& upper,
+			Visitor &visitor) override {
+		ScopedLatency lat(&stats, StatsRecorder::kRange);
+		std::vector<uint64_t> keys;
+		index.keys(&keys);
+		std::sort(keys.begin(), keys.end());
+		char kbuf[KeyBytes];
+		std::string value;
+		for (uint64_t k : keys) {
+			unpack(k, kbuf);
+			PolarString key(kbuf, KeyBytes);
+			if (lower.size() && key.compare(lower) < 0) {
+				continue;
+			}
+			if (upper.size() && key.compare(upper) >= 0) {
+				break;
+			}
+			SlotIndex::Stripe& s(index.stripeOf(k));
+			uint32_t slot;
+			{
+				std::lock_guard<std::mutex> lck(s.mtx);
+				if (!s.find(k, &slot)) {
+					return kIOError;
+				}
+			}
+			RetCode ret(readSlot(slot, &value));
+			if (ret == kNotFound) {
+				continue;
+			}
+			if (ret != kSucc) {
+				return ret;
+			}
+			visitor.Visit(key, value);
+		}
+		return kSucc;
+	}
+
+	RetCode GetStats(Stats* st) override {
+		stats.snapshot(st);
+		st->keys = index.size();
+		st->index_bytes = index.bytes() +
+			pages_used.load(std::memory_order_relaxed) * seq_page * sizeof(uint32_t);
+		return kSucc;
+	}
+
+private:
+	// Leads <name>.fixed.keys; a store is only reopened with the widths
+	// it was made with
+	struct Header {
+		char magic[8];
+		uint32_t key_bytes;
+		uint32_t value_bytes;
+	};
+
+	// check is slot ^ record_check, so a record never written reads as
+	// invalid
+	struct Record {
+		uint64_t key;
+		uint32_t slot;
+		uint32_t check;
+	};
+
+	static const uint32_t record_check = 0x5a17c0deu;
+	static const uint32_t max_slots = 0xfffffff0u;
+	static const size_t page = 4096;
+	// Sequence words are allocated this many slots at a time
+	static const int seq_shift = 16;
+	static const size_t seq_page = 1 << seq_shift;
+	static const size_t n_pages = ((size_t)max_slots >> seq_shift) + 1;
+
+	FixedEngine() : data_fd(-1), keys_fd(-1), direct(false), next_slot(0),
+		seq_pages(new std::atomic<std::atomic<uint32_t>*>[n_pages]()), pages_used(0) {}
+
+	static inline uint64_t pack(const char* p) {
+		uint64_t k(0);
+		for (size_t i = 0; i < KeyBytes; ++i) {
+			k = k << 8 | (unsigned char)p[i];
+		}
+		return k;
+	}
+
+	static inline void unpack(uint64_t k, char* p) {
+		for (size_t i = KeyBytes; i > 0; --i, k >>= 8) {
+			p[i - 1] = (char)(k & 0xff);
+		}
+	}
+
+	static inline off_t valueOffset(uint32_t slot) {
+		return (off_t)slot * ValueBytes;
+	}
+
+	static inline off_t recordOffset(uint32_t slot) {
+		return sizeof(Header) + (off_t)slot * sizeof(Record);
+	}
+
+	// The sequence word of slot: odd while a writer is in the value, 0
+	// while it has none because the write adding it failed. Slots of a
+	// page are taken in order, so whoever takes one first adds the page.
+	std::atomic<uint32_t>& seqOf(uint32_t slot) {
+		std::atomic<std::atomic<uint32_t>*>& p(seq_pages[slot >> seq_shift]);
+		std::atomic<uint32_t>* words(p.load(std::memory_order_acquire));
+		if (words == NULL) {
+			std::atomic<uint32_t>* fresh(new std::atomic<uint32_t>[seq_page]());
+			if (p.compare_exchange_strong(words, fresh, std::memory_order_acq_rel)) {
+				words = fresh;
+				++pages_used;
+			} else {
+				delete [] fresh;
+			}
+		}
+		return words[slot & (seq_page - 1)];
+	}
+
+	// Retries a read a write overlapped, waiting out one in progress
+	RetCode readSlot(uint32_t slot, std::string* value) {
+		std::atomic<uint32_t>& seq(seqOf(slot));
+		for (;;) {
+			uint32_t v(seq.load(std::memory_order_acquire));
+			if (v == 0) {
+				return kNotFound;
+			}
+			if (v & 1) {
+				sched_yield();
+				continue;
+			}
+			if (!readValue(slot, value)) {
+				return kIOError;
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (seq.load(std::memory_order_relaxed) == v) {
+				return kSucc;
+			}
+		}
+	}
+
+	// A page-aligned buffer of one value per thread, for O_DIRECT
+	static char* alignedBuffer() {
+		struct Buffer {
+			char* p;
+			Buffer() : p(NULL) {
+				if (posix_memalign((void**)&p, page, ValueBytes)) {
+					p = NULL;
+				}
+			}
+			~Buffer() { free(p); }
+		};
+		static thread_local Buffer buf;
+		return buf.p;
+	}
+
+	bool writeValue(uint32_t slot, const char* value) {
+		if (direct) {
+			char* buf(alignedBuffer());
+			if (buf == NULL) {
+				return false;
+			}
+			memcpy(buf, value, ValueBytes);
+			value = buf;
+		}
+		return pwrite(data_fd, value, ValueBytes, valueOffset(slot)) == (ssize_t)ValueBytes;
+	}
+
+	bool readValue(uint32_t slot, std::string* value) {
+		value->resize(ValueBytes);
+		if (!direct) {
+			return pread(data_fd, &(*value)[0], ValueBytes, valueOffset(slot)) == (ssize_t)ValueBytes;
+		}
+		char* buf(alignedBuffer());
+		if (buf == NULL ||
+				pread(data_fd, buf, ValueBytes, valueOffset(slot)) != (ssize_t)ValueBytes) {
+			return false;
+		}
+		memcpy(&(*value)[0], buf, ValueBytes);
+		return true;
+	}
+
+	RetCode open(const std::string& name, const Options& options) {
+		std::string data_path(name + ".fixed.data");
+		if (options.direct_io && ValueBytes % page == 0) {
+			data_fd = ::open(data_path.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+			direct = data_fd != -1;
+		}
+		if (data_fd == -1) {
+			data_fd = ::open(data_path.c_str(), O_RDWR | O_CREAT, 0644);
+		}
+		keys_fd = ::open((name + ".fixed.keys").c_str(), O_RDWR | O_CREAT, 0644);
+		if (data_fd == -1 || keys_fd == -1) {
+			return kIOError;
+		}
+
+		Header h;
+		memset(&h, 0, sizeof(h));
+		ssize_t n(pread(keys_fd, &h, sizeof(h), 0));
+		if (n == 0) {
+			memcpy(h.magic, "PKVFIXED", sizeof(h.magic));
+			h.key_bytes = KeyBytes;
+			h.value_bytes = ValueBytes;
+			if (pwrite(keys_fd, &h, sizeof(h), 0) != sizeof(h)) {
+				return kIOError;
+			}
+			return kSucc;
+		}
+		if (n != sizeof(h) || memcmp(h.magic, "PKVFIXED", sizeof(h.magic))) {
+			return kCorruption;
+		}
+		if (h.key_bytes != KeyBytes || h.value_bytes != ValueBytes) {
+			return kInvalidArgument;
+		}
+
+		// Slots are taken in order but written concurrently, so a crash
+		// can leave holes; they stay unused
+		std::vector<Record> rs(4096);
+		off_t off(sizeof(h));
+		uint32_t slot(0);
+		while ((n = pread(keys_fd, rs.data(), rs.size() * sizeof(Record), off)) > 0) {
+			size_t cnt(n / sizeof(Record));
+			for (size_t i = 0; i < cnt; ++i, ++slot) {
+				if (rs[i].slot == slot && rs[i].check == (slot ^ record_check)) {
+					index.stripeOf(rs[i].key).insert(rs[i].key, slot);
+					seqOf(slot).store(2, std::memory_order_relaxed);
+					next_slot = slot + 1;
+				}
+			}
+			if (cnt == 0) {
+				break;
+			}
+			off += cnt * sizeof(Record);
+		}
+		return n < 0 ? kIOError : kSucc;
+	}
+
+	int data_fd;
+	int keys_fd;
+	bool direct;
+	std::atomic<uint32_t> next_slot;
+	std::atomic<std::atomic<uint32_t>*>* seq_pages;	// n_pages, null until used
+	std::atomic<size_t> pages_used;
+	SlotIndex index;
+	StatsRecorder stats;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_FIXED_ENGINE_H_
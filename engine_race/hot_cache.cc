@@ -0,0 +1,216 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "hot_cache.h"
+
+#include <sched.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "slot_index.h"
+
+namespace polar_race {
+
+HotCache::HotCache(size_t bytes) : samples(0) {
+	size_t n_entries(0);
+	for (int i = 0; i < n_classes; ++i) {
+		Class& c(classes[i]);
+		c.max_len = max_value >> 2 * (n_classes - 1 - i);
+		c.stride = header + c.max_len / sizeof(uint64_t);
+		c.n_buckets = std::max<size_t>(1,
+				bytes / n_classes / (2 * c.stride * sizeof(uint64_t)));
+		// Value-initialized, so every entry starts empty at version 0
+		c.slab = new std::atomic<uint64_t>[c.n_buckets * 2 * c.stride]();
+		n_entries += c.n_buckets * 2;
+	}
+	size_t width(256);
+	while (width < n_entries * 4) {
+		width *= 2;
+	}
+	sketch_mask = width - 1;
+	sketch = std::vector<std::atomic<uint8_t> >(width * rows);
+	for (auto& c : sketch) {
+		c.store(0, std::memory_order_relaxed);
+	}
+	sample_size = n_entries * 10;
+}
+
+HotCache::~HotCache() {
+	for (auto& c : classes) {
+		delete [] c.slab;
+	}
+}
+
+inline HotCache::Class& HotCache::classOf(size_t len) {
+	int i(0);
+	while (len > classes[i].max_len) {
+		++i;
+	}
+	return classes[i];
+}
+
+inline std::atomic<uint64_t>* HotCache::bucketOf(const Class& c, size_t idx) {
+	return c.slab + SlotIndex::hash(idx) % c.n_buckets * 2 * c.stride;
+}
+
+void HotCache::record(size_t idx) {
+	uint64_t h(SlotIndex::hash(idx ^ 0x9e3779b97f4a7c15ull));
+	uint64_t step(h >> 32 | 1);
+	bool added(false);
+	for (int r = 0; r < rows; ++r, h += step) {
+		std::atomic<uint8_t>& c(sketch[r * (sketch_mask + 1) + (h & sketch_mask)]);
+		uint8_t n(c.load(std::memory_order_relaxed));
+		if (n < max_count) {
+			c.store(n + 1, std::memory_order_relaxed);
+			added = true;
+		}
+	}
+	// Ages the counts, so keys that cooled down can be displaced. Only
+	// the thread that reaches sample_size halves them.
+	if (added && samples.fetch_add(1, std::memory_order_relaxed) == sample_size) {
+		for (auto& c : sketch) {
+			c.store(c.load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+		}
+		samples.store(0, std::memory_order_relaxed);
+	}
+}
+
+uint8_t HotCache::estimate(size_t idx) {
+	uint64_t h(SlotIndex::hash(idx ^ 0x9e3779b97f4a7c15ull));
+	uint64_t step(h >> 32 | 1);
+	uint8_t n(max_count);
+	for (int r = 0; r < rows; ++r, h += step) {
+		uint8_t c(sketch[r * (sketch_mask + 1) + (h & sketch_mask)].load(
+					std::memory_order_relaxed));
+		n = std::min(n, c);
+	}
+	return n;
+}
+
+// The words are loaded relaxed, so a copy racing a fill is torn rather
+// than a data race, and the version check throws it away
+bool HotCache::lookup(size_t idx, uint64_t p, size_t len, std::string* value) {
+	record(idx);
+	if (len > max_value) {
+		return false;
+	}
+	Class& c(classOf(len));
+	std::atomic<uint64_t>* b(bucketOf(c, idx));
+	for (int i = 0; i < 2; ++i) {
+		std::atomic<uint64_t>* e(b + i * c.stride);
+		uint64_t v(e[version].load(std::memory_order_acquire));
+		if ((v & 1) || e[slot].load(std::memory_order_relaxed) != idx + 1 ||
+				e[pos].load(std::memory_order_relaxed) != p ||
+				e[length].load(std::memory_order_relaxed) != len) {
+			continue;
+		}
+		value->resize(len);
+		char* data((char*)value->data());
+		for (size_t w = 0; w * sizeof(uint64_t) < len; ++w) {
+			uint64_t word(e[header + w].load(std::memory_order_relaxed));
+			memcpy(data + w * sizeof(uint64_t), &word,
+					std::min(sizeof(uint64_t), len - w * sizeof(uint64_t)));
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return e[version].load(std::memory_order_relaxed) == v;
+	}
+	return false;
+}
+
+bool HotCache::take(std::atomic<uint64_t>* e, bool wait, uint64_t* v) {
+	for (;;) {
+		*v = e[version].load(std::memory_order_relaxed);
+		if (!(*v & 1) && e[version].compare_exchange_strong(*v, *v + 1,
+					std::memory_order_relaxed)) {
+			std::atomic_thread_fence(std::memory_order_release);
+			return true;
+		}
+		if (!wait) {
+			return false;
+		}
+		// A fill copies at most max_value bytes
+		sched_yield();
+	}
+}
+
+void HotCache::fill(std::atomic<uint64_t>* e, uint64_t v, size_t idx, uint64_t p,
+		const char* value, size_t len) {
+	e[slot].store(value ? idx + 1 : 0, std::memory_order_relaxed);
+	e[pos].store(p, std::memory_order_relaxed);
+	e[length].store(len, std::memory_order_relaxed);
+	for (size_t w = 0; w * sizeof(uint64_t) < len; ++w) {
+		uint64_t word(0);
+		memcpy(&word, value + w * sizeof(uint64_t),
+				std::min(sizeof(uint64_t), len - w * sizeof(uint64_t)));
+		e[header + w].store(word, std::memory_order_relaxed);
+	}
+	e[version].store(v + 2, std::memory_order_release);
+}
+
+bool HotCache::admit(size_t idx, uint64_t p, const char* value, size_t len) {
+	if (len > max_value) {
+		return false;
+	}
+	Class& c(classOf(len));
+	std::atomic<uint64_t>* b(bucketOf(c, idx));
+	std::atomic<uint64_t>* e[2] = { b, b + c.stride };
+	std::atomic<uint64_t>* victim(NULL);
+	for (int i = 0; i < 2 && victim == NULL; ++i) {
+		uint64_t s(e[i][slot].load(std::memory_order_relaxed));
+		// An older version of the key, or room
+		if (s == idx + 1 || s == 0) {
+			victim = e[i];
+		}
+	}
+	if (victim == NULL) {
+		uint8_t f0(estimate(e[0][slot].load(std::memory_order_relaxed) - 1));
+		uint8_t f1(estimate(e[1][slot].load(std::memory_order_relaxed) - 1));
+		victim = f0 <= f1 ? e[0] : e[1];
+		if (estimate(idx) <= std::min(f0, f1)) {
+			return false;
+		}
+	}
+	uint64_t v;
+	if (!take(victim, false, &v)) {
+		return false;
+	}
+	fill(victim, v, idx, p, value, len);
+	// Pairs with the fence in invalidate: either the write's invalidate
+	// sees this fill, or the caller's check sees the write's Item
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	return true;
+}
+
+// An entry neither holding idx nor being filled when looked at can only
+// get idx from a fill whose caller sees the newer Item and invalidates
+// again, so only the others are taken, waiting for a fill under way
+void HotCache::invalidate(size_t idx, size_t len) {
+	if (len > max_value) {
+		return;
+	}
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	Class& c(classOf(len));
+	std::atomic<uint64_t>* b(bucketOf(c, idx));
+	for (int i = 0; i < 2; ++i) {
+		std::atomic<uint64_t>* e(b + i * c.stride);
+		uint64_t v(e[version].load(std::memory_order_acquire));
+		if (!(v & 1) && e[slot].load(std::memory_order_relaxed) != idx + 1) {
+			continue;
+		}
+		take(e, true, &v);
+		if (e[slot].load(std::memory_order_relaxed) == idx + 1) {
+			fill(e, v, idx, 0, NULL, 0);
+		} else {
+			e[version].store(v + 2, std::memory_order_release);
+		}
+	}
+}
+
+size_t HotCache::bytes() const {
+	size_t n(sketch.size());
+	for (auto& c : classes) {
+		n += c.n_buckets * 2 * c.stride * sizeof(uint64_t);
+	}
+	return n;
+}
+
+}  // namespace polar_race
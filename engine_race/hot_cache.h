@@ -0,0 +1,100 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_HOT_CACHE_H_
+#define ENGINE_RACE_HOT_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace polar_race {
+
+// Values of the most read keys of one EngineRace, by index slot, so a
+// hit copies the value without touching the chunk, its lock or usecnt.
+//
+// Entries live in a slab per size class, each given an equal share of
+// the bytes, so short values are not charged the room of the longest
+// and the classes of short ones hold many more. A slot is cached in the
+// class of its value length. Entries come in buckets of two and are
+// words guarded by a seqlock: a reader copies them optimistically with
+// relaxed loads and takes a copy torn by a concurrent fill for a miss,
+// so a hit writes to no shared line. An entry only answers for the
+// Item::p it was filled from, which every write of the key changes;
+// writes invalidate the slot as well, to free the entry early, waiting
+// out a fill under way rather than missing it.
+//
+// Admission is TinyLFU. Every lookup counts the slot in a count-min
+// sketch of four rows of counters that saturate at 15 and are halved
+// once ten reads per entry have been counted, and a missed value only
+// displaces the entry whose slot the sketch thinks is read less. A scan
+// reading each key once thus leaves the hot keys in place. Saturated
+// counters are not written, so the hottest keys do not contend on the
+// sketch either.
+class HotCache {
+public:
+	// Longer values are not cached
+	static const size_t max_value = 4096;
+
+	// About bytes of entries, at least one bucket per size class
+	explicit HotCache(size_t bytes);
+	~HotCache();
+
+	// Copies the value of slot idx into value, if it is cached as of the
+	// Item at p, whose value is len bytes
+	bool lookup(size_t idx, uint64_t p, size_t len, std::string* value);
+
+	// Offers the value of slot idx just read from the Item at p. If it is
+	// taken, the caller checks that the Item is still the newest and
+	// invalidates the slot otherwise, as a write may have missed it.
+	bool admit(size_t idx, uint64_t p, const char* value, size_t len);
+
+	// Drops slot idx, whose value of len bytes changed
+	void invalidate(size_t idx, size_t len);
+
+	size_t bytes() const;
+
+private:
+	// Words of an entry, the value's after the header
+	enum { version, slot, pos, length, header };
+
+	// The entries of the values of up to max_len bytes
+	struct Class {
+		size_t max_len;
+		size_t stride;	// words per entry
+		size_t n_buckets;
+		std::atomic<uint64_t>* slab;
+	};
+
+	static const int n_classes = 4;
+	static const int rows = 4;
+	static const uint8_t max_count = 15;
+
+	HotCache(const HotCache&) = delete;
+	HotCache& operator=(const HotCache&) = delete;
+
+	inline Class& classOf(size_t len);
+	inline std::atomic<uint64_t>* bucketOf(const Class& c, size_t idx);
+
+	// Counts a read of idx in the sketch
+	void record(size_t idx);
+	uint8_t estimate(size_t idx);
+
+	// Takes entry e from readers, at version *v, unless another thread
+	// holds it and wait is not set
+	bool take(std::atomic<uint64_t>* e, bool wait, uint64_t* v);
+	// Writes the taken entry e and hands it back at version v + 2
+	void fill(std::atomic<uint64_t>* e, uint64_t v, size_t idx, uint64_t p,
+			const char* value, size_t len);
+
+	Class classes[n_classes];
+	std::vector<std::atomic<uint8_t> > sketch;
+	size_t sketch_mask;	// of one row
+	size_t sample_size;
+	std::atomic<size_t> samples;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_HOT_CACHE_H_
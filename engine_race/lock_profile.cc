@@ -0,0 +1,76 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "lock_profile.h"
+
+namespace polar_race {
+
+namespace {
+
+struct LockCounters {
+	std::atomic<uint64_t> acquisitions, contended, wait_ns, hold_ns;
+	char pad[32];
+};
+
+// One row of sites per thread slot, so profiling does not itself
+// bounce a shared line between the threads it measures.
+LockCounters lock_counters[StatsRecorder::n_slots][kNumLockSites];
+
+}  // namespace
+
+#ifdef POLAR_LOCK_PROFILE
+const bool lock_profiling = true;
+#else
+const bool lock_profiling = false;
+#endif  // POLAR_LOCK_PROFILE
+
+void ProfiledMutex::profiledLock() {
+	LockCounters& c(lock_counters[StatsRecorder::slotId()][site]);
+	if (!mtx.try_lock()) {
+		uint64_t t(nowNs());
+		mtx.lock();
+		acquired_at = nowNs();
+		c.contended.fetch_add(1, std::memory_order_relaxed);
+		c.wait_ns.fetch_add(acquired_at - t, std::memory_order_relaxed);
+	} else {
+		acquired_at = nowNs();
+	}
+	c.acquisitions.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ProfiledMutex::profiledUnlock() {
+	uint64_t held(nowNs() - acquired_at);
+	mtx.unlock();
+	lock_counters[StatsRecorder::slotId()][site].hold_ns.fetch_add(held,
+			std::memory_order_relaxed);
+}
+
+void ProfiledMutex::profiledPause() {
+	lock_counters[StatsRecorder::slotId()][site].hold_ns.fetch_add(nowNs() - acquired_at,
+			std::memory_order_relaxed);
+}
+
+void ProfiledMutex::profiledResume() {
+	acquired_at = nowNs();
+}
+
+void lockProfile(Stats* stats) {
+	if (!lock_profiling) {
+		return;
+	}
+	static const char* names[kNumLockSites] = {
+		"journal_mtx", "ret_mtx", "p_disk_mtx", "DataBlk::op",
+	};
+	for (int s = 0; s < kNumLockSites; ++s) {
+		LockStats l;
+		l.site = names[s];
+		for (size_t i = 0; i < StatsRecorder::n_slots; ++i) {
+			LockCounters& c(lock_counters[i][s]);
+			l.acquisitions += c.acquisitions.load(std::memory_order_relaxed);
+			l.contended += c.contended.load(std::memory_order_relaxed);
+			l.wait_ns += c.wait_ns.load(std::memory_order_relaxed);
+			l.hold_ns += c.hold_ns.load(std::memory_order_relaxed);
+		}
+		stats->locks.push_back(l);
+	}
+}
+
+}  // namespace polar_race
@@ -0,0 +1,89 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_LOCK_PROFILE_H_
+#define ENGINE_RACE_LOCK_PROFILE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "include/engine.h"
+#include "stats.h"
+
+namespace polar_race {
+
+// Lock sites are aggregated over every engine in the process; all the
+// per-chunk DataBlk locks count as one site.
+enum LockSite {
+	kLockJournal,
+	kLockRet,
+	kLockDisk,
+	kLockChunk,
+	kNumLockSites
+};
+
+// Adds the per-site counters to stats->locks. Empty unless built with
+// LOCK_PROFILE=1, which defines POLAR_LOCK_PROFILE.
+void lockProfile(Stats* stats);
+
+// Whether the library was built with LOCK_PROFILE=1. The flag only
+// changes lock_profile.cc, so every translation unit including this
+// header sees one and the same ProfiledMutex, whatever it was built
+// with.
+extern const bool lock_profiling;
+
+// std::mutex that, when profiling, counts acquisitions, contended
+// acquisitions and the time spent waiting for and holding it
+class ProfiledMutex {
+public:
+	explicit ProfiledMutex(LockSite site) : site(site), acquired_at(0) {}
+
+	void lock() {
+		if (lock_profiling) {
+			profiledLock();
+		} else {
+			mtx.lock();
+		}
+	}
+
+	void unlock() {
+		if (lock_profiling) {
+			profiledUnlock();
+		} else {
+			mtx.unlock();
+		}
+	}
+
+	// Waits on cv, holding the mutex from lock(), until pred holds, and
+	// leaves it held. Time spent waiting counts as neither hold nor wait.
+	template <class Pred>
+	void wait(std::condition_variable& cv, Pred pred) {
+		std::unique_lock<std::mutex> lck(mtx, std::adopt_lock);
+		while (!pred()) {
+			if (lock_profiling) {
+				profiledPause();
+			}
+			cv.wait(lck);
+			if (lock_profiling) {
+				profiledResume();
+			}
+		}
+		lck.release();
+	}
+
+private:
+	void profiledLock();
+	void profiledUnlock();
+	// Count the hold up to a wait, and restart it after
+	void profiledPause();
+	void profiledResume();
+
+	std::mutex mtx;
+	LockSite site;
+	uint64_t acquired_at;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_LOCK_PROFILE_H_
@@ -0,0 +1,171 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "long_key_index.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace polar_race {
+
+LongKeyIndex::LongKeyIndex()
+	: table(NULL), n(0), walkers(0), dir_size(16), n_blocks(0), block_used(block_size),
+	arena_bytes(0) {
+	dirs.push_back(new char*[dir_size]());
+	dir.store(dirs.back(), std::memory_order_relaxed);
+}
+
+LongKeyIndex::~LongKeyIndex() {
+	delete table.load(std::memory_order_relaxed);
+	for (auto t : retired) {
+		delete t;
+	}
+	for (size_t i = 0; i < n_blocks; ++i) {
+		delete [] dirs.back()[i];
+	}
+	for (auto d : dirs) {
+		delete [] d;
+	}
+}
+
+// FNV-1a with a finalizer other than hashShard's, so keys of one shard
+// still spread over the table. 0 marks empty cells and is never used.
+uint32_t LongKeyIndex::hash(const char* key, size_t n) {
+	uint64_t h(14695981039346656037ull);
+	for (size_t i = 0; i < n; ++i) {
+		h = (h ^ (unsigned char)key[i]) * 1099511628211ull;
+	}
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ull;
+	h ^= h >> 32;
+	return (uint32_t)h ? (uint32_t)h : 1;
+}
+
+bool LongKeyIndex::equal(const Cell& c, const char* key, size_t n) const {
+	uint64_t ref(c.ref.load(std::memory_order_relaxed));
+	const char* p(dir.load(std::memory_order_acquire)[ref >> 32] + (uint32_t)ref);
+	uint32_t len;
+	memcpy(&len, p, sizeof(len));
+	return len == n && memcmp(p + sizeof(len), key, n) == 0;
+}
+
+// A grow that sees no walker after publishing its table is ordered
+// before the load of table here, so this walk is on the new one
+uint32_t LongKeyIndex::find(const char* key, size_t n) const {
+	walkers.fetch_add(1, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const Table* t(table.load(std::memory_order_acquire));
+	uint32_t found(npos);
+	if (t) {
+		uint32_t fp(hash(key, n));
+		size_t mask(t->size - 1);
+		for (size_t i = fp & mask; ; i = (i + 1) & mask) {
+			uint32_t f(t->cells[i].fp.load(std::memory_order_acquire));
+			if (f == 0) {
+				break;
+			}
+			if (f == fp && equal(t->cells[i], key, n)) {
+				found = t->cells[i].idx.load(std::memory_order_relaxed);
+				break;
+			}
+		}
+	}
+	walkers.fetch_sub(1, std::memory_order_release);
+	return found;
+}
+
+void LongKeyIndex::insert(const char* key, size_t n, uint32_t idx) {
+	// Kept at most 3/4 full
+	Table* t(table.load(std::memory_order_relaxed));
+	if (t == NULL || (this->n + 1) * 4 > t->size * 3) {
+		grow();
+		t = table.load(std::memory_order_relaxed);
+	}
+	uint32_t fp(hash(key, n));
+	size_t mask(t->size - 1);
+	size_t i(fp & mask);
+	for (; t->cells[i].fp.load(std::memory_order_relaxed); i = (i + 1) & mask) {
+		if (t->cells[i].fp.load(std::memory_order_relaxed) == fp && equal(t->cells[i], key, n)) {
+			t->cells[i].idx.store(idx, std::memory_order_relaxed);
+			return;
+		}
+	}
+	t->cells[i].ref.store(intern(key, n), std::memory_order_relaxed);
+	t->cells[i].idx.store(idx, std::memory_order_relaxed);
+	t->cells[i].fp.store(fp, std::memory_order_release);
+	++this->n;
+}
+
+// Keys longer than a block get a block of their own
+uint64_t LongKeyIndex::intern(const char* key, size_t n) {
+	uint32_t len(n);
+	size_t need(sizeof(len) + n);
+	char** d(dirs.back());
+	if (block_used + need > block_size) {
+		if (n_blocks == dir_size) {
+			char** grown(new char*[dir_size * 2]());
+			memcpy(grown, d, dir_size * sizeof(char*));
+			dirs.push_back(grown);
+			dir.store(grown, std::memory_order_release);
+			dir_size *= 2;
+			d = grown;
+		}
+		size_t sz(std::max(need, (size_t)block_size));
+		d[n_blocks++] = new char[sz];
+		arena_bytes += sz;
+		block_used = 0;
+	}
+	char* p(d[n_blocks - 1] + block_used);
+	memcpy(p, &len, sizeof(len));
+	memcpy(p + sizeof(len), key, n);
+	uint64_t ref((uint64_t)(n_blocks - 1) << 32 | block_used);
+	block_used += need;
+	return ref;
+}
+
+// Cells carry their fingerprint, so growing reads no keys
+void LongKeyIndex::grow() {
+	Table* old(table.load(std::memory_order_relaxed));
+	Table* t(new Table(old ? old->size * 2 : 1024));
+	size_t mask(t->size - 1);
+	for (size_t j = 0; old && j < old->size; ++j) {
+		const Cell& c(old->cells[j]);
+		uint32_t fp(c.fp.load(std::memory_order_relaxed));
+		if (fp) {
+			size_t i(fp & mask);
+			while (t->cells[i].fp.load(std::memory_order_relaxed)) {
+				i = (i + 1) & mask;
+			}
+			t->cells[i].ref.store(c.ref.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			t->cells[i].idx.store(c.idx.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			t->cells[i].fp.store(fp, std::memory_order_relaxed);
+		}
+	}
+	table.store(t, std::memory_order_release);
+	if (old) {
+		retired.push_back(old);
+	}
+	// A find that starts walking after the fence finds t, so with none
+	// walking now the retired tables can go
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (walkers.load(std::memory_order_acquire) == 0) {
+		for (auto r : retired) {
+			delete r;
+		}
+		retired.clear();
+	}
+}
+
+size_t LongKeyIndex::bytes() const {
+	const Table* t(table.load(std::memory_order_relaxed));
+	size_t cells(t ? t->size : 0);
+	for (auto r : retired) {
+		cells += r->size;
+	}
+	size_t dir_bytes(0);
+	for (size_t i = 0, sz = 16; i < dirs.size(); ++i, sz *= 2) {
+		dir_bytes += sz * sizeof(char*);
+	}
+	return cells * sizeof(Cell) + dir_bytes + arena_bytes;
+}
+
+}  // namespace polar_race
@@ -0,0 +1,83 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_LONG_KEY_INDEX_H_
+#define ENGINE_RACE_LONG_KEY_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+namespace polar_race {
+
+// Maps keys of any length to a 32-bit index. Keys are copied once into
+// append-only arena blocks, each behind a 4-byte length, and the table
+// holds 16-byte cells of arena reference, hash fingerprint and index,
+// with open addressing and linear probing. Lookups take the key as
+// bytes and allocate nothing.
+//
+// find is safe against one thread inserting. A cell is published by a
+// release store of its fingerprint after the key and the rest of the
+// cell are written. A grown table is published with a release store and
+// the old one retired, freed by a later grow once no find is walking
+// one; a grown block directory is kept until the index goes.
+class LongKeyIndex {
+public:
+	static const uint32_t npos = -1u;
+	static const size_t block_size = 1 << 20;
+
+	LongKeyIndex();
+	~LongKeyIndex();
+
+	LongKeyIndex(const LongKeyIndex&) = delete;
+	LongKeyIndex& operator=(const LongKeyIndex&) = delete;
+
+	uint32_t find(const char* key, size_t n) const;
+
+	// Sets the index of key, adding it if absent
+	void insert(const char* key, size_t n, uint32_t idx);
+
+	size_t size() const { return n; }
+
+	// Table and arena bytes held
+	size_t bytes() const;
+
+private:
+	struct Cell {
+		std::atomic<uint64_t> ref;	// block << 32 | offset, of the length-prefixed key
+		std::atomic<uint32_t> fp;	// hash of the key, 0 for an empty cell
+		std::atomic<uint32_t> idx;
+	};
+
+	struct Table {
+		// Value-initialized, so every cell starts empty
+		explicit Table(size_t size) : size(size), cells(new Cell[size]()) {}
+		~Table() {
+			delete [] cells;
+		}
+
+		size_t size;
+		Cell* cells;
+	};
+
+	static uint32_t hash(const char* key, size_t n);
+
+	bool equal(const Cell& c, const char* key, size_t n) const;
+	uint64_t intern(const char* key, size_t n);
+	void grow();
+
+	std::atomic<Table*> table;	// null until the first insert
+	size_t n;
+	std::vector<Table*> retired;	// grown out of while finds may walk them
+	mutable std::atomic<size_t> walkers;
+
+	std::atomic<char**> dir;	// of the blocks
+	size_t dir_size, n_blocks;
+	std::vector<char**> dirs;	// every directory, the current one last
+	size_t block_used;	// in the last block
+	size_t arena_bytes;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_LONG_KEY_INDEX_H_
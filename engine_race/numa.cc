@@ -0,0 +1,142 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "numa.h"
+
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace polar_race {
+
+namespace {
+
+struct Node {
+	int id;		// the kernel's
+	std::vector<int> cpus;
+};
+
+// "0-3,8-11"
+std::vector<int> parseCpuList(const std::string& s) {
+	std::vector<int> cpus;
+	const char* p(s.c_str());
+	while (*p) {
+		char* end;
+		long lo(strtol(p, &end, 10));
+		if (end == p) {
+			break;
+		}
+		long hi(lo);
+		if (*end == '-') {
+			p = end + 1;
+			hi = strtol(p, &end, 10);
+		}
+		for (long c = lo; c <= hi; ++c) {
+			cpus.push_back(c);
+		}
+		p = *end == ',' ? end + 1 : end;
+	}
+	return cpus;
+}
+
+const std::vector<Node>& topology() {
+	static std::vector<Node>* nodes = [] {
+		std::vector<Node>* nodes(new std::vector<Node>());
+		DIR* d(opendir("/sys/devices/system/node"));
+		if (d == NULL) {
+			return nodes;
+		}
+		while (dirent* e = readdir(d)) {
+			if (strncmp(e->d_name, "node", 4) || e->d_name[4] < '0' || e->d_name[4] > '9') {
+				continue;
+			}
+			Node n;
+			n.id = atoi(e->d_name + 4);
+			std::string list;
+			std::ifstream in(std::string("/sys/devices/system/node/") + e->d_name + "/cpulist");
+			std::getline(in, list);
+			n.cpus = parseCpuList(list);
+			// Memory-only nodes have nothing to pin to
+			if (n.cpus.size()) {
+				nodes->push_back(n);
+			}
+		}
+		closedir(d);
+		std::sort(nodes->begin(), nodes->end(),
+				[](const Node& a, const Node& b) { return a.id < b.id; });
+		return nodes;
+	}();
+	return *nodes;
+}
+
+const unsigned long max_node(Numa::mask_words * sizeof(unsigned long) * 8);
+
+int setPolicy(void* p, size_t len, int node, int mode) {
+	unsigned long mask[Numa::mask_words] = { 0 };
+	if (mode != MPOL_DEFAULT) {
+		int id(topology()[node].id);
+		if ((unsigned long)id >= max_node) {
+			return -1;
+		}
+		mask[id / (sizeof(unsigned long) * 8)] |= 1ul << (id % (sizeof(unsigned long) * 8));
+	}
+	if (p) {
+		return syscall(SYS_mbind, p, len, mode, mask, max_node + 1, 0);
+	}
+	return syscall(SYS_set_mempolicy, mode, mode == MPOL_DEFAULT ? NULL : mask,
+			mode == MPOL_DEFAULT ? 0 : max_node + 1);
+}
+
+}  // namespace
+
+size_t Numa::nodes() {
+	return std::max<size_t>(topology().size(), 1);
+}
+
+void Numa::pinThread(int node) {
+	if (node < 0 || (size_t)node >= topology().size()) {
+		return;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int c : topology()[node].cpus) {
+		if (c < CPU_SETSIZE) {
+			CPU_SET(c, &set);
+		}
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+void Numa::bindMemory(void* p, size_t len, int node) {
+	if (node >= 0 && (size_t)node < topology().size()) {
+		setPolicy(p, len, node, MPOL_PREFERRED);
+	}
+}
+
+// The old policy keeps its mode flags, which set_mempolicy takes back
+// along with the mode
+Numa::PreferScope::PreferScope(int node) : node(node), old_mode(MPOL_DEFAULT) {
+	if (node >= 0 && (size_t)node < topology().size()) {
+		if (syscall(SYS_get_mempolicy, &old_mode, old_mask, max_node + 1, NULL, 0) != 0) {
+			old_mode = MPOL_DEFAULT;
+		}
+		setPolicy(NULL, 0, node, MPOL_PREFERRED);
+	}
+}
+
+Numa::PreferScope::~PreferScope() {
+	if (node >= 0 && (size_t)node < topology().size()) {
+		bool dflt(old_mode == MPOL_DEFAULT);
+		syscall(SYS_set_mempolicy, old_mode, dflt ? NULL : old_mask, dflt ? 0 : max_node + 1);
+	}
+}
+
+}  // namespace polar_race
@@ -0,0 +1,44 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_NUMA_H_
+#define ENGINE_RACE_NUMA_H_
+
+#include <stddef.h>
+
+namespace polar_race {
+
+// The NUMA nodes with CPUs, read from sysfs, and the calls that place
+// threads and memory on them. Nodes are numbered 0 .. nodes() - 1 here,
+// whatever the kernel's ids. System calls are made directly, so nothing
+// links against libnuma, and every call is a no-op for a node < 0.
+class Numa {
+public:
+	// 1 on machines without NUMA
+	static size_t nodes();
+
+	// Moves the calling thread onto the CPUs of node
+	static void pinThread(int node);
+
+	// Prefers node for the pages of [p, p + len), which must be page
+	// aligned, when they are first touched
+	static void bindMemory(void* p, size_t len, int node);
+
+	// Words of the node masks handed to the kernel
+	static const size_t mask_words = 16;
+
+	// Prefers node for what the calling thread touches first until the
+	// scope ends, then puts back the thread's policy from before
+	class PreferScope {
+	public:
+		explicit PreferScope(int node);
+		~PreferScope();
+
+	private:
+		int node;
+		int old_mode;
+		unsigned long old_mask[mask_words];
+	};
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_NUMA_H_
@@ -0,0 +1,64 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "op_recorder.h"
+#include "stats.h"
+
+namespace polar_race {
+
+OpRecorder::~OpRecorder() {
+	if (fd != -1) {
+		flushBuffer();
+		close(fd);
+	}
+}
+
+RetCode OpRecorder::open(const std::string& path) {
+	fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		return kIOError;
+	}
+	OpTraceHeader h;
+	memcpy(h.magic, kOpTraceMagic, sizeof(h.magic));
+	h.version = kOpTraceVersion;
+	h.reserved = 0;
+	buf.reserve(buffer_size * 2);
+	buf.append((const char*)&h, sizeof(h));
+	start = nowNs();
+	return kSucc;
+}
+
+void OpRecorder::record(OpTraceOp op, const PolarString& key, size_t value_len,
+		const PolarString& extra) {
+	OpTraceRecord r;
+	r.op = op;
+	r.key_len = key.size();
+	r.value_len = op == kOpTraceRange ? extra.size() : value_len;
+	r.reserved = 0;
+	std::lock_guard<std::mutex> lck(mtx);
+	// Taken under the lock so the file is ordered by time
+	r.ts_ns = nowNs() - start;
+	buf.append((const char*)&r, sizeof(r));
+	buf.append(key.data(), key.size());
+	buf.append(extra.data(), extra.size());
+	if (buf.size() >= buffer_size) {
+		flushBuffer();
+	}
+}
+
+void OpRecorder::flushBuffer() {
+	size_t off(0);
+	while (off < buf.size()) {
+		ssize_t n = write(fd, buf.data() + off, buf.size() - off);
+		if (n <= 0) {
+			break;
+		}
+		off += n;
+	}
+	buf.clear();
+}
+
+}  // namespace polar_race
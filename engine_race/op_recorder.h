@@ -0,0 +1,43 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_OP_RECORDER_H_
+#define ENGINE_RACE_OP_RECORDER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <mutex>
+
+#include "include/engine.h"
+#include "include/op_trace.h"
+
+namespace polar_race {
+
+// Writes the operations an engine receives to a trace file (see
+// include/op_trace.h). Records are appended to one buffer under a mutex
+// and written out whenever it fills, so recording costs a short critical
+// section per operation and a write() per buffer_size bytes.
+class OpRecorder {
+public:
+	static const size_t buffer_size = 1 << 20;
+
+	OpRecorder() : fd(-1), start(0) {}
+	~OpRecorder();
+
+	RetCode open(const std::string& path);
+
+	// extra is the upper bound of a range, stored after the key
+	void record(OpTraceOp op, const PolarString& key, size_t value_len,
+			const PolarString& extra = PolarString());
+
+private:
+	void flushBuffer();
+
+	std::mutex mtx;
+	std::string buf;
+	int fd;
+	uint64_t start;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_OP_RECORDER_H_
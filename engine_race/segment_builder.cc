@@ -0,0 +1,172 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include <string.h>
+
+#include "include/segment.h"
+#include "sharded_engine.h"
+
+namespace polar_race {
+
+struct SegmentBuilder::Shard {
+	static const size_t buf_size = 1 << 20;
+
+	int fd;
+	uint32_t id, n;
+	uint64_t size;		// bytes written and buffered
+	std::vector<char> buf;
+	std::vector<SegmentEntry> entries;
+	RetCode ret;
+
+	Shard() : fd(-1), id(0), n(0), size(0), ret(kSucc) {}
+
+	~Shard() {
+		if (fd != -1) {
+			close(fd);
+		}
+	}
+
+	void write(const char* p, size_t len) {
+		while (len && ret == kSucc) {
+			ssize_t w(::write(fd, p, len));
+			if (w <= 0) {
+				ret = kIOError;
+				break;
+			}
+			p += w;
+			len -= w;
+		}
+	}
+
+	void flushBuf() {
+		write(buf.data(), buf.size());
+		buf.clear();
+	}
+
+	void finish();
+};
+
+// Keys are compared in the written data, mapped back in, so the
+// entries stay 16 bytes each.
+void SegmentBuilder::Shard::finish() {
+	flushBuf();
+	char* data(0);
+	if (size && ret == kSucc) {
+		data = (char*)mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+			ret = kIOError;
+			return;
+		}
+	}
+	auto key = [data](const SegmentEntry& e) {
+		return PolarString(data + e.offset, e.key_len);
+	};
+	auto less = [&key](const SegmentEntry& a, const SegmentEntry& b) {
+		return key(a).compare(key(b)) < 0;
+	};
+	bool sorted(true);
+	for (size_t i = 1; i < entries.size() && sorted; ++i) {
+		sorted = less(entries[i - 1], entries[i]);
+	}
+	if (!sorted) {
+		// Equal keys keep the order they were added in; the last one wins
+		std::stable_sort(entries.begin(), entries.end(), less);
+		size_t m(0);
+		for (size_t i = 0; i < entries.size(); ++i) {
+			if (i + 1 < entries.size() && !less(entries[i], entries[i + 1])) {
+				continue;
+			}
+			entries[m++] = entries[i];
+		}
+		entries.resize(m);
+	}
+	if (data) {
+		munmap(data, size);
+	}
+
+	SegmentFooter f;
+	memset(&f, 0, sizeof(f));
+	memcpy(f.magic, kSegmentMagic, sizeof(f.magic));
+	f.version = kSegmentVersion;
+	f.shard = id;
+	f.shards = n;
+	f.records = entries.size();
+	f.index_offset = size;
+	write((const char*)entries.data(), entries.size() * sizeof(SegmentEntry));
+	write((const char*)&f, sizeof(f));
+	if (ret == kSucc && fsync(fd) != 0) {
+		ret = kIOError;
+	}
+	std::vector<SegmentEntry>().swap(entries);
+}
+
+std::string SegmentBuilder::SegmentPath(const std::string& dir, int i) {
+	return dir + "/shard" + std::to_string(i) + ".seg";
+}
+
+RetCode SegmentBuilder::Open(const std::string& dir, int shards,
+		SegmentBuilder** builder) {
+	*builder = NULL;
+	if (shards <= 0 || shards > ShardedEngine::max_shards) {
+		return kInvalidArgument;
+	}
+	SegmentBuilder* b = new SegmentBuilder();
+	for (int i = 0; i < shards; ++i) {
+		Shard* s = new Shard();
+		s->id = i;
+		s->n = shards;
+		s->fd = open(SegmentPath(dir, i).c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+		b->shards_.push_back(s);
+		if (s->fd == -1) {
+			delete b;
+			return kIOError;
+		}
+	}
+	*builder = b;
+	return kSucc;
+}
+
+SegmentBuilder::~SegmentBuilder() {
+	for (auto s : shards_) {
+		delete s;
+	}
+}
+
+RetCode SegmentBuilder::Add(const PolarString& key, const PolarString& value) {
+	if (finished_) {
+		return kInvalidArgument;
+	}
+	Shard* s(shards_[hashShard(key.data(), key.size()) % shards_.size()]);
+	SegmentEntry e;
+	e.offset = s->size;
+	e.key_len = key.size();
+	e.value_len = value.size();
+	s->entries.push_back(e);
+	s->buf.insert(s->buf.end(), key.data(), key.data() + key.size());
+	s->buf.insert(s->buf.end(), value.data(), value.data() + value.size());
+	s->size += key.size() + value.size();
+	if (s->buf.size() >= Shard::buf_size) {
+		s->flushBuf();
+	}
+	return s->ret;
+}
+
+RetCode SegmentBuilder::Finish() {
+	if (finished_) {
+		return kInvalidArgument;
+	}
+	finished_ = true;
+	std::vector<std::thread> ths;
+	for (auto s : shards_) {
+		ths.push_back(std::thread(&Shard::finish, s));
+	}
+	for (auto& t : ths) {
+		t.join();
+	}
+	for (auto s : shards_) {
+		if (s->ret != kSucc) {
+			return s->ret;
+		}
+	}
+	return kSucc;
+}
+
+}  // namespace polar_race
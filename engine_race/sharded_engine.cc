@@ -0,0 +1,773 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "sharded_engine.h"
+
+#include <sys/file.h>
+
+#include <functional>
+#include <sstream>
+
+namespace polar_race {
+
+// FNV-1a followed by a 64-bit finalizer. hashPolar only packs bytes and
+// would send keys sharing a suffix to the same shard.
+unsigned long long hashShard(const char* s, size_t n) {
+	unsigned long long h(14695981039346656037ull);
+	for (size_t i = 0; i < n; ++i) {
+		h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+std::string ShardedEngine::shardPath(const std::string& name, size_t i, size_t n) {
+	if (n == 1) {
+		return name;
+	}
+	return name + ".shard" + std::to_string(i);
+}
+
+EngineRace::Config ShardedEngine::shardConfig(const std::string& name,
+		const Manifest& m, size_t i) {
+	std::string path(shardPath(name, i, m.shards));
+	std::string base(path.substr(path.rfind('/') + 1));
+	EngineRace::Config conf;
+	conf.max_chunks = std::max<size_t>(conf.max_chunks / m.shards, 4);
+	for (size_t f = 0; f < m.log_dirs.size(); ++f) {
+		conf.data_paths.push_back(m.log_dirs[f] + "/" + base + "." +
+				std::to_string(f) + ".data");
+	}
+	if (m.meta_dir.size()) {
+		conf.meta_path = m.meta_dir + "/" + base + ".meta";
+	}
+	conf.segments = m.segments;
+	if (m.ingest.size() == m.shards) {
+		conf.redo_from = m.ingest[i];
+	}
+	return conf;
+}
+
+RetCode ShardedEngine::loadManifest(const std::string& name, Manifest* m) {
+	std::ifstream in(name + ".manifest");
+	if (!in.is_open()) {
+		// Stores predating the manifest are a single unsharded instance
+		std::ifstream legacy(name + ".meta");
+		m->shards = legacy.is_open() ? 1 : 0;
+		return kSucc;
+	}
+	std::string line;
+	while (std::getline(in, line)) {
+		size_t sp(line.find(' '));
+		std::string tag(line.substr(0, sp));
+		std::string val(sp == std::string::npos ? "" : line.substr(sp + 1));
+		if (tag == "shards") {
+			m->shards = std::strtoul(val.c_str(), NULL, 10);
+		} else if (tag == "log_dir") {
+			m->log_dirs.push_back(val);
+		} else if (tag == "meta_dir") {
+			m->meta_dir = val;
+		} else if (tag == "segments") {
+			m->segments = std::strtoul(val.c_str(), NULL, 10);
+		} else if (tag == "ingest") {
+			std::istringstream ends(val);
+			size_t end;
+			while (ends >> end) {
+				m->ingest.push_back(end);
+			}
+		}
+	}
+	if (m->shards == 0 || m->shards > max_shards) {
+		return kCorruption;
+	}
+	return kSucc;
+}
+
+RetCode ShardedEngine::saveManifest(const std::string& name, const Manifest& m,
+		bool sync) {
+	std::string tmp(name + ".manifest.tmp");
+	std::ofstream ou(tmp, std::ios::trunc);
+	ou << "shards " << m.shards << "\n";
+	for (auto& d : m.log_dirs) {
+		ou << "log_dir " << d << "\n";
+	}
+	if (m.meta_dir.size()) {
+		ou << "meta_dir " << m.meta_dir << "\n";
+	}
+	if (m.segments != -1u) {
+		ou << "segments " << m.segments << "\n";
+	}
+	if (m.ingest.size()) {
+		ou << "ingest";
+		for (size_t end : m.ingest) {
+			ou << " " << end;
+		}
+		ou << "\n";
+	}
+	ou.close();
+	if (!ou || (sync && syncFile(tmp) != kSucc) ||
+			rename(tmp.c_str(), (name + ".manifest").c_str()) != 0 ||
+			(sync && syncDir(name) != kSucc)) {
+		return kIOError;
+	}
+	return kSucc;
+}
+
+RetCode ShardedEngine::Open(const std::string& name, const Options& options,
+		Engine** eptr) {
+	*eptr = NULL;
+	Manifest m;
+	RetCode ret = loadManifest(name, &m);
+	if (ret != kSucc) {
+		return ret;
+	}
+	if (m.shards == 0 && options.read_only) {
+		return kNotFound;
+	}
+	if (m.shards == 0) {
+		if (options.shards < 0 || options.shards > max_shards) {
+			return kInvalidArgument;
+		}
+		m.shards = options.shards;
+		if (m.shards == 0) {
+			m.shards = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u),
+					max_shards);
+		}
+		m.log_dirs = options.log_dirs;
+		m.meta_dir = options.meta_dir;
+		ret = saveManifest(name, m);
+		if (ret != kSucc) {
+			return ret;
+		}
+	}
+
+	OpRecorder* recorder(0);
+	if (options.op_trace.size()) {
+		recorder = new OpRecorder();
+		ret = recorder->open(options.op_trace);
+		if (ret != kSucc) {
+			delete recorder;
+			return ret;
+		}
+	}
+
+	ShardedEngine* engine = new ShardedEngine(name);
+	engine->read_only = options.read_only;
+	ret = engine->lockStore(options.read_only);
+	if (ret != kSucc) {
+		delete recorder;
+		delete engine;
+		return ret;
+	}
+	engine->recorder = recorder;
+	if (options.trace_sample) {
+		engine->tracer = new Tracer(options.trace_sample);
+	}
+	if (options.stall_threshold_ns) {
+		engine->stall_log = new StallLog(options.stall_threshold_ns,
+				options.stall_log_size);
+	}
+	if (options.change_retention && !options.read_only) {
+		engine->changes = new ChangeLog(options.change_retention, m.shards);
+	}
+	size_t nodes(options.numa ? Numa::nodes() : 1);
+	for (size_t i = 0; i < m.shards; ++i) {
+		EngineRace::Config conf(shardConfig(name, m, i));
+		conf.stats = &engine->stats;
+		conf.tracer = engine->tracer;
+		conf.stalls = engine->stall_log;
+		conf.snapshots = &engine->snapshots;
+		conf.changes = engine->changes;
+		conf.shard = i;
+		conf.hot_cache_bytes = options.hot_cache_bytes / m.shards;
+		conf.numa_node = nodes > 1 ? i % nodes : -1;
+		conf.read_only = options.read_only;
+		EngineRace* shard(NULL);
+		auto open_shard = [&] {
+			Numa::pinThread(conf.numa_node);
+			shard = new EngineRace(shardPath(name, i, m.shards), conf);
+			ret = shard->init(shardPath(name, i, m.shards));
+		};
+		// On a thread of its node, so the journal and the index rebuilt
+		// by init are first touched there
+		if (conf.numa_node >= 0) {
+			std::thread(open_shard).join();
+		} else {
+			open_shard();
+		}
+		engine->shards.push_back(shard);
+		if (ret != kSucc) {
+			delete engine;
+			return ret;
+		}
+	}
+	// Every shard redid the last ingest as it opened
+	if (m.ingest.size() && !options.read_only) {
+		m.ingest.clear();
+		ret = saveManifest(name, m);
+		if (ret != kSucc) {
+			delete engine;
+			return ret;
+		}
+	}
+	engine->manifest = m;
+	*eptr = engine;
+	return kSucc;
+}
+
+ShardedEngine::~ShardedEngine() {
+	for (auto s : shards) {
+		delete s;
+	}
+	delete tracer;
+	delete recorder;
+	delete stall_log;
+	delete changes;
+	if (lock_fd != -1) {
+		close(lock_fd);
+	}
+}
+
+RetCode ShardedEngine::lockStore(bool read_only) {
+	if (read_only) {
+		return kSucc;
+	}
+	lock_fd = open((name + ".lock").c_str(), O_RDONLY | O_CREAT, 0644);
+	if (lock_fd == -1) {
+		return kIOError;
+	}
+	if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+		// Another writer has the store open
+		return kIOError;
+	}
+	return kSucc;
+}
+
+RetCode ShardedEngine::Write(const PolarString& key, const PolarString& value) {
+	if (read_only) {
+		return kNotSupported;
+	}
+	ScopedLatency lat(&stats, StatsRecorder::kWrite);
+	TraceScope t(tracer, kTraceWrite);
+	if (recorder) {
+		recorder->record(kOpTraceWrite, key, value.size());
+	}
+	stats.add(StatsRecorder::kBytesWritten, key.size() + value.size());
+	return shardOf(key)->Write(key, value);
+}
+
+RetCode ShardedEngine::Read(const PolarString& key, std::string* value) {
+	return ReadAt(NULL, key, value);
+}
+
+RetCode ShardedEngine::ReadAt(const Snapshot* snapshot, const PolarString& key,
+		std::string* value) {
+	ScopedLatency lat(&stats, StatsRecorder::kRead);
+	TraceScope t(tracer, kTraceRead);
+	if (recorder) {
+		recorder->record(kOpTraceRead, key, 0);
+	}
+	RetCode ret = snapshot ? shardOf(key)->readAt(key, snapshot->sequence(), value) :
+		shardOf(key)->Read(key, value);
+	if (ret == kSucc) {
+		stats.add(StatsRecorder::kBytesRead, value->size());
+	} else {
+		stats.add(StatsRecorder::kReadMisses, 1);
+	}
+	return ret;
+}
+
+RetCode ShardedEngine::Range(const PolarString& lower, const PolarString& upper,
+		Visitor &visitor) {
+	return RangeAt(NULL, lower, upper, visitor);
+}
+
+RetCode ShardedEngine::RangeAt(const Snapshot* snapshot, const PolarString& lower,
+		const PolarString& upper, Visitor &visitor) {
+	ScopedLatency lat(&stats, StatsRecorder::kRange);
+	TraceScope t(tracer, kTraceRange);
+	if (recorder) {
+		recorder->record(kOpTraceRange, lower, 0, upper);
+	}
+	IteratorOptions o;
+	o.lower = lower.ToString();
+	o.upper = upper.ToString();
+	o.snapshot = snapshot;
+	ShardedIterator it(shards, iteratorSnapshots(), o);
+	for (it.SeekToFirst(); it.Valid(); it.Next()) {
+		visitor.Visit(it.key(), it.value());
+	}
+	return kSucc;
+}
+
+// The iterator's cursors drop keys as they move on, so keys are copied
+// into a batch along with the values
+RetCode ShardedEngine::RangeBatch(const PolarString& lower,
+		const PolarString& upper, BatchVisitor &visitor, size_t batch_size) {
+	if (batch_size == 0) {
+		return kInvalidArgument;
+	}
+	ScopedLatency lat(&stats, StatsRecorder::kRange);
+	TraceScope t(tracer, kTraceRange);
+	if (recorder) {
+		recorder->record(kOpTraceRange, lower, 0, upper);
+	}
+	IteratorOptions o;
+	o.lower = lower.ToString();
+	o.upper = upper.ToString();
+	ShardedIterator it(shards, iteratorSnapshots(), o);
+	std::vector<PolarString> keys(batch_size), values(batch_size);
+	std::vector<std::string> key_bufs(batch_size), bufs(batch_size);
+	size_t n(0);
+	for (it.SeekToFirst(); it.Valid(); it.Next()) {
+		PolarString k(it.key());
+		key_bufs[n].assign(k.data(), k.size());
+		keys[n] = PolarString(key_bufs[n]);
+		PolarString v(it.value());
+		bufs[n].assign(v.data(), v.size());
+		values[n] = PolarString(bufs[n]);
+		if (++n == batch_size) {
+			visitor.Visit(keys.data(), values.data(), n);
+			n = 0;
+		}
+	}
+	if (n) {
+		visitor.Visit(keys.data(), values.data(), n);
+	}
+	return kSucc;
+}
+
+// Every shard samples its part of the range at n * 8 byte offsets; the
+// samples of all shards in key order are then cut into n equal shares.
+void ShardedEngine::splitRange(const PolarString& lower, const PolarString& upper,
+		size_t n, std::vector<std::string>* bounds) {
+	std::vector<std::pair<std::string, uint64_t> > samples;
+	uint64_t total(0);
+	for (auto s : shards) {
+		s->sampleKeys(lower, upper, n * 8, &samples);
+	}
+	std::sort(samples.begin(), samples.end());
+	for (auto& i : samples) {
+		total += i.second;
+	}
+	bounds->assign(1, lower.ToString());
+	uint64_t acc(0);
+	for (auto& i : samples) {
+		if (acc > 0 && bounds->size() < n && acc >= total * bounds->size() / n) {
+			bounds->push_back(i.first);
+		}
+		acc += i.second;
+	}
+	bounds->push_back(upper.ToString());
+}
+
+namespace {
+
+// Batches of one partition handed from its reader to the calling thread
+struct PartitionQueue {
+	static const size_t max_batches = 4;
+	static const size_t batch_size = 256;
+
+	typedef std::vector<std::pair<std::string, std::string> > Batch;
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::deque<Batch> batches;
+	bool done;
+
+	PartitionQueue() : done(false) {}
+
+	void push(Batch* b, bool last) {
+		std::unique_lock<std::mutex> lck(mtx);
+		cv.wait(lck, [&] { return batches.size() < max_batches; });
+		if (b->size()) {
+			batches.push_back(Batch());
+			batches.back().swap(*b);
+		}
+		done = last;
+		cv.notify_all();
+	}
+
+	// False once the partition is exhausted
+	bool pop(Batch* b) {
+		std::unique_lock<std::mutex> lck(mtx);
+		cv.wait(lck, [&] { return batches.size() || done; });
+		if (batches.empty()) {
+			return false;
+		}
+		b->swap(batches.front());
+		batches.pop_front();
+		cv.notify_all();
+		return true;
+	}
+};
+
+}  // namespace
+
+RetCode ShardedEngine::ParallelRange(const PolarString& lower,
+		const PolarString& upper, size_t n, VisitorFactory& factory, bool ordered) {
+	if (n == 0) {
+		return kInvalidArgument;
+	}
+	ScopedLatency lat(&stats, StatsRecorder::kRange);
+	TraceScope t(tracer, kTraceRange);
+	if (recorder) {
+		recorder->record(kOpTraceRange, lower, 0, upper);
+	}
+	std::vector<std::string> bounds;
+	splitRange(lower, upper, n, &bounds);
+	size_t parts(bounds.size() - 1);
+	std::vector<Visitor*> visitors(parts);
+	for (size_t i = 0; i < parts; ++i) {
+		visitors[i] = factory.NewVisitor(i, bounds[i], bounds[i + 1]);
+	}
+
+	// Partitions are taken in order, so the one the calling thread waits
+	// on in ordered mode is always being read
+	std::vector<PartitionQueue> queues(ordered ? parts : 0);
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i; (i = next++) < parts; ) {
+			IteratorOptions o;
+			o.lower = bounds[i];
+			o.upper = bounds[i + 1];
+			ShardedIterator it(shards, iteratorSnapshots(), o);
+			PartitionQueue::Batch batch;
+			for (it.SeekToFirst(); it.Valid(); it.Next()) {
+				if (!ordered) {
+					visitors[i]->Visit(it.key(), it.value());
+					continue;
+				}
+				batch.push_back(std::make_pair(it.key().ToString(), it.value().ToString()));
+				if (batch.size() == PartitionQueue::batch_size) {
+					queues[i].push(&batch, false);
+				}
+			}
+			if (ordered) {
+				queues[i].push(&batch, true);
+			}
+		}
+	};
+	size_t n_workers(std::min(parts,
+				(size_t)std::max(1u, std::thread::hardware_concurrency())));
+	std::vector<std::thread> workers;
+	for (size_t i = ordered ? 0 : 1; i < n_workers; ++i) {
+		workers.push_back(std::thread(worker));
+	}
+	if (ordered) {
+		PartitionQueue::Batch batch;
+		for (size_t i = 0; i < parts; ++i) {
+			while (queues[i].pop(&batch)) {
+				for (auto& kv : batch) {
+					visitors[i]->Visit(kv.first, kv.second);
+				}
+			}
+		}
+	} else {
+		worker();
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+	return kSucc;
+}
+
+RetCode ShardedEngine::ApproximateSize(const PolarString& lower,
+		const PolarString& upper, uint64_t* size) {
+	*size = 0;
+	for (auto s : shards) {
+		*size += s->approximateSize(lower, upper);
+	}
+	return kSucc;
+}
+
+// Every segment is checked and linked in first, so a bad one changes
+// nothing, and the manifest then commits them: from there on, opening
+// the store redoes the ingest if it stops. Each shard indexes its
+// records in batches, between which writers go on, as versions that
+// read as missing; all shards then reveal them under one sequence, so
+// no reader or snapshot sees part of them. Keys written meanwhile keep
+// what was written.
+RetCode ShardedEngine::Ingest(const std::string& dir) {
+	if (read_only) {
+		return kNotSupported;
+	}
+	std::lock_guard<std::mutex> lck(ingest_mtx);
+	size_t n(shards.size());
+	RetCode ret(kSucc);
+	size_t opened(0);
+	for (; opened < n && ret == kSucc; ++opened) {
+		ret = shards[opened]->openSegment(SegmentBuilder::SegmentPath(dir, opened),
+				opened, n);
+	}
+	if (ret != kSucc) {
+		for (size_t i = 0; i + 1 < opened; ++i) {
+			shards[i]->dropSegment();
+		}
+		return ret;
+	}
+
+	Manifest m(manifest);
+	m.segments = shards[0]->segments();
+	m.ingest.resize(n);
+	for (auto s : shards) {
+		s->lockJournal();
+	}
+	uint64_t after(snapshots.next());
+	for (size_t i = 0; i < n; ++i) {
+		m.ingest[i] = shards[i]->logEnd();
+	}
+	for (auto s : shards) {
+		s->unlockJournal();
+	}
+	ret = saveManifest(name, m, true);
+	if (ret != kSucc) {
+		saveManifest(name, manifest);
+		for (auto s : shards) {
+			s->dropSegment();
+		}
+		return ret;
+	}
+	manifest = m;
+
+	auto each = [this, n](std::function<void(EngineRace*)> f) {
+		std::vector<std::thread> ths;
+		for (size_t i = 1; i < n; ++i) {
+			ths.push_back(std::thread(f, shards[i]));
+		}
+		f(shards[0]);
+		for (auto& t : ths) {
+			t.join();
+		}
+	};
+	each([after](EngineRace* s) { s->applySegment(after); });
+	for (auto s : shards) {
+		s->lockJournal();
+	}
+	uint64_t seq(snapshots.next());
+	for (auto s : shards) {
+		s->revealSegment(seq);
+	}
+	for (auto s : shards) {
+		s->unlockJournal();
+	}
+	each([](EngineRace* s) { s->settleSegment(); });
+
+	// Redoing it is harmless, so this need not reach the disk
+	manifest.ingest.clear();
+	saveManifest(name, manifest);
+	return kSucc;
+}
+
+// Holding every journal_mtx means no shard is inside a flush, so the
+// sequence taken covers whole flushes on all of them.
+RetCode ShardedEngine::GetSnapshot(const Snapshot** snapshot) {
+	// Refresh does not keep the versions it replaces
+	if (read_only) {
+		return kNotSupported;
+	}
+	for (auto s : shards) {
+		s->lockJournal();
+	}
+	uint64_t seq(snapshots.acquire());
+	for (auto s : shards) {
+		s->unlockJournal();
+	}
+	*snapshot = new Snapshot(seq);
+	return kSucc;
+}
+
+RetCode ShardedEngine::ReleaseSnapshot(const Snapshot* snapshot) {
+	if (snapshot == NULL) {
+		return kInvalidArgument;
+	}
+	snapshots.release(snapshot->sequence());
+	delete snapshot;
+	for (auto s : shards) {
+		s->pruneVersions();
+	}
+	return kSucc;
+}
+
+RetCode ShardedEngine::NewIterator(const IteratorOptions& options,
+		Iterator** it) {
+	*it = new ShardedIterator(shards, iteratorSnapshots(), options);
+	return kSucc;
+}
+
+RetCode ShardedEngine::Refresh() {
+	if (!read_only) {
+		return kNotSupported;
+	}
+	// Not otherwise taken by a read-only engine
+	std::lock_guard<std::mutex> lck(ingest_mtx);
+	std::vector<RetCode> rets(shards.size(), kSucc);
+	std::vector<std::thread> ths;
+	for (size_t i = 0; i < shards.size(); ++i) {
+		ths.push_back(std::thread([this, i, &rets] {
+			rets[i] = shards[i]->refresh();
+		}));
+	}
+	for (auto& t : ths) {
+		t.join();
+	}
+	for (auto r : rets) {
+		if (r != kSucc) {
+			return r;
+		}
+	}
+	return kSucc;
+}
+
+// The state of every shard is taken with all journals locked, which
+// holds writes up for no longer than copying the meta in memory; the
+// files are written once they are released. Sealed chunks of a log
+// never change, so <target>.checkpoint records how much of each file is
+// there, and the next checkpoint into dir copies from the last chunk on.
+// Files and directory entries are synced before the record names them.
+RetCode ShardedEngine::Checkpoint(const std::string& dir) {
+	if (read_only) {
+		return kNotSupported;
+	}
+	// Two into one dir would share the record and the files
+	std::lock_guard<std::mutex> checkpoint_lck(checkpoint_mtx);
+	if (mkdir(dir.c_str(), 0755) == 0) {
+		if (syncDir(dir) != kSucc) {
+			return kIOError;
+		}
+	} else if (errno != EEXIST) {
+		return kIOError;
+	}
+	size_t slash(name.rfind('/'));
+	std::string target(dir + "/" + name.substr(slash + 1));
+	char* d(realpath(dir.c_str(), NULL));
+	char* home(realpath(slash == std::string::npos ? "." : name.substr(0, slash + 1).c_str(), NULL));
+	bool same(d == NULL || home == NULL || strcmp(d, home) == 0);
+	free(d);
+	free(home);
+	if (same) {
+		return kInvalidArgument;
+	}
+	Manifest src, m;
+	RetCode ret(loadManifest(name, &src));
+	if (ret != kSucc) {
+		return ret;
+	}
+	m.shards = shards.size();
+	m.log_dirs.assign(src.log_dirs.size(), dir);
+
+	// Lengths copied by the last checkpoint of this store into dir. The
+	// record is dropped until this one is done, so one cut short is
+	// followed by a full copy.
+	std::map<std::string, uint64_t> copied;
+	std::string record(target + ".checkpoint");
+	std::ifstream in(record);
+	std::string line;
+	if (std::getline(in, line) && line == "source " + name) {
+		while (std::getline(in, line)) {
+			size_t sp(line.rfind(' '));
+			if (line.compare(0, 5, "file ") == 0 && sp > 5) {
+				copied[line.substr(5, sp - 5)] = std::strtoull(line.c_str() + sp + 1, NULL, 10);
+			}
+		}
+	}
+	in.close();
+	unlink(record.c_str());
+
+	std::vector<EngineRace::CheckpointState> states(shards.size());
+	{
+		// Keeps the segments of each shard as its meta names them
+		std::lock_guard<std::mutex> lck(ingest_mtx);
+		for (auto s : shards) {
+			s->lockJournal();
+		}
+		for (size_t i = 0; i < shards.size(); ++i) {
+			shards[i]->checkpointState(&states[i]);
+		}
+		for (auto s : shards) {
+			s->unlockJournal();
+		}
+	}
+
+	std::vector<RetCode> rets(shards.size(), kSucc);
+	std::vector<std::map<std::string, uint64_t> > lens(shards.size());
+	std::vector<std::thread> ths;
+	for (size_t i = 0; i < shards.size(); ++i) {
+		ths.push_back(std::thread([&, i] {
+			rets[i] = shards[i]->writeCheckpoint(states[i], shardPath(target, i, m.shards),
+					shardConfig(target, m, i), copied, &lens[i]);
+		}));
+	}
+	for (auto& t : ths) {
+		t.join();
+	}
+	for (auto r : rets) {
+		if (r != kSucc) {
+			return r;
+		}
+	}
+	ret = saveManifest(target, m, true);
+	if (ret != kSucc) {
+		return ret;
+	}
+
+	std::string tmp(record + ".tmp");
+	std::ofstream ou(tmp, std::ios::trunc);
+	ou << "source " << name << "\n";
+	for (size_t i = 0; i < shards.size(); ++i) {
+		for (auto& f : lens[i]) {
+			ou << "file " << f.first << " " << f.second << "\n";
+		}
+	}
+	ou.close();
+	if (!ou || syncFile(tmp) != kSucc || rename(tmp.c_str(), record.c_str()) != 0) {
+		return kIOError;
+	}
+	// Also holds the entries of the logs and segment links
+	return syncDir(record);
+}
+
+RetCode ShardedEngine::Tail(uint64_t sequence, ChangeStream** stream) {
+	*stream = NULL;
+	if (changes == 0) {
+		return kNotSupported;
+	}
+	std::vector<ChangeEntry> first;
+	uint64_t last(changes->last());
+	sequence = std::min(sequence, last);
+	if (sequence < last && changes->get(sequence, 1, 0, &first) == kNotFound) {
+		return kNotFound;
+	}
+	*stream = new ShardedChangeStream(shards, changes, sequence);
+	return kSucc;
+}
+
+RetCode ShardedEngine::GetStats(Stats* st) {
+	*st = Stats();
+	stats.snapshot(st);
+	for (auto s : shards) {
+		s->memoryUsage(st);
+	}
+	lockProfile(st);
+	if (stall_log) {
+		st->stalls = stall_log->count();
+	}
+	return kSucc;
+}
+
+RetCode ShardedEngine::GetStallEvents(std::vector<StallEvent>* events) {
+	if (stall_log == 0) {
+		return kNotSupported;
+	}
+	stall_log->get(events);
+	return kSucc;
+}
+
+RetCode ShardedEngine::DumpTrace(const std::string& path) {
+	if (tracer == 0) {
+		return kNotSupported;
+	}
+	return tracer->dump(path);
+}
+
+}  // namespace polar_race
@@ -0,0 +1,153 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_SHARDED_ENGINE_H_
+#define ENGINE_RACE_SHARDED_ENGINE_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "include/engine.h"
+#include "engine_race.h"
+#include "change_stream.h"
+#include "op_recorder.h"
+#include "sharded_iterator.h"
+#include "snapshot_list.h"
+
+namespace polar_race {
+
+unsigned long long hashShard(const char* s, size_t n);
+
+// Hash-partitions keys over independent EngineRace instances, so each
+// shard has its own journal, flusher, index and files. The shard count
+// is fixed when the store is created and kept in <name>.manifest, along
+// with the log and meta directories.
+class ShardedEngine : public Engine {
+public:
+	static const int max_shards = 256;
+
+	static RetCode Open(const std::string& name, const Options& options,
+			Engine** eptr);
+
+	~ShardedEngine();
+
+	RetCode Write(const PolarString& key,
+			const PolarString& value) override;
+
+	RetCode Read(const PolarString& key,
+			std::string* value) override;
+
+	RetCode Range(const PolarString& lower,
+			const PolarString& upper,
+			Visitor &visitor) override;
+
+	RetCode ReadAt(const Snapshot* snapshot,
+			const PolarString& key,
+			std::string* value) override;
+
+	RetCode RangeAt(const Snapshot* snapshot,
+			const PolarString& lower,
+			const PolarString& upper,
+			Visitor &visitor) override;
+
+	RetCode Ingest(const std::string& dir) override;
+
+	RetCode GetSnapshot(const Snapshot** snapshot) override;
+
+	RetCode ReleaseSnapshot(const Snapshot* snapshot) override;
+
+	RetCode RangeBatch(const PolarString& lower,
+			const PolarString& upper,
+			BatchVisitor &visitor,
+			size_t batch_size = 256) override;
+
+	RetCode ParallelRange(const PolarString& lower,
+			const PolarString& upper,
+			size_t n,
+			VisitorFactory& factory,
+			bool ordered = false) override;
+
+	RetCode ApproximateSize(const PolarString& lower,
+			const PolarString& upper,
+			uint64_t* size) override;
+
+	RetCode NewIterator(const IteratorOptions& options,
+			Iterator** it) override;
+
+	RetCode Refresh() override;
+
+	RetCode Checkpoint(const std::string& dir) override;
+
+	RetCode Tail(uint64_t sequence, ChangeStream** stream) override;
+
+	RetCode GetStats(Stats* stats) override;
+
+	RetCode DumpTrace(const std::string& path) override;
+
+	RetCode GetStallEvents(std::vector<StallEvent>* events) override;
+
+private:
+	// Layout fixed at creation, and the segments ingested since
+	struct Manifest {
+		size_t shards;
+		std::vector<std::string> log_dirs;
+		std::string meta_dir;
+		size_t segments;	// committed per shard, -1u if never counted
+		// The log end of each shard when the last ingest was committed,
+		// until it is applied in full
+		std::vector<size_t> ingest;
+
+		Manifest() : shards(0), segments(-1u) {}
+	};
+
+	explicit ShardedEngine(const std::string& name)
+		: name(name), tracer(0), recorder(0), stall_log(0), changes(0), read_only(false),
+		lock_fd(-1) {}
+
+	// Takes <name>.lock exclusively for a writer, so there is one at a
+	// time. A read-only open takes no lock and creates no file, so it
+	// works on a read-only mount and never keeps the writer out.
+	RetCode lockStore(bool read_only);
+
+	static std::string shardPath(const std::string& name, size_t i, size_t n);
+	static EngineRace::Config shardConfig(const std::string& name,
+			const Manifest& m, size_t i);
+	static RetCode loadManifest(const std::string& name, Manifest* m);
+	// Replaces the manifest whole; with sync it is on disk on return
+	static RetCode saveManifest(const std::string& name, const Manifest& m,
+			bool sync = false);
+
+	// For iterators to pin their own snapshot in; a read-only store
+	// keeps no old versions
+	inline SnapshotList* iteratorSnapshots() {
+		return read_only ? NULL : &snapshots;
+	}
+
+	inline EngineRace* shardOf(const PolarString& key) {
+		return shards[hashShard(key.data(), key.size()) % shards.size()];
+	}
+
+	// n + 1 bounds of up to n partitions of [lower, upper) with about
+	// equal bytes
+	void splitRange(const PolarString& lower, const PolarString& upper,
+			size_t n, std::vector<std::string>* bounds);
+
+	std::string name;
+	std::vector<EngineRace*> shards;
+	StatsRecorder stats;
+	Tracer* tracer;
+	OpRecorder* recorder;
+	StallLog* stall_log;
+	SnapshotList snapshots;
+	ChangeLog* changes;
+	std::mutex ingest_mtx;	// also guards manifest, and Refresh
+	std::mutex checkpoint_mtx;
+	Manifest manifest;
+
+	bool read_only;
+	int lock_fd;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_SHARDED_ENGINE_H_
@@ -0,0 +1,176 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "sharded_iterator.h"
+
+namespace polar_race {
+
+// Keys inserted later are born after seq, so sorting them in once here
+// is enough for every batch the cursors copy
+ShardedIterator::ShardedIterator(const std::vector<EngineRace*>& shards,
+		SnapshotList* snapshots, const IteratorOptions& options)
+	: shards(shards), snapshots(snapshots), options(options),
+	lower(this->options.lower), upper(this->options.upper), seq(EngineRace::latest),
+	pinned(false), cursors(shards.size()), forward(true), value_read(false) {
+	size_t n(shards.size());
+	readahead = options.keys_only ? 0 : (options.readahead + n - 1) / n;
+	if (options.snapshot) {
+		seq = options.snapshot->sequence();
+	} else if (snapshots) {
+		for (auto s : shards) {
+			s->lockJournal();
+		}
+		seq = snapshots->acquire();
+		for (auto s : shards) {
+			s->unlockJournal();
+		}
+		pinned = true;
+	}
+	std::vector<std::thread> sorters;
+	for (size_t i = 1; i < n; ++i) {
+		sorters.push_back(std::thread(&EngineRace::sortKeys, shards[i]));
+	}
+	shards[0]->sortKeys();
+	for (auto& t : sorters) {
+		t.join();
+	}
+}
+
+ShardedIterator::~ShardedIterator() {
+	if (pinned) {
+		snapshots->release(seq);
+		for (auto s : shards) {
+			s->pruneVersions();
+		}
+	}
+}
+
+void ShardedIterator::SeekToFirst() {
+	seek(NULL, true, true);
+}
+
+void ShardedIterator::SeekToLast() {
+	seek(NULL, true, false);
+}
+
+void ShardedIterator::Seek(const PolarString& target) {
+	std::string from(target.ToString());
+	seek(&from, true, true);
+}
+
+void ShardedIterator::SeekForPrev(const PolarString& target) {
+	std::string from(target.ToString());
+	seek(&from, true, false);
+}
+
+// A key lives in one shard only, so turning around is seeking every
+// cursor past the current key the other way
+void ShardedIterator::Next() {
+	if (forward) {
+		step();
+	} else {
+		std::string from(current().key);
+		seek(&from, false, true);
+	}
+}
+
+// Stepping back from the first key leaves the iterator invalid
+void ShardedIterator::Prev() {
+	if (!forward) {
+		step();
+	} else {
+		std::string from(current().key);
+		seek(&from, false, false);
+	}
+}
+
+PolarString ShardedIterator::value() {
+	if (options.keys_only) {
+		return PolarString();
+	}
+	if (!value_read) {
+		const Entry& e(current());
+		shards[heap.front()]->readItem(e.item, e.inlined, &value_buf);
+		value_read = true;
+	}
+	return PolarString(value_buf);
+}
+
+void ShardedIterator::seek(const std::string* from, bool inclusive, bool forward) {
+	this->forward = forward;
+	value_read = false;
+	heap.clear();
+	for (size_t s = 0; s < cursors.size(); ++s) {
+		fill(s, from, inclusive);
+		if (cursors[s].pos < cursors[s].entries.size()) {
+			heap.push_back(s);
+		}
+	}
+	std::make_heap(heap.begin(), heap.end(),
+			[this](size_t a, size_t b) { return later(a, b); });
+}
+
+// Keys born after seq are skipped, a batch at a time until one is left
+// or the shard has no more
+void ShardedIterator::fill(size_t s, const std::string* from, bool inclusive) {
+	Cursor& c(cursors[s]);
+	c.entries.clear();
+	c.pos = c.ahead = 0;
+	c.last_chunk = -1u;
+	std::string resume;
+	do {
+		c.more = shards[s]->orderedKeys(from, inclusive, forward, lower, upper, batch,
+				&keys_buf);
+		Entry e;
+		for (auto& k : keys_buf) {
+			if (shards[s]->resolve(k.second, seq, &e.item, &e.inlined)) {
+				c.entries.push_back(e);
+				c.entries.back().key.swap(k.first);
+			}
+		}
+		if (c.entries.empty() && c.more) {
+			resume.swap(keys_buf.back().first);
+			from = &resume;
+			inclusive = false;
+		}
+	} while (c.entries.empty() && c.more);
+	readAhead(&c, s);
+}
+
+void ShardedIterator::step() {
+	value_read = false;
+	auto cmp = [this](size_t a, size_t b) { return later(a, b); };
+	std::pop_heap(heap.begin(), heap.end(), cmp);
+	size_t s(heap.back());
+	Cursor& c(cursors[s]);
+	if (++c.pos == c.entries.size() && c.more) {
+		std::string from;
+		from.swap(c.entries.back().key);
+		fill(s, &from, false);
+	} else {
+		readAhead(&c, s);
+	}
+	if (c.pos < c.entries.size()) {
+		std::push_heap(heap.begin(), heap.end(), cmp);
+	} else {
+		heap.pop_back();
+	}
+}
+
+bool ShardedIterator::later(size_t a, size_t b) const {
+	const Cursor& x(cursors[a]);
+	const Cursor& y(cursors[b]);
+	int c(x.entries[x.pos].key.compare(y.entries[y.pos].key));
+	return forward ? c > 0 : c < 0;
+}
+
+void ShardedIterator::readAhead(Cursor* c, size_t s) {
+	size_t end(std::min(c->entries.size(), c->pos + 1 + readahead));
+	c->ahead = std::max(c->ahead, c->pos + 1);
+	for (; c->ahead < end; ++c->ahead) {
+		const Item& item(c->entries[c->ahead].item);
+		if (item.szVal > EngineRace::max_inline) {
+			shards[s]->prefetch(item, &c->last_chunk);
+		}
+	}
+}
+
+}  // namespace polar_race
@@ -0,0 +1,98 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_SHARDED_ITERATOR_H_
+#define ENGINE_RACE_SHARDED_ITERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "include/engine.h"
+#include "engine_race.h"
+#include "snapshot_list.h"
+
+namespace polar_race {
+
+// Keeps a cursor into the ordered keys of every shard and merges them
+// lazily through a heap on the current key of each, so the iterator
+// costs its walk rather than the size of its bounds. A cursor copies a
+// batch of keys at a time, holding the shard's journal_mtx for the copy
+// alone, and resolves their versions without it. Without a snapshot the
+// iterator pins one of its own in snapshots, if given, so its batches
+// all read one moment. Values are read on demand.
+class ShardedIterator : public Iterator {
+public:
+	ShardedIterator(const std::vector<EngineRace*>& shards, SnapshotList* snapshots,
+			const IteratorOptions& options);
+	~ShardedIterator();
+
+	bool Valid() const override {
+		return !heap.empty();
+	}
+
+	void SeekToFirst() override;
+	void SeekToLast() override;
+	void Seek(const PolarString& target) override;
+	void SeekForPrev(const PolarString& target) override;
+	void Next() override;
+	void Prev() override;
+
+	PolarString key() const override {
+		return PolarString(current().key);
+	}
+
+	PolarString value() override;
+
+private:
+	// Keys copied per step of a cursor
+	static const size_t batch = 128;
+
+	struct Entry {
+		std::string key;
+		Item item;
+		uint64_t inlined;	// the value, if short enough
+	};
+
+	// The keys of one shard from its position on, in the direction of
+	// travel
+	struct Cursor {
+		std::vector<Entry> entries;
+		size_t pos;
+		size_t ahead;	// entries before it have been read ahead
+		bool more;	// the shard holds keys past entries
+		size_t last_chunk;	// for EngineRace::prefetch
+	};
+
+	inline const Entry& current() const {
+		const Cursor& c(cursors[heap.front()]);
+		return c.entries[c.pos];
+	}
+
+	// Points every cursor at from, or at the bound if null, and heaps them
+	void seek(const std::string* from, bool inclusive, bool forward);
+	// Refills cursor s with the keys after from
+	void fill(size_t s, const std::string* from, bool inclusive);
+	// Moves the current cursor one key on
+	void step();
+	// Orders the heap with the next key in the direction of travel on top
+	bool later(size_t a, size_t b) const;
+	void readAhead(Cursor* c, size_t s);
+
+	std::vector<EngineRace*> shards;
+	SnapshotList* snapshots;
+	IteratorOptions options;
+	PolarString lower, upper;
+	uint64_t seq;
+	bool pinned;
+
+	std::vector<Cursor> cursors;
+	std::vector<size_t> heap;	// of the cursors positioned on a key
+	bool forward;
+	size_t readahead;	// per shard
+
+	std::vector<std::pair<std::string, size_t> > keys_buf;
+	std::string value_buf;
+	bool value_read;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_SHARDED_ITERATOR_H_
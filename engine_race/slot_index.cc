@@ -0,0 +1,82 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "slot_index.h"
+
+namespace polar_race {
+
+// The stripe took hash % n_stripes, so cells are picked by the bits above
+bool SlotIndex::Stripe::find(uint64_t key, uint32_t* slot) const {
+	if (keys.empty()) {
+		return false;
+	}
+	size_t mask(keys.size() - 1);
+	for (size_t i = (hash(key) / n_stripes) & mask; slots[i]; i = (i + 1) & mask) {
+		if (keys[i] == key) {
+			*slot = slots[i] - 1;
+			return true;
+		}
+	}
+	return false;
+}
+
+void SlotIndex::Stripe::insert(uint64_t key, uint32_t slot) {
+	// Kept at most 3/4 full
+	if ((n + 1) * 4 > keys.size() * 3) {
+		grow();
+	}
+	size_t mask(keys.size() - 1);
+	size_t i((hash(key) / n_stripes) & mask);
+	for (; slots[i]; i = (i + 1) & mask) {
+		if (keys[i] == key) {
+			slots[i] = slot + 1;
+			return;
+		}
+	}
+	keys[i] = key;
+	slots[i] = slot + 1;
+	++n;
+}
+
+void SlotIndex::Stripe::grow() {
+	std::vector<uint64_t> old_keys(keys.size() ? keys.size() * 2 : 16);
+	std::vector<uint32_t> old_slots(old_keys.size(), 0);
+	old_keys.swap(keys);
+	old_slots.swap(slots);
+	n = 0;
+	for (size_t i = 0; i < old_keys.size(); ++i) {
+		if (old_slots[i]) {
+			insert(old_keys[i], old_slots[i] - 1);
+		}
+	}
+}
+
+size_t SlotIndex::size() {
+	size_t n(0);
+	for (auto& s : stripes) {
+		std::lock_guard<std::mutex> lck(s.mtx);
+		n += s.n;
+	}
+	return n;
+}
+
+size_t SlotIndex::bytes() {
+	size_t n(0);
+	for (auto& s : stripes) {
+		std::lock_guard<std::mutex> lck(s.mtx);
+		n += s.keys.capacity() * sizeof(uint64_t) + s.slots.capacity() * sizeof(uint32_t);
+	}
+	return n;
+}
+
+void SlotIndex::keys(std::vector<uint64_t>* out) {
+	out->clear();
+	for (auto& s : stripes) {
+		std::lock_guard<std::mutex> lck(s.mtx);
+		for (size_t i = 0; i < s.keys.size(); ++i) {
+			if (s.slots[i]) {
+				out->push_back(s.keys[i]);
+			}
+		}
+	}
+}
+
+}  // namespace polar_race
@@ -0,0 +1,60 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_SLOT_INDEX_H_
+#define ENGINE_RACE_SLOT_INDEX_H_
+
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+namespace polar_race {
+
+// Hash table from a key packed into 64 bits to a 32-bit slot, with open
+// addressing and linear probing, 12 bytes a cell. It is split into
+// stripes by hash, each with its own mutex; callers lock the stripe.
+class SlotIndex {
+public:
+	static const size_t n_stripes = 64;
+
+	struct Stripe {
+		std::mutex mtx;
+		std::vector<uint64_t> keys;
+		std::vector<uint32_t> slots;	// slot + 1, 0 for an empty cell
+		size_t n;
+
+		Stripe() : n(0) {}
+
+		bool find(uint64_t key, uint32_t* slot) const;
+
+		// Sets the slot of key, adding it if absent
+		void insert(uint64_t key, uint32_t slot);
+
+	private:
+		void grow();
+	};
+
+	static inline uint64_t hash(uint64_t k) {
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdull;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ull;
+		k ^= k >> 33;
+		return k;
+	}
+
+	inline Stripe& stripeOf(uint64_t key) {
+		return stripes[hash(key) % n_stripes];
+	}
+
+	// Totals over the stripes, each locked in turn
+	size_t size();
+	size_t bytes();
+	void keys(std::vector<uint64_t>* out);
+
+private:
+	Stripe stripes[n_stripes];
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_SLOT_INDEX_H_
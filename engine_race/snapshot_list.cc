@@ -0,0 +1,47 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "snapshot_list.h"
+
+namespace polar_race {
+
+uint64_t SnapshotList::acquire() {
+	std::lock_guard<std::mutex> lck(mtx);
+	uint64_t s(seq.load());
+	snapshots.insert(s);
+	setBounds();
+	return s;
+}
+
+void SnapshotList::release(uint64_t s) {
+	std::lock_guard<std::mutex> lck(mtx);
+	auto it(snapshots.find(s));
+	if (it != snapshots.end()) {
+		snapshots.erase(it);
+		setBounds();
+	}
+}
+
+bool SnapshotList::pinned(uint64_t born, uint64_t replaced) {
+	if (n_live.load(std::memory_order_acquire) == 0) {
+		return false;
+	}
+	uint64_t lo(oldest.load(std::memory_order_acquire));
+	uint64_t hi(newest.load(std::memory_order_acquire));
+	if (hi < born || lo >= replaced) {
+		return false;
+	}
+	if (lo >= born || hi < replaced) {
+		return true;
+	}
+	std::lock_guard<std::mutex> lck(mtx);
+	auto it(snapshots.lower_bound(born));
+	return it != snapshots.end() && *it < replaced;
+}
+
+void SnapshotList::setBounds() {
+	bool empty(snapshots.empty());
+	oldest.store(empty ? -1ull : *snapshots.begin(), std::memory_order_release);
+	newest.store(empty ? 0 : *snapshots.rbegin(), std::memory_order_release);
+	n_live.store(snapshots.size(), std::memory_order_release);
+}
+
+}  // namespace polar_race
@@ -0,0 +1,59 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_SNAPSHOT_LIST_H_
+#define ENGINE_RACE_SNAPSHOT_LIST_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+
+namespace polar_race {
+
+// The sequence numbers shared by the shards of an engine and the
+// snapshots pinning them. Every flush takes the next sequence; a
+// snapshot at s sees what the flushes up to s wrote.
+//
+// acquire and release keep the count and the oldest and newest pinned
+// sequence in atomics as well, so a flush asks live and pinned without
+// the mutex. Its versions are replaced after every live snapshot, which
+// the newest settles on its own; only a range lying inside the pinned
+// ones takes the mutex to look at the rest. Reading the atomics while a
+// release changes them may keep a version for a snapshot just gone,
+// never drop one still pinned.
+class SnapshotList {
+public:
+	SnapshotList() : seq(0), n_live(0), oldest(-1ull), newest(0) {}
+
+	inline uint64_t next() {
+		return ++seq;
+	}
+
+	// Pins the last sequence given out. The caller holds every shard's
+	// journal_mtx, so no flush is halfway.
+	uint64_t acquire();
+
+	void release(uint64_t s);
+
+	// Whether a live snapshot lies in [born, replaced), which is when a
+	// version born at born and replaced at replaced is visible to it
+	bool pinned(uint64_t born, uint64_t replaced);
+
+	inline size_t live() const {
+		return n_live.load(std::memory_order_acquire);
+	}
+
+private:
+	// Stores the bounds of snapshots, under mtx
+	void setBounds();
+
+	std::atomic<uint64_t> seq;
+	std::mutex mtx;
+	std::multiset<uint64_t> snapshots;
+	std::atomic<size_t> n_live;
+	std::atomic<uint64_t> oldest, newest;	// -1 and 0 with none live
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_SNAPSHOT_LIST_H_
@@ -0,0 +1,33 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include <time.h>
+
+#include "stall_log.h"
+
+namespace polar_race {
+
+void StallLog::add(const StallEvent& e) {
+	std::lock_guard<std::mutex> lck(mtx);
+	events[total++ % events.size()] = e;
+}
+
+void StallLog::get(std::vector<StallEvent>* out) {
+	std::lock_guard<std::mutex> lck(mtx);
+	out->clear();
+	size_t n(total < events.size() ? total : events.size());
+	for (size_t i = total - n; i < total; ++i) {
+		out->push_back(events[i % events.size()]);
+	}
+}
+
+uint64_t StallLog::count() {
+	std::lock_guard<std::mutex> lck(mtx);
+	return total;
+}
+
+uint64_t realtimeNs() {
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+}  // namespace polar_race
@@ -0,0 +1,44 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_STALL_LOG_H_
+#define ENGINE_RACE_STALL_LOG_H_
+
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+#include "include/engine.h"
+
+namespace polar_race {
+
+// Ring of the latest stall events. Adding takes a mutex, which is fine
+// as only waits past the threshold get here.
+class StallLog {
+public:
+	StallLog(uint64_t threshold_ns, size_t capacity)
+		: threshold_ns(threshold_ns), events(capacity ? capacity : 1), total(0) {}
+
+	inline bool isStall(uint64_t ns) const {
+		return ns >= threshold_ns;
+	}
+
+	void add(const StallEvent& e);
+
+	// Oldest first
+	void get(std::vector<StallEvent>* out);
+
+	uint64_t count();
+
+private:
+	uint64_t threshold_ns;
+	std::mutex mtx;
+	std::vector<StallEvent> events;
+	uint64_t total;
+};
+
+// Wall-clock now, for StallEvent::time_ns
+uint64_t realtimeNs();
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_STALL_LOG_H_
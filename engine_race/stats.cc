@@ -0,0 +1,63 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "stats.h"
+
+namespace polar_race {
+
+StatsRecorder::StatsRecorder() {
+	slots = new Slot[n_slots];
+	for (size_t i = 0; i < n_slots; ++i) {
+		Slot& s(slots[i]);
+		for (int op = 0; op < kNumOps; ++op) {
+			for (int b = 0; b < Histogram::kBuckets; ++b) {
+				s.buckets[op][b].store(0, std::memory_order_relaxed);
+			}
+			s.sum[op].store(0, std::memory_order_relaxed);
+			s.max[op].store(0, std::memory_order_relaxed);
+		}
+		for (int c = 0; c < kNumCounters; ++c) {
+			s.counters[c].store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+StatsRecorder::~StatsRecorder() {
+	delete [] slots;
+}
+
+size_t StatsRecorder::slotId() {
+	static std::atomic<size_t> n_threads(0);
+	static thread_local size_t id(n_threads.fetch_add(1) % n_slots);
+	return id;
+}
+
+void StatsRecorder::snapshot(Stats* stats) const {
+	Histogram* hists[kNumOps] = { &stats->read, &stats->write, &stats->range,
+		&stats->flush, &stats->chunk_load };
+	uint64_t* counters[kNumCounters] = { &stats->read_misses,
+		&stats->bytes_written, &stats->bytes_read, &stats->flushed_records,
+		&stats->hot_cache_hits };
+	for (int op = 0; op < kNumOps; ++op) {
+		hists[op]->Clear();
+	}
+	for (int c = 0; c < kNumCounters; ++c) {
+		*counters[c] = 0;
+	}
+	for (size_t i = 0; i < n_slots; ++i) {
+		const Slot& s(slots[i]);
+		for (int op = 0; op < kNumOps; ++op) {
+			for (int b = 0; b < Histogram::kBuckets; ++b) {
+				uint64_t n(s.buckets[op][b].load(std::memory_order_relaxed));
+				if (n) {
+					hists[op]->AddBucket(b, n);
+				}
+			}
+			hists[op]->AddSum(s.sum[op].load(std::memory_order_relaxed),
+					s.max[op].load(std::memory_order_relaxed));
+		}
+		for (int c = 0; c < kNumCounters; ++c) {
+			*counters[c] += s.counters[c].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+}  // namespace polar_race
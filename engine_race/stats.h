@@ -0,0 +1,84 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_STATS_H_
+#define ENGINE_RACE_STATS_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+
+#include "include/engine.h"
+
+namespace polar_race {
+
+inline uint64_t nowNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Latency histograms and counters sharded per thread. A thread always
+// records into the same slot, so recording is a relaxed add on a line
+// no other thread writes unless there are more threads than slots.
+class StatsRecorder {
+public:
+	enum Op { kRead, kWrite, kRange, kFlush, kChunkLoad, kNumOps };
+	enum Counter { kReadMisses, kBytesWritten, kBytesRead, kFlushedRecords,
+		kHotCacheHits, kNumCounters };
+
+	static const size_t n_slots = 32;
+
+	StatsRecorder();
+	~StatsRecorder();
+
+	inline void record(Op op, uint64_t ns) {
+		Slot& s(slots[slotId()]);
+		s.buckets[op][Histogram::BucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+		s.sum[op].fetch_add(ns, std::memory_order_relaxed);
+		if (ns > s.max[op].load(std::memory_order_relaxed)) {
+			s.max[op].store(ns, std::memory_order_relaxed);
+		}
+	}
+
+	inline void add(Counter c, uint64_t n) {
+		slots[slotId()].counters[c].fetch_add(n, std::memory_order_relaxed);
+	}
+
+	// Sums all slots into the histograms and counters of stats
+	void snapshot(Stats* stats) const;
+
+	// Slot of the calling thread
+	static size_t slotId();
+
+private:
+	struct Slot {
+		char pad[64];	// keeps the tail of the previous slot off our lines
+		std::atomic<uint64_t> buckets[kNumOps][Histogram::kBuckets];
+		std::atomic<uint64_t> sum[kNumOps];
+		std::atomic<uint64_t> max[kNumOps];
+		std::atomic<uint64_t> counters[kNumCounters];
+	};
+
+	Slot* slots;
+};
+
+// Times a scope into recorder, if there is one
+class ScopedLatency {
+public:
+	ScopedLatency(StatsRecorder* recorder, StatsRecorder::Op op)
+		: recorder(recorder), op(op), start(recorder ? nowNs() : 0) {}
+	~ScopedLatency() {
+		if (recorder) {
+			recorder->record(op, nowNs() - start);
+		}
+	}
+
+private:
+	StatsRecorder* recorder;
+	StatsRecorder::Op op;
+	uint64_t start;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_STATS_H_
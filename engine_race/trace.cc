@@ -0,0 +1,143 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "trace.h"
+
+namespace polar_race {
+
+namespace {
+
+const char* phase_names[kNumTracePhases] = {
+	"write", "read", "range", "journal_lock", "ret_wait", "flush",
+	"flush_index", "file_grow", "flush_copy", "meta_write", "chunk_load",
+};
+
+}  // namespace
+
+// Kept alive by the tracer and by the thread recording into it
+struct Tracer::Ring {
+	struct Event {
+		uint64_t start, end;
+		int phase;
+	};
+
+	std::mutex mtx;
+	Event events[Tracer::ring_size];
+	size_t head;
+	long tid;
+	std::atomic<bool> owned;
+};
+
+namespace {
+
+std::atomic<uint64_t> next_tracer_id(0);
+
+// The rings of this thread, one per tracer it recorded into. They are
+// given back to their tracers when the thread exits.
+struct ThreadRings {
+	std::vector<std::pair<uint64_t, std::shared_ptr<Tracer::Ring> > > rings;
+
+	~ThreadRings() {
+		for (auto& r : rings) {
+			r.second->owned = false;
+		}
+	}
+};
+
+thread_local ThreadRings my_rings;
+
+}  // namespace
+
+thread_local bool TraceScope::sampled(false);
+thread_local int TraceScope::depth(0);
+
+Tracer::Tracer(unsigned sample_every)
+	: sample_every(sample_every), id(next_tracer_id++) {}
+
+bool Tracer::sample() {
+	static thread_local unsigned n(0);
+	if (++n >= sample_every) {
+		n = 0;
+		return true;
+	}
+	return false;
+}
+
+Tracer::Ring* Tracer::ring() {
+	auto& mine(my_rings.rings);
+	for (auto& r : mine) {
+		if (r.first == id) {
+			return r.second.get();
+		}
+	}
+	// Rings of tracers that are gone are only held here
+	mine.erase(std::remove_if(mine.begin(), mine.end(),
+				[](const std::pair<uint64_t, std::shared_ptr<Ring> >& r) {
+					return r.second.use_count() == 1;
+				}), mine.end());
+
+	std::shared_ptr<Ring> r;
+	std::lock_guard<std::mutex> lck(rings_mtx);
+	for (auto& free : rings) {
+		bool owned(false);
+		if (free->owned.compare_exchange_strong(owned, true)) {
+			r = free;
+			break;
+		}
+	}
+	if (!r) {
+		r = std::make_shared<Ring>();
+		r->owned = true;
+		rings.push_back(r);
+	}
+	std::lock_guard<std::mutex> ring_lck(r->mtx);
+	r->head = 0;
+	r->tid = syscall(SYS_gettid);
+	mine.push_back(std::make_pair(id, r));
+	return r.get();
+}
+
+void Tracer::record(TracePhase phase, uint64_t start, uint64_t end) {
+	Ring* r(ring());
+	std::lock_guard<std::mutex> lck(r->mtx);
+	Ring::Event& e(r->events[r->head++ % ring_size]);
+	e.start = start;
+	e.end = end;
+	e.phase = phase;
+}
+
+RetCode Tracer::dump(const std::string& path) {
+	FILE* f = fopen(path.c_str(), "w");
+	if (f == NULL) {
+		return kIOError;
+	}
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	bool first(true);
+	std::vector<Ring::Event> events;
+	std::lock_guard<std::mutex> lck(rings_mtx);
+	for (auto& r : rings) {
+		r->mtx.lock();
+		size_t n(std::min(r->head, ring_size));
+		events.clear();
+		for (size_t i = r->head - n; i < r->head; ++i) {
+			events.push_back(r->events[i % ring_size]);
+		}
+		r->mtx.unlock();
+		for (auto& e : events) {
+			fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"polarkv\",\"ph\":\"X\","
+					"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld}",
+					first ? "" : ",", phase_names[e.phase], e.start / 1000.0,
+					(e.end - e.start) / 1000.0, getpid(), r->tid);
+			first = false;
+		}
+	}
+	fprintf(f, "\n]}\n");
+	return fclose(f) == 0 ? kSucc : kIOError;
+}
+
+}  // namespace polar_race
@@ -0,0 +1,108 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_TRACE_H_
+#define ENGINE_RACE_TRACE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <vector>
+
+#include "include/engine.h"
+#include "stats.h"
+
+namespace polar_race {
+
+enum TracePhase {
+	kTraceWrite,
+	kTraceRead,
+	kTraceRange,
+	kTraceJournalLock,	// waiting for journal_mtx
+	kTraceRetWait,		// waiting for the flush covering a write
+	kTraceFlush,
+	kTraceFlushIndex,	// lookup map and meta vector updates
+	kTraceFileGrow,		// ftruncate and remap of a log file
+	kTraceFlushCopy,	// memcpy of chunks into the mapping
+	kTraceMetaWrite,	// rewrite of touched meta blocks
+	kTraceChunkLoad,
+	kNumTracePhases
+};
+
+// Samples one in sample_every operations per thread and records their
+// phases into per-thread rings of the latest ring_size events. Phases
+// nested in an unsampled operation cost a thread-local check.
+//
+// The rings belong to the tracer and go with it. A thread that exits
+// gives its ring back, and the next thread to record takes it over,
+// dropping the events left in it, so short-lived threads do not pile up
+// rings.
+class Tracer {
+public:
+	static const size_t ring_size = 1 << 14;
+
+	explicit Tracer(unsigned sample_every);
+
+	// Starts an operation on this thread, returning whether it is sampled
+	bool sample();
+
+	void record(TracePhase phase, uint64_t start, uint64_t end);
+
+	// Writes the events of all threads as Chrome trace-event JSON
+	RetCode dump(const std::string& path);
+
+	// A thread's latest events
+	struct Ring;
+
+private:
+	Ring* ring();
+
+	unsigned sample_every;
+	uint64_t id;	// tells the tracers apart in the threads' ring lists
+	std::mutex rings_mtx;
+	std::vector<std::shared_ptr<Ring> > rings;
+};
+
+// Records the enclosing scope as phase if the current operation is
+// sampled. The outermost scope on a thread is the operation and makes
+// the sampling call; nested scopes follow its decision.
+class TraceScope {
+public:
+	TraceScope(Tracer* tracer, TracePhase phase)
+		: tracer(tracer), phase(phase), active(false), start(0) {
+		if (tracer == 0) {
+			return;
+		}
+		if (depth++ == 0) {
+			sampled = tracer->sample();
+		}
+		if (sampled) {
+			active = true;
+			start = nowNs();
+		}
+	}
+
+	~TraceScope() {
+		if (tracer == 0) {
+			return;
+		}
+		--depth;
+		if (active) {
+			tracer->record(phase, start, nowNs());
+		}
+	}
+
+private:
+	static thread_local bool sampled;
+	static thread_local int depth;
+
+	Tracer* tracer;
+	TracePhase phase;
+	bool active;
+	uint64_t start;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_TRACE_H_
@@ -0,0 +1,235 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include "version_table.h"
+
+#include <string.h>
+
+namespace polar_race {
+
+VersionTable::VersionTable() : dir_size(16), n(0), revealed(0), n_versions(0), walkers(0) {
+	dirs.push_back(new Page*[dir_size]());
+	dir.store(dirs.back(), std::memory_order_relaxed);
+}
+
+VersionTable::~VersionTable() {
+	for (size_t idx : chained) {
+		Version* v(slot(idx).older.load(std::memory_order_relaxed));
+		while (v) {
+			Version* older(v->older.load(std::memory_order_relaxed));
+			delete v;
+			v = older;
+		}
+	}
+	for (Version* v : retired) {
+		delete v;
+	}
+	Page** d(dirs.back());
+	for (size_t i = 0; i < dir_size && d[i]; ++i) {
+		delete [] d[i]->values.load(std::memory_order_relaxed);
+		delete d[i];
+	}
+	for (Page** d : dirs) {
+		delete [] d;
+	}
+}
+
+Item VersionTable::latest(size_t idx, uint64_t* born, uint64_t* value) const {
+	const Page& pg(page(idx));
+	const Slot& s(pg.slots[idx & (page_size - 1)]);
+	for (;;) {
+		uint64_t st(s.stamp.load(std::memory_order_acquire));
+		if (st >> write_shift & 1) {
+			continue;
+		}
+		Item item;
+		item.p = s.p.load(std::memory_order_relaxed);
+		uint64_t sizes(s.sizes.load(std::memory_order_relaxed));
+		if (value && (uint32_t)sizes <= max_inline) {
+			// Null only in a read torn by the first small value of the
+			// page, which the stamp check below throws away
+			std::atomic<uint64_t>* values(pg.values.load(std::memory_order_acquire));
+			*value = values ? values[idx & (page_size - 1)].load(std::memory_order_relaxed) : 0;
+		}
+		// Loaded before the check, so settled() clearing it after the
+		// slot was stamped anew fails the check
+		uint64_t b(st & born_mask);
+		if (b == pending && born) {
+			uint64_t r(revealed.load(std::memory_order_acquire));
+			b = r ? r : pending;
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (s.stamp.load(std::memory_order_relaxed) != st) {
+			continue;
+		}
+		item.szKey = sizes >> 32;
+		item.szVal = sizes;
+		if (born) {
+			*born = b;
+		}
+		return item;
+	}
+}
+
+// A snapshot at seq pins the version it reads, and that version was
+// linked before any newer one was set, so it is on the chain by the time
+// the newest version is seen to be too new. Newer nodes on the way may be
+// unlinked meanwhile; walkers keeps them from being freed.
+bool VersionTable::resolve(size_t idx, uint64_t seq, Item* item, uint64_t* value) {
+	uint64_t born;
+	*item = latest(idx, &born, value);
+	if (born <= seq && born != pending) {
+		return true;
+	}
+	Slot& s(slot(idx));
+	if (s.older.load(std::memory_order_acquire) == NULL) {
+		return false;
+	}
+	walkers.fetch_add(1, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	bool found(false);
+	for (Version* v = s.older.load(std::memory_order_acquire); v;
+			v = v->older.load(std::memory_order_acquire)) {
+		if (v->born <= seq) {
+			*item = v->item;
+			if (value) {
+				*value = v->value;
+			}
+			found = true;
+			break;
+		}
+	}
+	walkers.fetch_sub(1, std::memory_order_release);
+	return found;
+}
+
+void VersionTable::push(const Item& item, uint64_t born, const char* value) {
+	size_t idx(n.load(std::memory_order_relaxed));
+	size_t page(idx >> page_shift);
+	Page** d(dirs.back());
+	if (page == dir_size) {
+		Page** grown(new Page*[dir_size * 2]());
+		memcpy(grown, d, dir_size * sizeof(Page*));
+		dirs.push_back(grown);
+		dir.store(grown, std::memory_order_release);
+		dir_size *= 2;
+		d = grown;
+	}
+	if (d[page] == NULL) {
+		// Value-initialized, so every slot starts with no older versions
+		d[page] = new Page();
+	}
+	Slot& s(d[page]->slots[idx & (page_size - 1)]);
+	setValue(d[page], idx, item, value);
+	s.p.store(item.p, std::memory_order_relaxed);
+	s.sizes.store((uint64_t)item.szKey << 32 | item.szVal, std::memory_order_relaxed);
+	s.stamp.store(born, std::memory_order_relaxed);
+	n.store(idx + 1, std::memory_order_release);
+}
+
+void VersionTable::set(size_t idx, const Item& item, uint64_t born, bool keep,
+		const char* value) {
+	Page& pg(page(idx));
+	Slot& s(pg.slots[idx & (page_size - 1)]);
+	uint64_t st(s.stamp.load(std::memory_order_relaxed));
+	if (keep) {
+		Version* v(new Version());
+		v->item = latest(idx, &v->born, &v->value);
+		v->replaced = born;
+		Version* older(s.older.load(std::memory_order_relaxed));
+		v->older.store(older, std::memory_order_relaxed);
+		s.older.store(v, std::memory_order_release);
+		if (older == NULL) {
+			chained.insert(idx);
+		}
+		++n_versions;
+	}
+	uint64_t writes((st >> write_shift) + 1);
+	s.stamp.store(writes << write_shift | (st & born_mask), std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	setValue(&pg, idx, item, value);
+	s.p.store(item.p, std::memory_order_relaxed);
+	s.sizes.store((uint64_t)item.szKey << 32 | item.szVal, std::memory_order_relaxed);
+	s.stamp.store((writes + 1) << write_shift | born, std::memory_order_release);
+}
+
+void VersionTable::setValue(Page* p, size_t idx, const Item& item, const char* value) {
+	if (item.szVal > max_inline) {
+		return;
+	}
+	std::atomic<uint64_t>* values(p->values.load(std::memory_order_relaxed));
+	if (values == NULL) {
+		values = new std::atomic<uint64_t>[page_size]();
+		p->values.store(values, std::memory_order_release);
+	}
+	uint64_t word(0);
+	memcpy(&word, value, item.szVal);
+	values[idx & (page_size - 1)].store(word, std::memory_order_relaxed);
+}
+
+void VersionTable::prune(SnapshotList* snapshots) {
+	for (auto it = chained.begin(); it != chained.end(); ) {
+		Slot& s(slot(*it));
+		std::atomic<Version*>* link(&s.older);
+		for (Version* v = link->load(std::memory_order_relaxed); v;
+				v = link->load(std::memory_order_relaxed)) {
+			// Every reader needs what a hidden version replaced
+			if (v->replaced == pending || snapshots->pinned(v->born, v->replaced)) {
+				link = &v->older;
+			} else {
+				link->store(v->older.load(std::memory_order_relaxed), std::memory_order_release);
+				retired.push_back(v);
+				--n_versions;
+			}
+		}
+		if (s.older.load(std::memory_order_relaxed)) {
+			++it;
+		} else {
+			it = chained.erase(it);
+		}
+	}
+	// A reader that starts walking after the fence finds none of the
+	// retired nodes, so with none walking now they can go
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (walkers.load(std::memory_order_acquire) == 0) {
+		for (Version* v : retired) {
+			delete v;
+		}
+		retired.clear();
+	}
+}
+
+void VersionTable::settle(size_t idx) {
+	Slot& s(slot(idx));
+	uint64_t r(revealed.load(std::memory_order_relaxed));
+	uint64_t st(s.stamp.load(std::memory_order_relaxed));
+	if ((st & born_mask) == pending) {
+		// The item stays, so readers only need the stamp to move on
+		s.stamp.store(((st >> write_shift) + 2) << write_shift | r, std::memory_order_release);
+	}
+	// Only prune reads replaced, under the same writer
+	for (Version* v = s.older.load(std::memory_order_relaxed); v;
+			v = v->older.load(std::memory_order_relaxed)) {
+		if (v->replaced == pending) {
+			v->replaced = r;
+			break;
+		}
+	}
+}
+
+size_t VersionTable::bytes() const {
+	size_t pages(0), value_bytes(0);
+	Page** d(dirs.back());
+	for (; pages < dir_size && d[pages]; ++pages) {
+		if (d[pages]->values.load(std::memory_order_relaxed)) {
+			value_bytes += page_size * sizeof(uint64_t);
+		}
+	}
+	size_t dir_bytes(0);
+	for (size_t i = 0, sz = 16; i < dirs.size(); ++i, sz *= 2) {
+		dir_bytes += sz * sizeof(Page*);
+	}
+	return pages * sizeof(Page) + value_bytes + dir_bytes +
+		(n_versions + retired.size()) * sizeof(Version) +
+		chained.bucket_count() * sizeof(void*) + chained.size() * 2 * sizeof(void*);
+}
+
+}  // namespace polar_race
@@ -0,0 +1,158 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef ENGINE_RACE_VERSION_TABLE_H_
+#define ENGINE_RACE_VERSION_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <unordered_set>
+#include <vector>
+
+#include "snapshot_list.h"
+
+namespace polar_race {
+
+// p is a logical address: chunk p / chunk_size is stored in log file
+// (p / chunk_size) % n_logs, at chunk (p / chunk_size) / n_logs of it.
+struct Item {
+	size_t p;
+	unsigned szKey, szVal;
+};
+
+// The Items of an EngineRace by index slot: the newest version of each
+// key with the sequence it was born at, and the replaced versions a live
+// snapshot may still read.
+//
+// Readers take no lock. The newest version of a slot sits behind a
+// seqlock of atomic words, so a read racing an overwrite retries rather
+// than tearing. Replaced versions hang off the slot in a chain of
+// immutable nodes, newest first, read with acquire loads. Slots live in
+// pages that never move; a grown page directory is published with a
+// release store and the old one kept until the table goes. Unlinked
+// nodes are only freed once no reader is walking a chain.
+//
+// Values of up to max_inline bytes are copied into the table as well,
+// into a word per slot read under the same seqlock, so reading them
+// touches no chunk. A page only gets its words once a small value lands
+// in it. The copy is a cache: the log keeps the value, and opening the
+// store copies it again.
+//
+// An ingest sets its versions born at pending, which reads as missing,
+// keeping every version it replaces, and reveal then gives them all one
+// sequence at once. settle stamps them with it slot by slot, without
+// changing what readers see.
+//
+// push, set, prune, reveal and settle are for one writer at a time.
+class VersionTable {
+public:
+	// Longest value kept inline
+	static const size_t max_inline = sizeof(uint64_t);
+	// Born at of the versions an ingest has not revealed yet
+	static const uint64_t pending = (1ull << 48) - 1;
+
+	VersionTable();
+	~VersionTable();
+
+	// Slots pushed so far
+	inline size_t size() const {
+		return n.load(std::memory_order_acquire);
+	}
+
+	// The newest version of idx, and the sequence it was born at, pending
+	// if not revealed yet. value gets the bytes of a value of up to
+	// max_inline bytes.
+	Item latest(size_t idx, uint64_t* born = NULL, uint64_t* value = NULL) const;
+
+	// The version of idx newest as of seq, if the key existed then, with
+	// its value in value as for latest. Pending versions are skipped.
+	bool resolve(size_t idx, uint64_t seq, Item* item, uint64_t* value = NULL);
+
+	// Adds slot size(), born at born. value holds the item's value bytes,
+	// and is only read for one of up to max_inline of them.
+	void push(const Item& item, uint64_t born, const char* value);
+
+	// Makes item, born at born, the newest version of idx. With keep the
+	// version it replaces stays readable as of the sequences before born.
+	void set(size_t idx, const Item& item, uint64_t born, bool keep, const char* value);
+
+	// Drops the replaced versions no live snapshot of snapshots can see
+	void prune(SnapshotList* snapshots);
+
+	// Makes the pending versions born at seq
+	inline void reveal(uint64_t seq) {
+		revealed.store(seq, std::memory_order_release);
+	}
+
+	// Stamps the pending version of idx, if still there, and the version
+	// it replaced with the revealed sequence
+	void settle(size_t idx);
+
+	// Once every slot an ingest set is settled
+	inline void settled() {
+		revealed.store(0, std::memory_order_release);
+	}
+
+	// Replaced versions kept
+	inline size_t versions() const {
+		return n_versions;
+	}
+
+	size_t bytes() const;
+
+private:
+	static const int page_shift = 12;
+	static const size_t page_size = 1 << page_shift;
+	static const int write_shift = 48;
+	static const uint64_t born_mask = (1ull << write_shift) - 1;
+
+	struct Version {
+		Item item;
+		uint64_t born, replaced;
+		uint64_t value;
+		std::atomic<Version*> older;
+	};
+
+	struct Slot {
+		std::atomic<uint64_t> stamp;	// writes << 48 | born; writes odd while set
+		std::atomic<uint64_t> p;
+		std::atomic<uint64_t> sizes;	// szKey << 32 | szVal
+		std::atomic<Version*> older;
+	};
+
+	struct Page {
+		Slot slots[page_size];
+		std::atomic<std::atomic<uint64_t>*> values;	// null until one is small
+	};
+
+	VersionTable(const VersionTable&) = delete;
+	VersionTable& operator=(const VersionTable&) = delete;
+
+	inline Page& page(size_t idx) const {
+		return *dir.load(std::memory_order_acquire)[idx >> page_shift];
+	}
+
+	inline Slot& slot(size_t idx) const {
+		return page(idx).slots[idx & (page_size - 1)];
+	}
+
+	// Stores the inline value of a slot of p being written
+	void setValue(Page* p, size_t idx, const Item& item, const char* value);
+
+	std::atomic<Page**> dir;
+	size_t dir_size;
+	std::vector<Page**> dirs;	// every directory, the current one last
+	std::atomic<size_t> n;
+	std::atomic<uint64_t> revealed;	// what pending stands for, 0 while hidden
+
+	// Slots with replaced versions, for prune
+	std::unordered_set<size_t> chained;
+	size_t n_versions;
+	// Nodes unlinked while a reader may still be on them
+	std::vector<Version*> retired;
+	std::atomic<size_t> walkers;
+};
+
+}  // namespace polar_race
+
+#endif  // ENGINE_RACE_VERSION_TABLE_H_
@@ -2,7 +2,9 @@
 #ifndef INCLUDE_ENGINE_H_
 #define INCLUDE_ENGINE_H_
 #include <string>
+#include <vector>
 #include "polar_string.h"
+#include "histogram.h"
 
 namespace polar_race {
 
@@ -27,12 +29,284 @@ class Visitor {
   virtual void Visit(const PolarString &key, const PolarString &value) = 0;
 };
 
+// Pass to Engine::RangeBatch; receives the pairs of the range in order,
+// up to the batch size at a time. The arrays are only valid during the
+// call.
+class BatchVisitor {
+ public:
+  virtual ~BatchVisitor() {}
+
+  virtual void Visit(const PolarString* keys, const PolarString* values,
+      size_t n) = 0;
+};
+
+// Pass to Engine::ParallelRange; makes the visitor of each partition
+class VisitorFactory {
+ public:
+  virtual ~VisitorFactory() {}
+
+  // Called on the calling thread for partitions 0, 1, ... before any
+  // Visit. The partition covers [lower, upper), empty bounds being
+  // open. The factory keeps ownership of the visitor.
+  virtual Visitor* NewVisitor(size_t partition, const PolarString& lower,
+      const PolarString& upper) = 0;
+};
+
+// A point in time to read at, from Engine::GetSnapshot. Writes made
+// after it are not seen through it.
+class Snapshot {
+ public:
+  explicit Snapshot(uint64_t sequence) : sequence_(sequence) { }
+
+  uint64_t sequence() const { return sequence_; }
+
+ private:
+  uint64_t sequence_;
+};
+
+// Returned by Engine::NewIterator. Positioned on no key until one of the
+// Seek calls. An iterator sees the keys and values as of its snapshot,
+// or else as of when it was created; values are only read when first
+// asked for. Delete it before the engine.
+class Iterator {
+ public:
+  virtual ~Iterator() {}
+
+  // Whether the iterator is positioned on a key
+  virtual bool Valid() const = 0;
+
+  virtual void SeekToFirst() = 0;
+  virtual void SeekToLast() = 0;
+
+  // Moves to the first key >= target
+  virtual void Seek(const PolarString& target) = 0;
+
+  // Moves to the last key <= target
+  virtual void SeekForPrev(const PolarString& target) = 0;
+
+  // Require Valid()
+  virtual void Next() = 0;
+  virtual void Prev() = 0;
+
+  // Valid until the iterator moves
+  virtual PolarString key() const = 0;
+
+  // Empty for a keys_only iterator. Valid until the iterator moves.
+  virtual PolarString value() = 0;
+};
+
+// Pass to ChangeStream::Next; receives committed writes in order. The
+// key and value point into the engine's log and are only valid during
+// the call.
+class ChangeVisitor {
+ public:
+  virtual ~ChangeVisitor() {}
+
+  virtual void Visit(uint64_t sequence, const PolarString& key,
+      const PolarString& value) = 0;
+};
+
+// Returned by Engine::Tail. Delete it before the engine.
+class ChangeStream {
+ public:
+  virtual ~ChangeStream() {}
+
+  // Visits up to max of the records after the last one visited, in
+  // sequence order, waiting up to timeout_ms for the first. kTimedOut if
+  // none came; kNotFound if the next record is no longer retained, after
+  // which the stream can not go on.
+  virtual RetCode Next(ChangeVisitor& visitor, size_t max,
+      uint64_t timeout_ms) = 0;
+
+  // Sequence of the last record visited
+  virtual uint64_t sequence() const = 0;
+};
+
+// Pass to Engine::NewIterator
+struct IteratorOptions {
+  IteratorOptions() : keys_only(false), readahead(16), snapshot(NULL) { }
+
+  // Keys outside [lower, upper) are not visited; empty bounds are open
+  std::string lower;
+  std::string upper;
+
+  // Never read values, so iterating touches no value bytes
+  bool keys_only;
+
+  // Values of this many keys ahead in the direction of travel are read
+  // ahead in the background. 0 disables readahead.
+  size_t readahead;
+
+  // Read as of this snapshot rather than the latest state
+  const Snapshot* snapshot;
+};
+
+// Pass to Engine::Open to tune the engine. Fields that shape the on-disk
+// layout are only consulted when the store is created; reopening an
+// existing store keeps the layout recorded in its manifest.
+struct Options {
+  Options() : shards(1), trace_sample(0), stall_threshold_ns(0),
+    stall_log_size(1024), direct_io(false), numa(false), read_only(false),
+    change_retention(0), hot_cache_bytes(0) { }
+
+  // Registered engine to open, see Engine::Register. Empty takes the
+  // engine from an "engine:" prefix of the name, or else the default.
+  std::string engine;
+
+  // Number of hash partitions, each with its own journal, flusher and
+  // files. One by default; 0 picks one partition per hardware thread.
+  int shards;
+
+  // Directories, ideally one per device, that every partition stripes
+  // its data log over. Empty keeps the log next to the store name.
+  std::vector<std::string> log_dirs;
+
+  // Directory for the per-partition meta files. Empty keeps them next
+  // to the store name.
+  std::string meta_dir;
+
+  // Trace the phases of one in trace_sample operations per thread, for
+  // Engine::DumpTrace. 0 disables tracing.
+  unsigned trace_sample;
+
+  // Records every operation (time, type, key, value size) into this
+  // file, replacing it, in the format of op_trace.h for replay. Empty
+  // disables recording.
+  std::string op_trace;
+
+  // Waits in Write and Read at least this long are logged as
+  // StallEvents, see Engine::GetStallEvents. 0 disables the detector.
+  uint64_t stall_threshold_ns;
+
+  // Most recent stall events kept
+  size_t stall_log_size;
+
+  // Read and write values with O_DIRECT, bypassing the page cache. Only
+  // the "fixed" engine honours it, and only where the file system can.
+  bool direct_io;
+
+  // On machines with several NUMA nodes, deal the shards out over the
+  // nodes: each shard's chunks, index and journal are allocated on its
+  // node and its background threads run there. No effect on one node.
+  bool numa;
+
+  // Open an existing store for reading alongside its writer, see
+  // Engine::OpenReadOnly. Engines without a read-only mode fail with
+  // kNotSupported.
+  bool read_only;
+
+  // Keep the latest change_retention writes for Engine::Tail, 32 bytes
+  // each. 0 disables the change stream.
+  size_t change_retention;
+
+  // Bytes, over all shards, of a cache of single values up to 4 KB for
+  // the most read keys, in front of the chunks. Admission is by read
+  // frequency, so scans do not displace hot keys. 0 disables it.
+  size_t hot_cache_bytes;
+};
+
+// A wait in Write or Read that reached Options::stall_threshold_ns
+struct StallEvent {
+  StallEvent() : time_ns(0), duration_ns(0), flush_batch(0),
+    file_grew(false) { }
+
+  uint64_t time_ns;       // start of the wait, ns since the Unix epoch
+  uint64_t duration_ns;
+  std::string op;         // "write" or "read"
+  // What it waited for: "journal_mtx" (other writers), "DataBlk::op",
+  // "p_disk_mtx", "chunk_load", or the longest phase of the flush it
+  // waited on: "flush_index", "file_grow", "flush_copy", "meta_write"
+  std::string cause;
+  uint32_t flush_batch;   // records in that flush, 0 if none
+  bool file_grew;         // whether a log file was grown and remapped
+};
+
+// Contention of one lock site, times in nanoseconds
+struct LockStats {
+  LockStats() : acquisitions(0), contended(0), wait_ns(0), hold_ns(0) { }
+
+  std::string site;
+  uint64_t acquisitions;
+  uint64_t contended;
+  uint64_t wait_ns;
+  uint64_t hold_ns;
+};
+
+// Filled by Engine::GetStats. Latencies are in nanoseconds.
+struct Stats {
+  Stats() : read_misses(0), bytes_written(0), bytes_read(0),
+    flushed_records(0), hot_cache_hits(0), keys(0), index_bytes(0),
+    meta_bytes(0), chunk_cache_bytes(0), hot_cache_bytes(0),
+    journal_bytes(0), versions(0), stalls(0) { }
+
+  Histogram read;
+  Histogram write;
+  Histogram range;
+  Histogram flush;
+  Histogram chunk_load;
+
+  uint64_t read_misses;
+  uint64_t bytes_written;
+  uint64_t bytes_read;
+  uint64_t flushed_records;
+  // Reads served by the cache of Options::hot_cache_bytes
+  uint64_t hot_cache_hits;
+
+  // Memory accounting, in bytes
+  uint64_t keys;
+  uint64_t index_bytes;
+  uint64_t meta_bytes;
+  uint64_t chunk_cache_bytes;
+  uint64_t hot_cache_bytes;
+  uint64_t journal_bytes;
+
+  // Replaced versions kept for live snapshots
+  uint64_t versions;
+
+  // Stall events since Open, including those dropped from the log
+  uint64_t stalls;
+
+  // Empty unless the engine was built with lock profiling
+  std::vector<LockStats> locks;
+};
+
+class Engine;
+
+// Opens an engine of one kind; name has the "engine:" prefix removed
+typedef RetCode (*EngineFactory)(const std::string& name,
+    const Options& options, Engine** eptr);
+
 class Engine {
  public:
-  // Open engine
+  // Open engine. Names such as "example:/data/db" open /data/db with
+  // the engine registered as "example".
+  static RetCode Open(const std::string& name,
+      Engine** eptr);
+
   static RetCode Open(const std::string& name,
+      const Options& options,
+      Engine** eptr);
+
+  // Opens an existing store, kNotFound if there is none, with
+  // options.read_only set. The files are mapped read-only and shared
+  // through the page cache with the writer and other readers; there is
+  // no journal and no background thread, and no lock is taken or file
+  // created, so any number of readers may run beside one writer. Writes
+  // fail with kNotSupported. The engine sees the store as of Open until
+  // Refresh.
+  static RetCode OpenReadOnly(const std::string& name,
+      const Options& options,
       Engine** eptr);
 
+  // Makes factory available to Open as engine. The engines built into
+  // the library ("race", the default, "fixed" and "example") are
+  // registered before the first Open.
+  static RetCode Register(const std::string& engine,
+      EngineFactory factory);
+
+  // Names of the registered engines
+  static std::vector<std::string> Registered();
+
   Engine() { }
 
   // Close engine
@@ -61,6 +335,118 @@ class Engine {
   virtual RetCode Range(const PolarString& lower,
       const PolarString& upper,
       Visitor &visitor) = 0;
+
+  // Like Range, but hands the pairs to visitor batch_size at a time
+  virtual RetCode RangeBatch(const PolarString& lower,
+      const PolarString& upper,
+      BatchVisitor &visitor,
+      size_t batch_size = 256) {
+    return kNotSupported;
+  }
+
+  // Splits [lower, upper) into up to n partitions of about equal bytes
+  // and visits them in parallel, each in order. Fewer partitions are
+  // made when the range holds too few keys. With ordered set, the
+  // partitions are still read in parallel but every Visit is made on
+  // the calling thread, partition after partition, so the visitors see
+  // the whole range in order.
+  virtual RetCode ParallelRange(const PolarString& lower,
+      const PolarString& upper,
+      size_t n,
+      VisitorFactory& factory,
+      bool ordered = false) {
+    return kNotSupported;
+  }
+
+  // Approximate key and value bytes of [lower, upper), in *size
+  virtual RetCode ApproximateSize(const PolarString& lower,
+      const PolarString& upper,
+      uint64_t* size) {
+    return kNotSupported;
+  }
+
+  // A new iterator over the keys in options' bounds, in *it
+  virtual RetCode NewIterator(const IteratorOptions& options,
+      Iterator** it) {
+    return kNotSupported;
+  }
+
+  // Adds the segments SegmentBuilder wrote to dir, for a store of as
+  // many shards as this one. The files are linked into the store, not
+  // rewritten, and all of them become visible at once; their records
+  // replace those of the same keys. dir may be removed afterwards.
+  virtual RetCode Ingest(const std::string& dir) {
+    return kNotSupported;
+  }
+
+  // Pins the current state for ReadAt, RangeAt and iterators. Writes go
+  // on meanwhile; the versions they replace are kept until every
+  // snapshot that can see them is released. Snapshots do not survive
+  // reopening.
+  virtual RetCode GetSnapshot(const Snapshot** snapshot) {
+    return kNotSupported;
+  }
+
+  virtual RetCode ReleaseSnapshot(const Snapshot* snapshot) {
+    return kNotSupported;
+  }
+
+  // Read and Range as of snapshot
+  virtual RetCode ReadAt(const Snapshot* snapshot,
+      const PolarString& key,
+      std::string* value) {
+    return kNotSupported;
+  }
+
+  virtual RetCode RangeAt(const Snapshot* snapshot,
+      const PolarString& lower,
+      const PolarString& upper,
+      Visitor &visitor) {
+    return kNotSupported;
+  }
+
+  // Catches a read-only engine up with what the writer has made
+  // durable. Reads may run alongside it.
+  virtual RetCode Refresh() {
+    return kNotSupported;
+  }
+
+  // Writes a consistent copy of the store, as of one moment, into dir
+  // while the engine keeps serving; open it by the store's base name
+  // under dir. Files that never change are hard-linked and logs are
+  // copied, by reflink where the file system can. Checkpointing the same
+  // store into the same dir again only copies what changed since, so a
+  // checkpoint meant to be updated must not be written to.
+  virtual RetCode Checkpoint(const std::string& dir) {
+    return kNotSupported;
+  }
+
+  // A stream of the writes committed after sequence, in commit order,
+  // for feeding caches and followers. Every write (or ingested record)
+  // is numbered from 1 as it is made durable; a sequence past the latest
+  // starts from now. Records are kept as positions in the log, the
+  // latest Options::change_retention of them, and sequences start over
+  // with every Open. kNotFound if the record after sequence is no longer
+  // retained.
+  virtual RetCode Tail(uint64_t sequence, ChangeStream** stream) {
+    return kNotSupported;
+  }
+
+  // Counters, latency histograms and memory usage since Open
+  virtual RetCode GetStats(Stats* stats) {
+    return kNotSupported;
+  }
+
+  // Writes the most recent traced operations to path as Chrome
+  // trace-event JSON, for chrome://tracing or Perfetto
+  virtual RetCode DumpTrace(const std::string& path) {
+    return kNotSupported;
+  }
+
+  // The logged stall events, oldest first
+  virtual RetCode GetStallEvents(std::vector<StallEvent>* events) {
+    return kNotSupported;
+  }
 };
 
 }  // namespace polar_race
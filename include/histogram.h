@@ -0,0 +1,102 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef INCLUDE_HISTOGRAM_H_
+#define INCLUDE_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+namespace polar_race {
+
+// Log-linear histogram in the style of HdrHistogram: every power of two
+// is split into 16 linear sub-buckets, so any reported value is within
+// 1/16 of the recorded one. Values beyond 2^40 are clamped to the last
+// bucket, which for nanoseconds is about 18 minutes.
+class Histogram {
+ public:
+  static const int kSubBucketBits = 4;
+  static const int kSubBuckets = 1 << kSubBucketBits;
+  static const int kMaxExponent = 40;
+  static const int kBuckets = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+  Histogram() { Clear(); }
+
+  void Clear() {
+    memset(buckets_, 0, sizeof(buckets_));
+    count_ = sum_ = max_ = 0;
+  }
+
+  void Record(uint64_t v) {
+    ++buckets_[BucketOf(v)];
+    ++count_;
+    sum_ += v;
+    if (v > max_) max_ = v;
+  }
+
+  // Adds n values that fell into bucket b, used to rebuild a histogram
+  // from sharded counters.
+  void AddBucket(int b, uint64_t n) {
+    buckets_[b] += n;
+    count_ += n;
+  }
+
+  void AddSum(uint64_t sum, uint64_t max) {
+    sum_ += sum;
+    if (max > max_) max_ = max;
+  }
+
+  void Merge(const Histogram& other) {
+    for (int b = 0; b < kBuckets; ++b) {
+      buckets_[b] += other.buckets_[b];
+    }
+    count_ += other.count_;
+    AddSum(other.sum_, other.max_);
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+  double mean() const { return count_ ? (double)sum_ / count_ : 0; }
+
+  // Smallest bucket bound at or above fraction p (0..1) of the values,
+  // capped at the true maximum.
+  uint64_t Percentile(double p) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = (uint64_t)(p * count_ + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < kBuckets; ++b) {
+      seen += buckets_[b];
+      if (seen >= rank) {
+        uint64_t high = BucketHigh(b);
+        return high < max_ ? high : max_;
+      }
+    }
+    return max_;
+  }
+
+  static int BucketOf(uint64_t v) {
+    if (v < (uint64_t)kSubBuckets) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e > kMaxExponent) return kBuckets - 1;
+    int sub = (int)((v >> (e - kSubBucketBits)) & (kSubBuckets - 1));
+    return (e - kSubBucketBits + 1) * kSubBuckets + sub;
+  }
+
+  // Largest value that falls into bucket b
+  static uint64_t BucketHigh(int b) {
+    if (b < kSubBuckets) return b;
+    int e = b / kSubBuckets + kSubBucketBits - 1;
+    uint64_t sub = b % kSubBuckets;
+    uint64_t width = 1ull << (e - kSubBucketBits);
+    return (1ull << e) + (sub + 1) * width - 1;
+  }
+
+ private:
+  uint64_t buckets_[kBuckets];
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t max_;
+};
+
+}  // namespace polar_race
+
+#endif  // INCLUDE_HISTOGRAM_H_
@@ -0,0 +1,39 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef INCLUDE_OP_TRACE_H_
+#define INCLUDE_OP_TRACE_H_
+#include <stdint.h>
+
+namespace polar_race {
+
+// On-disk format of the operation trace written when Options::op_trace
+// is set. The file starts with an OpTraceHeader, followed by records in
+// the order the engine received them. Each record is an OpTraceRecord
+// and key_len bytes of key; a range record is followed by value_len
+// bytes of its upper bound instead of carrying a value size. All fields
+// are little endian.
+enum OpTraceOp {
+  kOpTraceWrite = 0,
+  kOpTraceRead = 1,
+  kOpTraceRange = 2,
+};
+
+static const char kOpTraceMagic[8] = {'P', 'K', 'V', 'T', 'R', 'A', 'C', 'E'};
+static const uint32_t kOpTraceVersion = 1;
+
+struct OpTraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct OpTraceRecord {
+  uint64_t ts_ns;       // since the engine was opened
+  uint32_t op;          // OpTraceOp
+  uint32_t key_len;
+  uint32_t value_len;   // value size of a write, upper bound size of a range
+  uint32_t reserved;
+};
+
+}  // namespace polar_race
+
+#endif  // INCLUDE_OP_TRACE_H_
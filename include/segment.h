@@ -0,0 +1,66 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#ifndef INCLUDE_SEGMENT_H_
+#define INCLUDE_SEGMENT_H_
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "engine.h"
+
+namespace polar_race {
+
+// On-disk format of the segment files made by SegmentBuilder for
+// Engine::Ingest, one per shard of the store. A segment holds the key
+// and value bytes of its records back to back, then a SegmentEntry for
+// each record in key order, then a SegmentFooter. Keys are unique. All
+// fields are little endian.
+static const char kSegmentMagic[8] = {'P', 'K', 'V', 'S', 'E', 'G', 'M', 'T'};
+static const uint32_t kSegmentVersion = 1;
+
+struct SegmentEntry {
+  uint64_t offset;      // of the key; the value follows it
+  uint32_t key_len;
+  uint32_t value_len;
+};
+
+struct SegmentFooter {
+  char magic[8];
+  uint32_t version;
+  uint32_t shard;       // hashShard(key) % shards of every key in it
+  uint32_t shards;
+  uint32_t reserved;
+  uint64_t records;
+  uint64_t index_offset;
+};
+
+// Builds the segments of a store of a given number of shards in a
+// directory, offline. Add takes records in any order, a later record
+// of a key replacing an earlier one, and spreads them over the shard
+// files as they come; Finish sorts and indexes every shard on its own
+// thread. Sorted input skips the sort. Not thread-safe.
+class SegmentBuilder {
+ public:
+  static RetCode Open(const std::string& dir, int shards,
+      SegmentBuilder** builder);
+
+  ~SegmentBuilder();
+
+  RetCode Add(const PolarString& key, const PolarString& value);
+
+  // Writes the indexes; the directory is then ready for Engine::Ingest
+  RetCode Finish();
+
+  // Name of the segment of shard i in dir
+  static std::string SegmentPath(const std::string& dir, int i);
+
+ private:
+  struct Shard;
+
+  SegmentBuilder() : finished_(false) { }
+
+  std::vector<Shard*> shards_;
+  bool finished_;
+};
+
+}  // namespace polar_race
+
+#endif  // INCLUDE_SEGMENT_H_
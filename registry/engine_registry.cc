@@ -0,0 +1,119 @@
+// Copyright [2018] Alibaba Cloud All rights reserved
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "include/engine.h"
+#ifdef POLAR_WITH_ENGINE_RACE
+#include "engine_race/fixed_engine.h"
+#include "engine_race/sharded_engine.h"
+#endif
+#ifdef POLAR_WITH_ENGINE_EXAMPLE
+#include "engine_example/engine_example.h"
+#endif
+
+namespace polar_race {
+
+namespace {
+
+struct Registry {
+  std::mutex mu;
+  std::map<std::string, EngineFactory> factories;
+  std::string default_engine;
+};
+
+// The built-in engines are named here rather than registering
+// themselves from static initializers: a linker pulls an object out of
+// lib/libengine.a only when something refers to it, and nothing else
+// refers to an engine's translation units.
+Registry& registry() {
+  static Registry* r = [] {
+    Registry* r = new Registry();
+#ifdef POLAR_WITH_ENGINE_RACE
+    r->factories["race"] = &ShardedEngine::Open;
+    r->factories["fixed"] = &FixedEngine<8, 4096>::Open;
+#endif
+#ifdef POLAR_WITH_ENGINE_EXAMPLE
+    r->factories["example"] = &EngineExample::Open;
+#endif
+    if (r->factories.count("race")) {
+      r->default_engine = "race";
+    } else if (!r->factories.empty()) {
+      r->default_engine = r->factories.begin()->first;
+    }
+    return r;
+  }();
+  return *r;
+}
+
+}  // namespace
+
+Engine::~Engine() {
+}
+
+RetCode Engine::Open(const std::string& name, Engine** eptr) {
+  return Engine::Open(name, Options(), eptr);
+}
+
+RetCode Engine::OpenReadOnly(const std::string& name,
+    const Options& options, Engine** eptr) {
+  Options o(options);
+  o.read_only = true;
+  return Engine::Open(name, o, eptr);
+}
+
+RetCode Engine::Open(const std::string& name, const Options& options,
+    Engine** eptr) {
+  *eptr = NULL;
+  Registry& r = registry();
+  std::string engine = options.engine;
+  std::string path = name;
+  EngineFactory factory = NULL;
+  {
+    std::lock_guard<std::mutex> lock(r.mu);
+    size_t colon = name.find(':');
+    if (engine.empty() && colon != std::string::npos &&
+        r.factories.count(name.substr(0, colon))) {
+      engine = name.substr(0, colon);
+      path = name.substr(colon + 1);
+    }
+    if (engine.empty()) {
+      engine = r.default_engine;
+    }
+    auto it = r.factories.find(engine);
+    if (it == r.factories.end()) {
+      return kNotSupported;
+    }
+    factory = it->second;
+  }
+  return factory(path, options, eptr);
+}
+
+RetCode Engine::Register(const std::string& engine, EngineFactory factory) {
+  if (engine.empty() || engine.find(':') != std::string::npos ||
+      factory == NULL) {
+    return kInvalidArgument;
+  }
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mu);
+  if (!r.factories.insert(std::make_pair(engine, factory)).second) {
+    return kInvalidArgument;
+  }
+  if (r.default_engine.empty()) {
+    r.default_engine = engine;
+  }
+  return kSucc;
+}
+
+std::vector<std::string> Engine::Registered() {
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mu);
+  std::vector<std::string> names;
+  for (auto& f : r.factories) {
+    names.push_back(f.first);
+  }
+  return names;
+}
+
+}  // namespace polar_race
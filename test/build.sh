@@ -1,6 +1,6 @@
 #!/bin/bash
 
-test=('single_thread_test.cc' 'multi_thread_test.cc' 'crash_test.cc')
+test=('single_thread_test.cc' 'multi_thread_test.cc' 'crash_test.cc' 'range_test.cc' 'registry_test.cc' 'stall_test.cc' 'iterator_test.cc' 'parallel_range_test.cc' 'snapshot_test.cc' 'ingest_test.cc' 'fixed_test.cc' 'long_key_test.cc' 'inline_value_test.cc' 'read_only_test.cc' 'checkpoint_test.cc' 'change_stream_test.cc' 'hot_cache_test.cc')
 
 rm -rf ./data/test-*
 for f in ${test[@]}; do
@@ -0,0 +1,181 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define THREAD_NUM 4
+#define KV_CNT 4000
+#define RETENTION 20000
+
+// Applies the stream to another store, as a follower would
+class Follower : public ChangeVisitor {
+public:
+    Engine *engine;
+    uint64_t last = 0;
+    void Visit(uint64_t sequence, const PolarString &key,
+               const PolarString &value) {
+        assert(sequence == last + 1);
+        last = sequence;
+        RetCode ret = engine->Write(key, value);
+        assert(ret == kSucc);
+    }
+};
+
+// Only checks that sequences come without gaps
+class SequenceCheck : public ChangeVisitor {
+public:
+    uint64_t last = 0;
+    void Visit(uint64_t sequence, const PolarString &key,
+               const PolarString &value) {
+        assert(sequence == last + 1);
+        last = sequence;
+    }
+};
+
+class CollectVisitor : public Visitor {
+public:
+    std::map<std::string, std::string> kvs;
+    void Visit(const PolarString &key, const PolarString &value) {
+        kvs[key.ToString()] = value.ToString();
+    }
+};
+
+// Threads overwrite each other's keys, so only following the commit
+// order gives the same final values
+void writer(Engine *engine, int t) {
+    char v[4096];
+    for (int i = 0; i < KV_CNT; ++i) {
+        std::string key = "key" + std::to_string((i * 7 + t) % 1000);
+        gen_random(v, 1 + (i * 31 + t) % 3000);
+        RetCode ret = engine->Write(key, v);
+        assert(ret == kSucc);
+    }
+}
+
+void follow(ChangeStream *stream, Follower *follower, uint64_t until) {
+    while (stream->sequence() < until) {
+        RetCode ret = stream->Next(*follower, 256, 100);
+        assert(ret == kSucc || ret == kTimedOut);
+    }
+}
+
+int main() {
+    printf_(
+        "======================= change stream test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    Engine *engine = NULL;
+    Options options;
+    options.shards = 3;
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+    ChangeStream *stream = NULL;
+    ret = engine->Tail(0, &stream);
+    assert(ret == kNotSupported);
+    delete engine;
+
+    options.change_retention = RETENTION;
+    ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+    Engine *replica = NULL;
+    ret = Engine::Open(engine_path + "-replica", Options(), &replica);
+    assert(ret == kSucc);
+
+    Follower follower;
+    follower.engine = replica;
+    ret = engine->Tail(0, &stream);
+    assert(ret == kSucc);
+    ret = stream->Next(follower, 256, 10);
+    assert(ret == kTimedOut);
+
+    std::thread ths[THREAD_NUM];
+    for (int t = 0; t < THREAD_NUM; ++t) {
+        ths[t] = std::thread(writer, engine, t);
+    }
+    follow(stream, &follower, THREAD_NUM * KV_CNT);
+    for (int t = 0; t < THREAD_NUM; ++t) ths[t].join();
+    ret = stream->Next(follower, 256, 10);
+    assert(ret == kTimedOut);
+
+    CollectVisitor primary, copy;
+    engine->Range("", "", primary);
+    replica->Range("", "", copy);
+    assert(primary.kvs.size() == 1000);
+    assert(primary.kvs == copy.kvs);
+
+    // Past the retention the oldest records are gone; a stream that
+    // falls that far behind can not go on
+    ChangeStream *now = NULL;
+    ret = engine->Tail(~0ull, &now);
+    assert(ret == kSucc);
+    assert(now->sequence() == THREAD_NUM * KV_CNT);
+    writer(engine, 0);
+    writer(engine, 1);
+    Follower skip;
+    skip.engine = replica;
+    skip.last = THREAD_NUM * KV_CNT;
+    ret = now->Next(skip, 1, 0);
+    assert(ret == kSucc);
+    assert(now->sequence() == THREAD_NUM * KV_CNT + 1);
+    delete now;
+    ret = engine->Tail(0, &now);
+    assert(ret == kNotFound);
+    assert(now == NULL);
+    ret = engine->Tail((THREAD_NUM + 2) * KV_CNT - RETENTION, &now);
+    assert(ret == kSucc);
+    delete now;
+    ret = stream->Next(follower, 256, 0);
+    assert(ret == kSucc);
+    follow(stream, &follower, (THREAD_NUM + 2) * KV_CNT);
+
+    // Streams started at the edge of the retention while writers push it
+    // on either get every record in order or kNotFound, never a gap
+    for (int t = 0; t < THREAD_NUM; ++t) {
+        ths[t] = std::thread(writer, engine, t);
+    }
+    int edges = 0, dropped = 0;
+    for (; edges < 200; ++edges) {
+        ret = engine->Tail(~0ull, &now);
+        assert(ret == kSucc);
+        uint64_t from = now->sequence() - RETENTION + 1;
+        delete now;
+        ret = engine->Tail(from, &now);
+        if (ret == kNotFound) {
+            ++dropped;
+            continue;
+        }
+        assert(ret == kSucc);
+        SequenceCheck check;
+        check.last = from;
+        ret = now->Next(check, RETENTION, 0);
+        if (ret == kNotFound) {
+            ++dropped;
+        } else {
+            assert(ret == kSucc);
+            assert(now->sequence() == check.last);
+        }
+        delete now;
+    }
+    for (int t = 0; t < THREAD_NUM; ++t) ths[t].join();
+    printf("%d of %d edge tails dropped\n", dropped, edges);
+
+    delete stream;
+    delete replica;
+    delete engine;
+
+    printf_(
+        "======================= change stream test pass :) "
+        "======================");
+    return 0;
+}
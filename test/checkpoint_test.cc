@@ -0,0 +1,127 @@
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define THREAD_NUM 4
+#define KV_CNT 4000
+
+std::atomic<bool> checkpointed(false);
+
+std::string key_of(int t, int i) {
+    return "thread" + std::to_string(t) + "-" + std::to_string(i);
+}
+
+std::string value_of(int t, int i) {
+    return std::string(1 + (t * 131 + i) % 3000, 'a' + (t + i) % 26);
+}
+
+// Keeps writing until well past the checkpoint, so it is taken under load
+void writer(Engine *engine, int t, int *written) {
+    int i = 0;
+    for (; i < KV_CNT || !checkpointed; ++i) {
+        RetCode ret = engine->Write(key_of(t, i), value_of(t, i));
+        assert(ret == kSucc);
+    }
+    *written = i;
+}
+
+// Writes return once flushed, so a consistent cut holds the first n keys
+// of every thread for some n, and none after them
+void check_prefix(Engine *engine, int t, int written) {
+    std::string value;
+    int i = 0;
+    for (; i < written; ++i) {
+        RetCode ret = engine->Read(key_of(t, i), &value);
+        if (ret == kNotFound) break;
+        assert(ret == kSucc);
+        assert(value == value_of(t, i));
+    }
+    printf("thread %d: %d of %d keys in the checkpoint\n", t, i, written);
+    for (int j = i; j < written; ++j) {
+        std::string value;
+        assert(engine->Read(key_of(t, j), &value) == kNotFound);
+    }
+}
+
+int main() {
+    printf_(
+        "======================= checkpoint test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    std::string dir = engine_path + ".backup";
+    std::string backup_path = dir + engine_path.substr(engine_path.rfind('/'));
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    Options options;
+    options.shards = 3;
+    Engine *engine = NULL;
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+
+    ret = engine->Checkpoint("./data");
+    assert(ret == kInvalidArgument);
+
+    int written[THREAD_NUM];
+    std::thread ths[THREAD_NUM];
+    for (int t = 0; t < THREAD_NUM; ++t) {
+        ths[t] = std::thread(writer, engine, t, &written[t]);
+    }
+    usleep(100000);
+    ret = engine->Checkpoint(dir);
+    assert(ret == kSucc);
+    checkpointed = true;
+    for (int t = 0; t < THREAD_NUM; ++t) ths[t].join();
+
+    Engine *backup = NULL;
+    ret = Engine::OpenReadOnly(backup_path, Options(), &backup);
+    assert(ret == kSucc);
+    for (int t = 0; t < THREAD_NUM; ++t) check_prefix(backup, t, written[t]);
+    delete backup;
+
+    // Overwrites and new keys reach the next checkpoint into the same dir
+    for (int t = 0; t < THREAD_NUM; ++t) {
+        for (int i = 0; i < written[t]; i += 7) {
+            ret = engine->Write(key_of(t, i), value_of(t, i + 1));
+            assert(ret == kSucc);
+        }
+    }
+    // Two at once into the same dir take turns
+    RetCode rets[2];
+    std::thread checkpointers[2];
+    for (int c = 0; c < 2; ++c) {
+        checkpointers[c] = std::thread([&, c] { rets[c] = engine->Checkpoint(dir); });
+    }
+    for (int c = 0; c < 2; ++c) {
+        checkpointers[c].join();
+        assert(rets[c] == kSucc);
+    }
+
+    ret = Engine::OpenReadOnly(backup_path, Options(), &backup);
+    assert(ret == kSucc);
+    std::string value;
+    for (int t = 0; t < THREAD_NUM; ++t) {
+        for (int i = 0; i < written[t]; ++i) {
+            ret = backup->Read(key_of(t, i), &value);
+            assert(ret == kSucc);
+            assert(value == value_of(t, i % 7 ? i : i + 1));
+        }
+    }
+    delete backup;
+    delete engine;
+
+    printf_(
+        "======================= checkpoint test pass :) "
+        "======================");
+    return 0;
+}
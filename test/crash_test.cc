@@ -93,6 +93,15 @@ int main() {
             ret = engine->Read(ks[i], &value);
             assert(ret == kNotFound);
         }
+        delete engine;
+
+        // A store whose log was lost fails to open rather than crashing
+        res = truncate((engine_path + ".data").c_str(), 0);
+        assert(res == 0);
+        engine = NULL;
+        ret = Engine::Open(engine_path, &engine);
+        assert(ret == kCorruption);
+        assert(engine == NULL);
         printf_( "======================= crash test pass :) " "======================");
 
     } else {
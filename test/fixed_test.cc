@@ -0,0 +1,163 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 4000
+#define THREAD_NUM 8
+#define VALUE_SIZE 4096
+
+std::string key_of(uint64_t i) {
+    // Big-endian, so key order is numeric order
+    char k[8];
+    for (int b = 7; b >= 0; --b, i >>= 8) k[b] = (char)(i & 0xff);
+    return std::string(k, 8);
+}
+
+std::string value_of(uint64_t i, int round) {
+    std::string v(VALUE_SIZE, 'a' + (i + round) % 26);
+    memcpy(&v[0], &i, sizeof(i));
+    return v;
+}
+
+class CollectVisitor : public Visitor {
+public:
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    void Visit(const PolarString &key, const PolarString &value) {
+        keys.push_back(key.ToString());
+        values.push_back(value.ToString());
+    }
+};
+
+void write_thread(Engine *engine, int id, int round) {
+    for (int i = id; i < KV_CNT; i += THREAD_NUM) {
+        RetCode ret = engine->Write(key_of(i * 3), value_of(i * 3, round));
+        assert(ret == kSucc);
+    }
+}
+
+void check(Engine *engine, int round) {
+    std::string value;
+    for (int i = 0; i < KV_CNT; ++i) {
+        RetCode ret = engine->Read(key_of(i * 3), &value);
+        assert(ret == kSucc);
+        assert(value == value_of(i * 3, round));
+        ret = engine->Read(key_of(i * 3 + 1), &value);
+        assert(ret == kNotFound);
+    }
+
+    // [30, 300) holds keys 30, 33, ..., 297
+    CollectVisitor visitor;
+    RetCode ret = engine->Range(key_of(30), key_of(300), visitor);
+    assert(ret == kSucc);
+    assert(visitor.keys.size() == 90);
+    for (size_t i = 0; i < visitor.keys.size(); ++i) {
+        assert(visitor.keys[i] == key_of(30 + i * 3));
+        assert(visitor.values[i] == value_of(30 + i * 3, round));
+    }
+
+    CollectVisitor all;
+    ret = engine->Range("", "", all);
+    assert(ret == kSucc);
+    assert(all.keys.size() == KV_CNT);
+
+    Stats stats;
+    ret = engine->GetStats(&stats);
+    assert(ret == kSucc);
+    assert(stats.keys == KV_CNT);
+}
+
+int main() {
+    printf_(
+        "======================= fixed test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    for (int direct = 0; direct < 2; ++direct) {
+        std::string path = engine_path + (direct ? "-direct" : "-cached");
+        Options options;
+        options.engine = "fixed";
+        options.direct_io = direct;
+        Engine *engine = NULL;
+        RetCode ret = Engine::Open(path, options, &engine);
+        assert(ret == kSucc);
+
+        // Only 8-byte keys and 4 KB values
+        assert(engine->Write("short", value_of(0, 0)) == kInvalidArgument);
+        assert(engine->Write(key_of(0), "short") == kInvalidArgument);
+        std::string value;
+        assert(engine->Read("short", &value) == kInvalidArgument);
+
+        std::thread ths[THREAD_NUM];
+        for (int i = 0; i < THREAD_NUM; ++i) {
+            ths[i] = std::thread(write_thread, engine, i, 0);
+        }
+        for (int i = 0; i < THREAD_NUM; ++i) ths[i].join();
+        check(engine, 0);
+
+        // Overwrites land in place
+        for (int i = 0; i < THREAD_NUM; ++i) {
+            ths[i] = std::thread(write_thread, engine, i, 1);
+        }
+        for (int i = 0; i < THREAD_NUM; ++i) ths[i].join();
+        check(engine, 1);
+        delete engine;
+
+        ret = Engine::Open(path, options, &engine);
+        assert(ret == kSucc);
+        check(engine, 1);
+
+        // Reads racing overwrites of their keys see one whole value
+        std::atomic<bool> done(false);
+        std::thread writers[2], readers[THREAD_NUM];
+        for (int t = 0; t < 2; ++t) {
+            writers[t] = std::thread([engine] {
+                for (int round = 2; round <= 5; ++round) {
+                    for (int i = 0; i < 100; ++i) {
+                        assert(engine->Write(key_of(i * 3), value_of(i * 3, round)) == kSucc);
+                    }
+                }
+            });
+        }
+        for (int t = 0; t < THREAD_NUM; ++t) {
+            readers[t] = std::thread([engine, &done] {
+                std::string value;
+                while (!done) {
+                    for (int i = 0; i < 100; ++i) {
+                        assert(engine->Read(key_of(i * 3), &value) == kSucc);
+                        bool whole = false;
+                        for (int round = 1; round <= 5; ++round) {
+                            whole = whole || value == value_of(i * 3, round);
+                        }
+                        assert(whole);
+                    }
+                }
+            });
+        }
+        for (int t = 0; t < 2; ++t) writers[t].join();
+        done = true;
+        for (int t = 0; t < THREAD_NUM; ++t) readers[t].join();
+        for (int i = 0; i < 100; ++i) {
+            assert(engine->Read(key_of(i * 3), &value) == kSucc);
+            assert(value == value_of(i * 3, 5));
+        }
+        delete engine;
+    }
+
+    printf_(
+        "======================= fixed test pass :) "
+        "======================");
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 20000
+#define HOT_CNT 20
+#define ROUNDS 100
+#define RACE_WRITES 5000
+#define RACE_READERS 4
+
+char k[1024];
+char v[9024];
+
+std::map<std::string, std::string> expected;
+
+uint64_t hits(Engine *engine) {
+    Stats st;
+    RetCode ret = engine->GetStats(&st);
+    assert(ret == kSucc);
+    return st.hot_cache_hits;
+}
+
+// Reads every hot key ROUNDS times, returning the cache hits among them
+uint64_t read_hot(Engine *engine) {
+    uint64_t before = hits(engine);
+    std::string value;
+    for (int r = 0; r < ROUNDS; ++r) {
+        for (int i = 0; i < HOT_CNT; ++i) {
+            std::string key = "hot" + std::to_string(i);
+            RetCode ret = engine->Read(key, &value);
+            assert(ret == kSucc);
+            assert(value == expected[key]);
+        }
+    }
+    return hits(engine) - before;
+}
+
+// The value of the race key's n-th write, its length moving through the
+// size classes
+std::string race_value(int n) {
+    static const size_t lens[] = { 40, 200, 900, 3000 };
+    std::string v = std::to_string(n);
+    v.resize(lens[n % 4], 'x');
+    return v;
+}
+
+// Readers filling the cache with the race key while it is rewritten never
+// read back a write older than the last one finished before their read
+void race(Engine *engine) {
+    std::atomic<int> written(0);
+    std::atomic<bool> stop(false);
+    RetCode ret = engine->Write("race", race_value(0));
+    assert(ret == kSucc);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < RACE_READERS; ++t) {
+        readers.push_back(std::thread([&]() {
+            std::string value;
+            while (!stop.load()) {
+                int before = written.load();
+                RetCode ret = engine->Read("race", &value);
+                assert(ret == kSucc);
+                int n = atoi(value.c_str());
+                assert(n >= before);
+                assert(value == race_value(n));
+            }
+        }));
+    }
+    for (int i = 1; i <= RACE_WRITES; ++i) {
+        ret = engine->Write("race", race_value(i));
+        assert(ret == kSucc);
+        written.store(i);
+    }
+    stop.store(true);
+    for (auto &t : readers) {
+        t.join();
+    }
+    std::string value;
+    for (int r = 0; r < ROUNDS; ++r) {
+        ret = engine->Read("race", &value);
+        assert(ret == kSucc);
+        assert(value == race_value(RACE_WRITES));
+    }
+}
+
+int main() {
+    printf_(
+        "======================= hot cache test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    Engine *engine = NULL;
+    Options options;
+    options.shards = 2;
+    options.hot_cache_bytes = 1 << 20;
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+
+    for (int i = 0; i < KV_CNT; ++i) {
+        gen_random(k, 16);
+        gen_random(v, 9 + i % 4000);
+        ret = engine->Write(k, v);
+        assert(ret == kSucc);
+        expected[k] = v;
+    }
+    for (int i = 0; i < HOT_CNT; ++i) {
+        std::string key = "hot" + std::to_string(i);
+        gen_random(v, 100 + i * 50);
+        ret = engine->Write(key, v);
+        assert(ret == kSucc);
+        expected[key] = v;
+    }
+
+    Stats st;
+    engine->GetStats(&st);
+    assert(st.hot_cache_bytes >= (1 << 19) && st.hot_cache_bytes <= (1 << 21));
+
+    uint64_t warm = read_hot(engine);
+    printf("hits while warming: %lu of %d\n", (unsigned long)warm,
+           ROUNDS * HOT_CNT);
+    assert(warm >= ROUNDS * HOT_CNT / 2);
+
+    // A scan reading every key once does not push the hot keys out
+    std::string value;
+    for (auto &kv : expected) {
+        ret = engine->Read(kv.first, &value);
+        assert(ret == kSucc);
+        assert(value == kv.second);
+    }
+    uint64_t hot = read_hot(engine);
+    printf("hits after the scan: %lu of %d\n", (unsigned long)hot,
+           ROUNDS * HOT_CNT);
+    assert(hot >= ROUNDS * HOT_CNT * 9 / 10);
+
+    // Writes are seen at once
+    for (int i = 0; i < HOT_CNT; i += 2) {
+        std::string key = "hot" + std::to_string(i);
+        gen_random(v, 200 + i);
+        ret = engine->Write(key, v);
+        assert(ret == kSucc);
+        expected[key] = v;
+    }
+    read_hot(engine);
+
+    race(engine);
+    delete engine;
+
+    printf_(
+        "======================= hot cache test pass :) "
+        "======================");
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "include/engine.h"
+#include "include/segment.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 3000
+#define SHARD_NUM 4
+
+char k[1024];
+char v[9024];
+
+typedef std::map<std::string, std::string> KVs;
+
+class CollectVisitor : public Visitor {
+ public:
+    KVs seen;
+
+    void Visit(const PolarString &key, const PolarString &value) {
+        seen[key.ToString()] = value.ToString();
+    }
+};
+
+void check(Engine *engine, const KVs &kvs) {
+    std::string value;
+    for (auto &kv : kvs) {
+        RetCode ret = engine->Read(kv.first, &value);
+        assert(ret == kSucc);
+        assert(value == kv.second);
+    }
+    CollectVisitor visitor;
+    RetCode ret = engine->Range("", "", visitor);
+    assert(ret == kSucc);
+    assert(visitor.seen == kvs);
+}
+
+// Records of fresh random keys, plus new values for some of the keys of
+// kvs and a key added twice; returns what a store holding kvs should
+// hold after ingesting them
+KVs build(const std::string &dir, int shards, const KVs &kvs, bool sorted) {
+    system(("mkdir -p " + dir).c_str());
+    KVs added;
+    for (int i = 0; i < KV_CNT; ++i) {
+        gen_random(k, i % 2 ? 4 : 17);
+        gen_random(v, 100 + (i * 53) % 8000);
+        added[k] = v;
+    }
+    int i = 0;
+    for (auto &kv : kvs) {
+        if (i++ % 3 == 0) added[kv.first] = "ingested" + std::to_string(i);
+    }
+
+    SegmentBuilder *builder = NULL;
+    RetCode ret = SegmentBuilder::Open(dir, shards, &builder);
+    assert(ret == kSucc);
+    if (sorted) {
+        for (auto &kv : added) {
+            ret = builder->Add(kv.first, kv.second);
+            assert(ret == kSucc);
+        }
+    } else {
+        // Reverse order, every key first with a value that is replaced
+        for (auto kv = added.rbegin(); kv != added.rend(); ++kv) {
+            ret = builder->Add(kv->first, "stale");
+            assert(ret == kSucc);
+        }
+        for (auto kv = added.rbegin(); kv != added.rend(); ++kv) {
+            ret = builder->Add(kv->first, kv->second);
+            assert(ret == kSucc);
+        }
+    }
+    ret = builder->Finish();
+    assert(ret == kSucc);
+    assert(builder->Add("late", "late") == kInvalidArgument);
+    delete builder;
+
+    KVs expect = kvs;
+    for (auto &kv : added) expect[kv.first] = kv.second;
+    return expect;
+}
+
+int main() {
+
+    printf_(
+        "======================= ingest test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    std::string dir = engine_path + "-segments";
+    Engine *engine = NULL;
+    Options options;
+    options.shards = SHARD_NUM;
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    KVs kvs;
+    for (int i = 0; i < KV_CNT; ++i) {
+        gen_random(k, i % 2 ? 4 : 17);
+        gen_random(v, 100 + (i * 37) % 8000);
+        kvs[k] = v;
+        ret = engine->Write(k, v);
+        assert(ret == kSucc);
+    }
+
+    // Built for another shard count, or missing: nothing changes
+    build(dir + "-2", 2, kvs, true);
+    assert(engine->Ingest(dir + "-2") == kInvalidArgument);
+    assert(engine->Ingest(dir + "-none") == kIOError);
+    check(engine, kvs);
+
+    const Snapshot *snapshot = NULL;
+    ret = engine->GetSnapshot(&snapshot);
+    assert(ret == kSucc);
+    KVs before = kvs;
+
+    KVs expect = build(dir, SHARD_NUM, kvs, false);
+    ret = engine->Ingest(dir);
+    assert(ret == kSucc);
+    check(engine, expect);
+
+    // Snapshots taken before do not see the ingested records
+    CollectVisitor old;
+    ret = engine->RangeAt(snapshot, "", "", old);
+    assert(ret == kSucc);
+    assert(old.seen == before);
+    ret = engine->ReleaseSnapshot(snapshot);
+    assert(ret == kSucc);
+
+    // Writes go on over ingested keys
+    std::string first = expect.begin()->first;
+    ret = engine->Write(first, "written");
+    assert(ret == kSucc);
+    expect[first] = "written";
+    delete engine;
+
+    // The store keeps its own links to the segments
+    system(("rm -rf " + dir).c_str());
+    ret = Engine::Open(engine_path, &engine);
+    assert(ret == kSucc);
+    check(engine, expect);
+
+    // A second, sorted, segment on top, which scans running alongside
+    // see all of or none of
+    before = expect;
+    expect = build(dir, SHARD_NUM, expect, true);
+    std::atomic<bool> done(false);
+    std::atomic<int> scans(0);
+    std::thread scanner([&] {
+        while (!done) {
+            CollectVisitor seen;
+            assert(engine->Range("", "", seen) == kSucc);
+            assert(seen.seen == before || seen.seen == expect);
+            ++scans;
+        }
+    });
+    while (scans == 0) usleep(100);
+    ret = engine->Ingest(dir);
+    assert(ret == kSucc);
+    done = true;
+    scanner.join();
+    check(engine, expect);
+
+    // A write after the ingest stands when it is redone on opening
+    std::string last;
+    for (auto &kv : expect) {
+        if (before.count(kv.first) == 0) last = kv.first;
+    }
+    std::string ingested = expect[last];
+    ret = engine->Write(last, "after");
+    assert(ret == kSucc);
+    expect[last] = "after";
+    delete engine;
+
+    ret = Engine::Open(engine_path, &engine);
+    assert(ret == kSucc);
+    check(engine, expect);
+    delete engine;
+
+    // As if the ingest stopped partway, from a log that ended before
+    // anything was written and past everything
+    std::ofstream(engine_path + ".manifest", std::ios::app) << "ingest 0 0 0 0\n";
+    ret = Engine::Open(engine_path, &engine);
+    assert(ret == kSucc);
+    check(engine, expect);
+    delete engine;
+    std::ofstream(engine_path + ".manifest", std::ios::app) <<
+        "ingest 281474976710656 281474976710656 281474976710656 281474976710656\n";
+    ret = Engine::Open(engine_path, &engine);
+    assert(ret == kSucc);
+    expect[last] = ingested;
+    check(engine, expect);
+    delete engine;
+
+    // A segment linked by an ingest that was never committed goes
+    std::string shard0 = engine_path + ".shard0.data.seg";
+    assert(access((shard0 + "2").c_str(), F_OK) == 0);
+    assert(link((shard0 + "2").c_str(), (shard0 + "3").c_str()) == 0);
+    ret = Engine::Open(engine_path, &engine);
+    assert(ret == kSucc);
+    assert(access((shard0 + "3").c_str(), F_OK) != 0);
+    check(engine, expect);
+    delete engine;
+
+    ret = Engine::Open("example:" + engine_path + "-example", &engine);
+    assert(ret == kSucc);
+    assert(engine->Ingest(dir) == kNotSupported);
+    delete engine;
+
+    printf_(
+        "======================= ingest test pass :) "
+        "======================");
+
+    return 0;
+}
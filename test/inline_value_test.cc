@@ -0,0 +1,89 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 5000
+
+char k[1024];
+char v[1024];
+std::string ks[KV_CNT];
+std::string vs[KV_CNT];
+
+// Values of 0 to 16 bytes, around the inline limit, and some large ones
+std::string make_value(int i, int round) {
+    int len = (i + round) % 20 == 19 ? 600 : (i + round) % 17;
+    gen_random(v, len);
+    return std::string(v, len);
+}
+
+void check(Engine *engine) {
+    std::string value;
+    for (int i = 0; i < KV_CNT; ++i) {
+        RetCode ret = engine->Read(ks[i], &value);
+        assert(ret == kSucc);
+        assert(value == vs[i]);
+    }
+}
+
+int main() {
+    printf_(
+        "======================= inline value test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    Engine *engine = NULL;
+    RetCode ret = Engine::Open(engine_path, &engine);
+    assert(ret == kSucc);
+
+    // Short and long keys alike
+    for (int i = 0; i < KV_CNT; ++i) {
+        gen_random(k, i % 2 ? 4 : 20);
+        ks[i] = std::string(k) + std::to_string(i);
+        vs[i] = make_value(i, 0);
+        ret = engine->Write(ks[i], vs[i]);
+        assert(ret == kSucc);
+    }
+    check(engine);
+
+    // Overwrites move keys between inline and logged values, while a
+    // snapshot still reads the old ones
+    const Snapshot *snap = NULL;
+    ret = engine->GetSnapshot(&snap);
+    assert(ret == kSucc);
+    std::string old[KV_CNT];
+    for (int i = 0; i < KV_CNT; ++i) {
+        old[i] = vs[i];
+        vs[i] = make_value(i, 1);
+        ret = engine->Write(ks[i], vs[i]);
+        assert(ret == kSucc);
+    }
+    check(engine);
+    std::string value;
+    for (int i = 0; i < KV_CNT; ++i) {
+        ret = engine->ReadAt(snap, ks[i], &value);
+        assert(ret == kSucc);
+        assert(value == old[i]);
+    }
+    ret = engine->ReleaseSnapshot(snap);
+    assert(ret == kSucc);
+    delete engine;
+
+    // Inline values are rebuilt from the log on open
+    ret = Engine::Open(engine_path, &engine);
+    assert(ret == kSucc);
+    check(engine);
+    delete engine;
+
+    printf_(
+        "======================= inline value test pass :) "
+        "======================");
+    return 0;
+}
@@ -0,0 +1,249 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 3000
+#define SHARD_NUM 4
+
+char k[1024];
+char v[9024];
+
+typedef std::map<std::string, std::string> KVs;
+
+class CollectBatches : public BatchVisitor {
+ public:
+    KVs seen;
+    std::string last;
+    bool ordered = true;
+    size_t batches = 0;
+    size_t max_batch = 0;
+
+    void Visit(const PolarString *keys, const PolarString *values, size_t n) {
+        ++batches;
+        max_batch = std::max(max_batch, n);
+        for (size_t i = 0; i < n; ++i) {
+            if (!seen.empty() && keys[i].ToString() <= last) ordered = false;
+            last = keys[i].ToString();
+            seen[last] = values[i].ToString();
+        }
+    }
+};
+
+// Walks the whole iterator both ways and checks it against kvs
+void check_walk(Engine *engine, const KVs &kvs, IteratorOptions options) {
+    Iterator *it = NULL;
+    RetCode ret = engine->NewIterator(options, &it);
+    assert(ret == kSucc);
+    assert(!it->Valid());
+
+    KVs expect;
+    for (auto &kv : kvs) {
+        if ((options.lower.empty() || kv.first >= options.lower) &&
+            (options.upper.empty() || kv.first < options.upper)) {
+            expect.insert(kv);
+        }
+    }
+
+    auto e = expect.begin();
+    for (it->SeekToFirst(); it->Valid(); it->Next(), ++e) {
+        assert(e != expect.end());
+        assert(it->key().ToString() == e->first);
+        if (options.keys_only) {
+            assert(it->value().empty());
+        } else {
+            assert(it->value().ToString() == e->second);
+            assert(it->value().ToString() == e->second);
+        }
+    }
+    assert(e == expect.end());
+
+    auto r = expect.rbegin();
+    for (it->SeekToLast(); it->Valid(); it->Prev(), ++r) {
+        assert(r != expect.rend());
+        assert(it->key().ToString() == r->first);
+        if (!options.keys_only) assert(it->value().ToString() == r->second);
+    }
+    assert(r == expect.rend());
+    delete it;
+}
+
+void check_seek(Engine *engine, const KVs &kvs) {
+    Iterator *it = NULL;
+    RetCode ret = engine->NewIterator(IteratorOptions(), &it);
+    assert(ret == kSucc);
+    for (int i = 0; i < 500; ++i) {
+        std::string target;
+        if (i % 3 == 0) {
+            // An existing key
+            auto e = kvs.begin();
+            std::advance(e, i % kvs.size());
+            target = e->first;
+        } else {
+            gen_random(k, 1 + i % 20);
+            target = k;
+        }
+
+        auto e = kvs.lower_bound(target);
+        it->Seek(target);
+        assert(it->Valid() == (e != kvs.end()));
+        if (e != kvs.end()) {
+            assert(it->key().ToString() == e->first);
+            assert(it->value().ToString() == e->second);
+            // Change direction from here
+            it->Prev();
+            if (e == kvs.begin()) {
+                assert(!it->Valid());
+            } else {
+                assert(it->key().ToString() == std::prev(e)->first);
+                it->Next();
+                assert(it->key().ToString() == e->first);
+            }
+        }
+
+        e = kvs.upper_bound(target);
+        it->SeekForPrev(target);
+        assert(it->Valid() == (e != kvs.begin()));
+        if (e != kvs.begin()) {
+            --e;
+            assert(it->key().ToString() == e->first);
+            assert(it->value().ToString() == e->second);
+        }
+    }
+    delete it;
+}
+
+void check_batch(Engine *engine, const KVs &kvs, size_t batch_size) {
+    CollectBatches visitor;
+    RetCode ret = engine->RangeBatch("", "", visitor, batch_size);
+    assert(ret == kSucc);
+    assert(visitor.ordered);
+    assert(visitor.seen == kvs);
+    assert(visitor.max_batch <= batch_size);
+    assert(visitor.batches == (kvs.size() + batch_size - 1) / batch_size);
+}
+
+void run(Engine *engine, const KVs &kvs) {
+    IteratorOptions options;
+    check_walk(engine, kvs, options);
+    options.readahead = 0;
+    check_walk(engine, kvs, options);
+    options.readahead = 16;
+    options.keys_only = true;
+    check_walk(engine, kvs, options);
+    options.keys_only = false;
+    options.lower = "B";
+    options.upper = "d";
+    check_walk(engine, kvs, options);
+    options.lower = "zzzz";
+    options.upper = "";
+    check_walk(engine, kvs, options);
+
+    check_seek(engine, kvs);
+
+    check_batch(engine, kvs, 1);
+    check_batch(engine, kvs, 7);
+    check_batch(engine, kvs, 256);
+    check_batch(engine, kvs, KV_CNT * 2);
+    CollectBatches visitor;
+    assert(engine->RangeBatch("", "", visitor, 0) == kInvalidArgument);
+}
+
+int main() {
+
+    printf_(
+        "======================= iterator test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    Engine *engine = NULL;
+    Options options;
+    options.shards = SHARD_NUM;
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    KVs kvs;
+    for (int i = 0; i < KV_CNT; ++i) {
+        // Mix short (hashed) and long keys
+        gen_random(k, i % 2 ? 4 : 17);
+        gen_random(v, 100 + (i * 37) % 8000);
+        kvs[k] = v;
+        ret = engine->Write(k, v);
+        assert(ret == kSucc);
+    }
+    run(engine, kvs);
+
+    // Neither keys nor values written after the iterator was created
+    // are seen
+    Iterator *it = NULL;
+    ret = engine->NewIterator(IteratorOptions(), &it);
+    assert(ret == kSucc);
+    std::string first = kvs.begin()->first;
+    std::string old = kvs.begin()->second;
+    engine->Write(first, "updated");
+    kvs[first] = "updated";
+    engine->Write("", "");
+    gen_random(k, 17);
+    engine->Write(k, "new");
+    it->SeekToFirst();
+    assert(it->key().ToString() == first);
+    assert(it->value().ToString() == old);
+    it->Seek(k);
+    assert(!it->Valid() || it->key().ToString() != k);
+    delete it;
+    kvs[""] = "";
+    kvs[k] = "new";
+
+    // Nor are writes made halfway through a walk, past the keys the
+    // cursors have copied so far
+    ret = engine->NewIterator(IteratorOptions(), &it);
+    assert(ret == kSucc);
+    auto e = kvs.begin();
+    it->SeekToFirst();
+    for (size_t i = 0; i < kvs.size() / 2; ++i, ++e, it->Next()) {
+        assert(it->key().ToString() == e->first);
+    }
+    KVs later = kvs;
+    for (auto r = kvs.rbegin(); r != kvs.rend(); ++r) {
+        engine->Write(r->first, "late");
+        later[r->first] = "late";
+        gen_random(k, r->first.size() % 2 ? 4 : 17);
+        engine->Write(k, "late");
+        later[k] = "late";
+    }
+    for (; it->Valid(); ++e, it->Next()) {
+        assert(e != kvs.end());
+        assert(it->key().ToString() == e->first);
+        assert(it->value().ToString() == e->second);
+    }
+    assert(e == kvs.end());
+    delete it;
+    kvs = later;
+    delete engine;
+
+    // Values now come from the log files, with readahead
+    ret = Engine::Open(engine_path, &engine);
+    assert(ret == kSucc);
+    run(engine, kvs);
+    delete engine;
+
+    // Engines without an iterator say so
+    ret = Engine::Open("example:" + engine_path + "-example", &engine);
+    assert(ret == kSucc);
+    ret = engine->NewIterator(IteratorOptions(), &it);
+    assert(ret == kNotSupported);
+    delete engine;
+
+    printf_(
+        "======================= iterator test pass :) "
+        "======================");
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 20000
+#define GROW_CNT 10000
+#define READERS 4
+
+// Counts the allocations of each thread, so the engine's own threads
+// do not count against the reads of main
+thread_local uint64_t allocs = 0;
+
+void *operator new(size_t n) {
+    ++allocs;
+    void *p = malloc(n ? n : 1);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+char k[1024];
+char v[1024];
+std::string ks[KV_CNT];
+std::string vs[KV_CNT];
+
+void check(Engine *engine) {
+    std::string value;
+    for (int i = 0; i < KV_CNT; ++i) {
+        RetCode ret = engine->Read(ks[i], &value);
+        assert(ret == kSucc);
+        assert(value == vs[i]);
+        // A longer or shorter key sharing the prefix is another key
+        ret = engine->Read(PolarString(ks[i].data(), ks[i].size() - 1), &value);
+        assert(ret == kNotFound || ks[i].size() - 1 <= 8);
+    }
+}
+
+int main() {
+    printf_(
+        "======================= long key test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    // 9 to 200 bytes, the distinct counter suffix last
+    for (int i = 0; i < KV_CNT; ++i) {
+        gen_random(k, 4 + i % 192);
+        ks[i] = std::string(k) + std::to_string(10000 + i);
+        gen_random(v, 1 + i % 512);
+        vs[i] = v;
+    }
+
+    Options options;
+    options.shards = 2;
+    Engine *engine = NULL;
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+    for (int i = 0; i < KV_CNT; ++i) {
+        ret = engine->Write(ks[i], std::to_string(i));
+        assert(ret == kSucc);
+    }
+    for (int i = 0; i < KV_CNT; ++i) {
+        ret = engine->Write(ks[i], vs[i]);
+        assert(ret == kSucc);
+    }
+    check(engine);
+
+    Stats stats;
+    ret = engine->GetStats(&stats);
+    assert(ret == kSucc);
+    assert(stats.keys == KV_CNT);
+
+    // Lookups, hits and misses alike, allocate nothing
+    std::string value;
+    value.reserve(1024);
+    for (int i = 0; i < KV_CNT; ++i) engine->Read(ks[i], &value);
+    uint64_t before = allocs;
+    for (int i = 0; i < KV_CNT; ++i) {
+        ret = engine->Read(ks[i], &value);
+        assert(ret == kSucc);
+        ret = engine->Read(PolarString(ks[i].data(), ks[i].size() - 1), &value);
+    }
+    assert(allocs == before);
+    delete engine;
+
+    ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+    check(engine);
+    delete engine;
+
+    // Reads find every key written before them while writes grow the
+    // index under them
+    options.shards = 1;
+    ret = Engine::Open(engine_path + "-grow", options, &engine);
+    assert(ret == kSucc);
+    std::atomic<int> written(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < READERS; ++t) {
+        readers.push_back(std::thread([&, t]() {
+            std::string value;
+            unsigned seed = t;
+            int n;
+            while ((n = written.load()) < GROW_CNT) {
+                if (n == 0) continue;
+                int i = rand_r(&seed) % n;
+                RetCode ret = engine->Read(ks[i], &value);
+                assert(ret == kSucc);
+                assert(value == vs[i]);
+            }
+        }));
+    }
+    for (int i = 0; i < GROW_CNT; ++i) {
+        ret = engine->Write(ks[i], vs[i]);
+        assert(ret == kSucc);
+        written.store(i + 1);
+    }
+    for (auto &t : readers) t.join();
+    delete engine;
+
+    printf_(
+        "======================= long key test pass :) "
+        "======================");
+    return 0;
+}
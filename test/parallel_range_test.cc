@@ -0,0 +1,258 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 3000
+#define SHARD_NUM 4
+#define LOAD_THREADS 8
+#define LOAD_CNT 40000
+
+char k[1024];
+char v[9024];
+
+typedef std::map<std::string, std::string> KVs;
+
+class CollectVisitor : public Visitor {
+ public:
+    KVs seen;
+    std::vector<std::string> order;
+    uint64_t bytes = 0;
+
+    void Visit(const PolarString &key, const PolarString &value) {
+        order.push_back(key.ToString());
+        seen[order.back()] = value.ToString();
+        bytes += key.size() + value.size();
+    }
+};
+
+class CollectFactory : public VisitorFactory {
+ public:
+    std::vector<CollectVisitor> visitors;
+    std::vector<std::pair<std::string, std::string> > bounds;
+
+    explicit CollectFactory(size_t n) : visitors(n) {}
+
+    Visitor *NewVisitor(size_t partition, const PolarString &lower,
+                        const PolarString &upper) {
+        assert(partition == bounds.size());
+        bounds.push_back(std::make_pair(lower.ToString(), upper.ToString()));
+        return &visitors[partition];
+    }
+};
+
+// Every ordered mode visit happens on the calling thread, so all
+// partitions may share one visitor
+class SharedFactory : public VisitorFactory {
+ public:
+    CollectVisitor visitor;
+
+    Visitor *NewVisitor(size_t partition, const PolarString &lower,
+                        const PolarString &upper) {
+        return &visitor;
+    }
+};
+
+uint64_t bytes_of(const KVs &kvs, const std::string &lower,
+                  const std::string &upper) {
+    uint64_t n = 0;
+    for (auto &kv : kvs) {
+        if ((lower.empty() || kv.first >= lower) &&
+            (upper.empty() || kv.first < upper)) {
+            n += kv.first.size() + kv.second.size();
+        }
+    }
+    return n;
+}
+
+void check_partitions(Engine *engine, const KVs &kvs, size_t n) {
+    CollectFactory factory(n);
+    RetCode ret = engine->ParallelRange("", "", n, factory);
+    assert(ret == kSucc);
+    size_t parts = factory.bounds.size();
+    assert(parts >= 1 && parts <= n);
+    assert(factory.bounds[0].first.empty());
+    assert(factory.bounds[parts - 1].second.empty());
+
+    KVs all;
+    uint64_t total = bytes_of(kvs, "", ""), max_bytes = 0;
+    for (size_t i = 0; i < parts; ++i) {
+        const CollectVisitor &vis = factory.visitors[i];
+        if (i) assert(factory.bounds[i].first == factory.bounds[i - 1].second);
+        for (size_t j = 0; j < vis.order.size(); ++j) {
+            if (j) assert(vis.order[j - 1] < vis.order[j]);
+            assert(vis.order[j] >= factory.bounds[i].first);
+            assert(factory.bounds[i].second.empty() ||
+                   vis.order[j] < factory.bounds[i].second);
+        }
+        all.insert(vis.seen.begin(), vis.seen.end());
+        max_bytes = std::max(max_bytes, vis.bytes);
+    }
+    assert(all == kvs);
+    // Balanced to within the sampling granularity
+    if (n <= 16) {
+        assert(parts == n);
+        assert(max_bytes <= 2 * total / n);
+    }
+}
+
+void run(Engine *engine, const KVs &kvs) {
+    uint64_t size = 0;
+    RetCode ret = engine->ApproximateSize("", "", &size);
+    assert(ret == kSucc);
+    assert(size == bytes_of(kvs, "", ""));
+    ret = engine->ApproximateSize("B", "d", &size);
+    assert(ret == kSucc);
+    assert(size == bytes_of(kvs, "B", "d"));
+    ret = engine->ApproximateSize("d", "B", &size);
+    assert(ret == kSucc);
+    assert(size == 0);
+
+    check_partitions(engine, kvs, 1);
+    check_partitions(engine, kvs, 4);
+    check_partitions(engine, kvs, 16);
+    check_partitions(engine, kvs, KV_CNT * 2);
+
+    SharedFactory shared;
+    ret = engine->ParallelRange("", "", 8, shared, true);
+    assert(ret == kSucc);
+    assert(shared.visitor.seen == kvs);
+    for (size_t j = 1; j < shared.visitor.order.size(); ++j) {
+        assert(shared.visitor.order[j - 1] < shared.visitor.order[j]);
+    }
+
+    SharedFactory bounded;
+    ret = engine->ParallelRange("B", "d", 3, bounded, true);
+    assert(ret == kSucc);
+    for (auto &key : bounded.visitor.order) assert(key >= "B" && key < "d");
+    assert(bounded.visitor.bytes == bytes_of(kvs, "B", "d"));
+
+    assert(engine->ParallelRange("", "", 0, shared) == kInvalidArgument);
+}
+
+uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void load(Engine *engine, int t) {
+    char key[32], value[64];
+    for (int i = 0; i < LOAD_CNT; ++i) {
+        snprintf(key, sizeof(key), "load-%d-%d", t, i);
+        gen_random(value, 32);
+        assert(engine->Write(key, value) == kSucc);
+    }
+}
+
+// Writes until stop, noting when each one returned
+void keep_writing(Engine *engine, std::atomic<bool> *stop,
+                  std::atomic<size_t> *n, std::vector<uint64_t> *done) {
+    char key[32], value[64];
+    for (size_t i = 0; !stop->load(); ++i) {
+        snprintf(key, sizeof(key), "more-%zu", i);
+        gen_random(value, 32);
+        assert(engine->Write(key, value) == kSucc);
+        done->push_back(now_us());
+        n->store(i + 1);
+    }
+}
+
+// The first ApproximateSize sorts in every key written so far, which
+// must not hold up the writes going on meanwhile
+void size_beside_writes(const std::string &path) {
+    Engine *engine = NULL;
+    Options options;
+    options.shards = 1;
+    RetCode ret = Engine::Open(path, options, &engine);
+    assert(ret == kSucc);
+    std::vector<std::thread> loaders;
+    for (int t = 0; t < LOAD_THREADS; ++t) {
+        loaders.push_back(std::thread(load, engine, t));
+    }
+    for (auto &th : loaders) th.join();
+
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> n(0);
+    std::vector<uint64_t> done;
+    std::thread writer(keep_writing, engine, &stop, &n, &done);
+    while (n.load() < 100) std::this_thread::yield();
+    uint64_t size = 0, start = now_us();
+    ret = engine->ApproximateSize("", "", &size);
+    uint64_t end = now_us();
+    stop = true;
+    writer.join();
+    assert(ret == kSucc);
+    assert(size >= (uint64_t)LOAD_THREADS * LOAD_CNT * 32);
+
+    // The longest the writes stood still while it ran
+    uint64_t last = start, gap = 0;
+    for (uint64_t t : done) {
+        if (t > start && t < end) {
+            gap = std::max(gap, t - last);
+            last = t;
+        }
+    }
+    gap = std::max(gap, end - last);
+    printf("approximate size took %lu us, writes stalled up to %lu us\n",
+           (unsigned long)(end - start), (unsigned long)gap);
+    assert(gap < (end - start) / 2);
+    delete engine;
+}
+
+int main() {
+
+    printf_(
+        "======================= parallel range test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    Engine *engine = NULL;
+    Options options;
+    options.shards = SHARD_NUM;
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    // An empty store makes one empty partition
+    CollectFactory empty(4);
+    ret = engine->ParallelRange("", "", 4, empty);
+    assert(ret == kSucc);
+    assert(empty.bounds.size() == 1 && empty.visitors[0].order.empty());
+
+    KVs kvs;
+    for (int i = 0; i < KV_CNT; ++i) {
+        // Mix short (hashed) and long keys
+        gen_random(k, i % 2 ? 4 : 17);
+        gen_random(v, 100 + (i * 37) % 8000);
+        kvs[k] = v;
+        ret = engine->Write(k, v);
+        assert(ret == kSucc);
+    }
+    run(engine, kvs);
+    delete engine;
+
+    ret = Engine::Open(engine_path, &engine);
+    assert(ret == kSucc);
+    run(engine, kvs);
+    delete engine;
+
+    size_beside_writes(engine_path + "-size");
+
+    printf_(
+        "======================= parallel range test pass :) "
+        "======================");
+
+    return 0;
+}
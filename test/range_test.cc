@@ -0,0 +1,128 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 3000
+#define SHARD_NUM 4
+
+char k[1024];
+char v[9024];
+
+class CollectVisitor : public Visitor {
+ public:
+    std::map<std::string, std::string> seen;
+    std::string last;
+    bool ordered = true;
+
+    void Visit(const PolarString &key, const PolarString &value) {
+        if (!seen.empty() && key.ToString() <= last) {
+            ordered = false;
+        }
+        last = key.ToString();
+        seen[last] = value.ToString();
+    }
+};
+
+void check_range(Engine *engine, const std::map<std::string, std::string> &kvs,
+                 const std::string &lower, const std::string &upper) {
+    CollectVisitor visitor;
+    RetCode ret = engine->Range(lower, upper, visitor);
+    assert(ret == kSucc);
+    assert(visitor.ordered);
+
+    std::map<std::string, std::string> expect;
+    for (auto &kv : kvs) {
+        if ((lower.empty() || kv.first >= lower) &&
+            (upper.empty() || kv.first < upper)) {
+            expect.insert(kv);
+        }
+    }
+    assert(visitor.seen == expect);
+}
+
+void run(const std::string &engine_path, Options options) {
+    Engine *engine = NULL;
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    std::map<std::string, std::string> kvs;
+    for (int i = 0; i < KV_CNT; ++i) {
+        // Mix short (hashed) and long keys
+        gen_random(k, i % 2 ? 4 : 17);
+        gen_random(v, 100 + (i * 37) % 8000);
+        kvs[k] = v;
+        ret = engine->Write(k, v);
+        assert(ret == kSucc);
+    }
+
+    Stats stats;
+    ret = engine->GetStats(&stats);
+    assert(ret == kSucc);
+    assert(stats.write.count() == KV_CNT);
+    assert(stats.keys == kvs.size());
+    assert(stats.write.Percentile(0.5) <= stats.write.Percentile(0.99));
+    assert(stats.write.Percentile(0.99) <= stats.write.max());
+
+    check_range(engine, kvs, "", "");
+    check_range(engine, kvs, "B", "d");
+    check_range(engine, kvs, "m", "");
+    check_range(engine, kvs, "", "5");
+    delete engine;
+
+    // The layout comes from the manifest on re-open, and re-opening
+    // twice must not lose meta written before the first one
+    options = Options();
+    options.shards = 1;
+    for (int round = 0; round < 2; ++round) {
+        ret = Engine::Open(engine_path, options, &engine);
+        assert(ret == kSucc);
+        std::string value;
+        for (auto &kv : kvs) {
+            ret = engine->Read(kv.first, &value);
+            assert(ret == kSucc);
+            assert(value == kv.second);
+        }
+        check_range(engine, kvs, "", "");
+        gen_random(k, 17);
+        kvs[k] = "round";
+        ret = engine->Write(k, "round");
+        assert(ret == kSucc);
+        delete engine;
+    }
+}
+
+int main() {
+
+    printf_(
+        "======================= range test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    Options options;
+    options.shards = SHARD_NUM;
+    run(engine_path, options);
+
+    // Striped over several log directories with meta kept apart
+    engine_path = std::string("./data/test-") + std::to_string(asm_rdtsc());
+    options.shards = 1;
+    options.log_dirs.push_back(engine_path + "-log0");
+    options.log_dirs.push_back(engine_path + "-log1");
+    options.meta_dir = engine_path + "-meta";
+    system(("mkdir -p " + options.log_dirs[0] + " " + options.log_dirs[1] +
+            " " + options.meta_dir).c_str());
+    run(engine_path, options);
+
+    printf_(
+        "======================= range test pass :) "
+        "======================");
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <assert.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 3000
+
+char k[1024];
+char v[9024];
+
+std::map<std::string, std::string> expected;
+
+class CountVisitor : public Visitor {
+public:
+    size_t n = 0;
+    void Visit(const PolarString &key, const PolarString &value) {
+        assert(expected.at(key.ToString()) == value.ToString());
+        ++n;
+    }
+};
+
+void write_batch(Engine *engine, int n) {
+    for (int i = 0; i < n; ++i) {
+        gen_random(k, 4 + i % 30);
+        gen_random(v, i % 3 ? 1 + i % 2000 : 1 + i % 8);
+        RetCode ret = engine->Write(k, v);
+        assert(ret == kSucc);
+        expected[k] = v;
+    }
+}
+
+void check(Engine *engine) {
+    std::string value;
+    for (auto &kv : expected) {
+        RetCode ret = engine->Read(kv.first, &value);
+        assert(ret == kSucc);
+        assert(value == kv.second);
+    }
+    CountVisitor visitor;
+    RetCode ret = engine->Range("", "", visitor);
+    assert(ret == kSucc);
+    assert(visitor.n == expected.size());
+}
+
+int main() {
+    printf_(
+        "======================= read only test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    Engine *reader = NULL;
+    RetCode ret = Engine::OpenReadOnly(engine_path, Options(), &reader);
+    assert(ret == kNotFound);
+    assert(reader == NULL);
+
+    Options options;
+    options.shards = 3;
+    Engine *writer = NULL;
+    ret = Engine::Open(engine_path, options, &writer);
+    assert(ret == kSucc);
+    write_batch(writer, KV_CNT);
+
+    // One writer at a time
+    Engine *second = NULL;
+    ret = Engine::Open(engine_path, options, &second);
+    assert(ret == kIOError);
+
+    // Readers run beside the writer and see what it had written
+    ret = Engine::OpenReadOnly(engine_path, Options(), &reader);
+    assert(ret == kSucc);
+    assert(access((engine_path + ".readers").c_str(), F_OK) != 0);
+    check(reader);
+    ret = reader->Write("key", "value");
+    assert(ret == kNotSupported);
+    ret = writer->Refresh();
+    assert(ret == kNotSupported);
+
+    // Later writes, new keys and overwrites, show after Refresh
+    std::map<std::string, std::string> before(expected);
+    write_batch(writer, KV_CNT);
+    for (auto &kv : expected) {
+        if (kv.second.size() % 5 == 0) {
+            kv.second += "x";
+            ret = writer->Write(kv.first, kv.second);
+            assert(ret == kSucc);
+        }
+    }
+    std::string value;
+    for (auto &kv : before) {
+        ret = reader->Read(kv.first, &value);
+        assert(ret == kSucc);
+        assert(value == kv.second);
+    }
+    ret = reader->Refresh();
+    assert(ret == kSucc);
+    check(reader);
+
+    // Reads go on while Refresh remaps the logs the writer grows
+    std::map<std::string, std::string> stable(expected);
+    std::atomic<bool> done(false);
+    std::thread r([&] {
+        std::string value;
+        while (!done) {
+            for (auto &kv : stable) {
+                assert(reader->Read(kv.first, &value) == kSucc);
+                assert(value == kv.second);
+            }
+        }
+    });
+    for (int i = 0; i < 5; ++i) {
+        write_batch(writer, KV_CNT);
+        ret = reader->Refresh();
+        assert(ret == kSucc);
+    }
+    done = true;
+    r.join();
+    check(reader);
+
+    // So does another process
+    pid_t pid = fork();
+    if (pid == 0) {
+        Engine *child = NULL;
+        ret = Engine::OpenReadOnly(engine_path, Options(), &child);
+        assert(ret == kSucc);
+        check(child);
+        delete child;
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // The reader outlives the writer, which can then reopen
+    delete writer;
+    check(reader);
+    ret = Engine::Open(engine_path, options, &writer);
+    assert(ret == kSucc);
+    delete writer;
+    delete reader;
+
+    printf_(
+        "======================= read only test pass :) "
+        "======================");
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 1000
+
+char k[1024];
+char v[9024];
+
+std::string ks[KV_CNT];
+std::string vs[KV_CNT];
+
+int custom_opens = 0;
+
+RetCode open_custom(const std::string &name, const Options &options,
+                    Engine **eptr) {
+    ++custom_opens;
+    return Engine::Open("example:" + name, options, eptr);
+}
+
+bool registered(const std::string &engine) {
+    std::vector<std::string> names = Engine::Registered();
+    return std::find(names.begin(), names.end(), engine) != names.end();
+}
+
+// Writes the same data through engine and reads it back after a reopen
+void round_trip(const std::string &name, const Options &options) {
+    printf("open engine_path: %s\n", name.c_str());
+    Engine *engine = NULL;
+    RetCode ret = Engine::Open(name, options, &engine);
+    assert(ret == kSucc);
+    for (int i = 0; i < KV_CNT; ++i) {
+        ret = engine->Write(ks[i], vs[i]);
+        assert(ret == kSucc);
+    }
+    delete engine;
+
+    ret = Engine::Open(name, options, &engine);
+    assert(ret == kSucc);
+    std::string value;
+    for (int i = 0; i < KV_CNT; ++i) {
+        ret = engine->Read(ks[i], &value);
+        assert(ret == kSucc);
+        assert(value == vs[i]);
+    }
+    delete engine;
+}
+
+int main() {
+    printf_(
+        "======================= registry test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+
+    for (int i = 0; i < KV_CNT; ++i) {
+        gen_random(k, 11);
+        ks[i] = std::string(k) + std::to_string(i);
+        gen_random(v, 1 + i * 7 % 4096);
+        vs[i] = v;
+    }
+
+    assert(registered("race"));
+    assert(registered("example"));
+
+    // The same data set through each engine, chosen by prefix or option
+    Options options;
+    round_trip("race:" + engine_path + "-race", options);
+    round_trip("example:" + engine_path + "-example", options);
+    options.engine = "example";
+    round_trip(engine_path + "-option", options);
+
+    Engine *engine = NULL;
+    options.engine = "missing";
+    RetCode ret = Engine::Open(engine_path + "-missing", options, &engine);
+    assert(ret == kNotSupported);
+    assert(engine == NULL);
+
+    assert(Engine::Register("custom", open_custom) == kSucc);
+    assert(Engine::Register("custom", open_custom) == kInvalidArgument);
+    assert(Engine::Register("a:b", open_custom) == kInvalidArgument);
+    assert(registered("custom"));
+    round_trip("custom:" + engine_path + "-custom", Options());
+    assert(custom_opens == 2);
+
+    printf_(
+        "======================= registry test pass :) "
+        "======================");
+    return 0;
+}
@@ -5,3 +5,31 @@ echo --------------------------------------
 ./multi_thread_test
 echo --------------------------------------
 ./crash_test
+echo --------------------------------------
+./range_test
+echo --------------------------------------
+./registry_test
+echo --------------------------------------
+./stall_test
+echo --------------------------------------
+./iterator_test
+echo --------------------------------------
+./parallel_range_test
+echo --------------------------------------
+./snapshot_test
+echo --------------------------------------
+./ingest_test
+echo --------------------------------------
+./fixed_test
+echo --------------------------------------
+./long_key_test
+echo --------------------------------------
+./inline_value_test
+echo --------------------------------------
+./read_only_test
+echo --------------------------------------
+./checkpoint_test
+echo --------------------------------------
+./change_stream_test
+echo --------------------------------------
+./hot_cache_test
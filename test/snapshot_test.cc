@@ -0,0 +1,189 @@
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define KV_CNT 2000
+#define SHARD_NUM 4
+
+char k[1024];
+char v[9024];
+
+typedef std::map<std::string, std::string> KVs;
+
+class CollectVisitor : public Visitor {
+ public:
+    KVs seen;
+
+    void Visit(const PolarString &key, const PolarString &value) {
+        seen[key.ToString()] = value.ToString();
+    }
+};
+
+// What every way of reading at snapshot sees must be kvs
+void check_view(Engine *engine, const Snapshot *snapshot, const KVs &kvs) {
+    std::string value;
+    for (auto &kv : kvs) {
+        RetCode ret = engine->ReadAt(snapshot, kv.first, &value);
+        assert(ret == kSucc);
+        assert(value == kv.second);
+    }
+
+    CollectVisitor visitor;
+    RetCode ret = engine->RangeAt(snapshot, "", "", visitor);
+    assert(ret == kSucc);
+    assert(visitor.seen == kvs);
+
+    IteratorOptions options;
+    options.snapshot = snapshot;
+    Iterator *it = NULL;
+    ret = engine->NewIterator(options, &it);
+    assert(ret == kSucc);
+    KVs seen;
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        seen[it->key().ToString()] = it->value().ToString();
+    }
+    assert(seen == kvs);
+    delete it;
+}
+
+uint64_t versions(Engine *engine) {
+    Stats stats;
+    RetCode ret = engine->GetStats(&stats);
+    assert(ret == kSucc);
+    return stats.versions;
+}
+
+// Overwrites every other key with a value tagged by round
+void overwrite(Engine *engine, KVs *kvs, const std::string &round) {
+    int i = 0;
+    for (auto &kv : *kvs) {
+        if (i++ % 2) continue;
+        kv.second = round + kv.second.substr(0, 100);
+        RetCode ret = engine->Write(kv.first, kv.second);
+        assert(ret == kSucc);
+    }
+}
+
+int main() {
+
+    printf_(
+        "======================= snapshot test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+    Engine *engine = NULL;
+    Options options;
+    options.shards = SHARD_NUM;
+    RetCode ret = Engine::Open(engine_path, options, &engine);
+    assert(ret == kSucc);
+    printf("open engine_path: %s\n", engine_path.c_str());
+
+    KVs v1;
+    for (int i = 0; i < KV_CNT; ++i) {
+        // Mix short (hashed) and long keys
+        gen_random(k, i % 2 ? 4 : 17);
+        gen_random(v, 100 + (i * 37) % 8000);
+        v1[k] = v;
+        ret = engine->Write(k, v);
+        assert(ret == kSucc);
+    }
+
+    // Nothing is kept while no snapshot is live
+    KVs latest = v1;
+    overwrite(engine, &latest, "r0");
+    v1 = latest;
+    assert(versions(engine) == 0);
+
+    const Snapshot *s1 = NULL;
+    ret = engine->GetSnapshot(&s1);
+    assert(ret == kSucc);
+
+    // Overwritten twice while s1 is live: only the version s1 sees is kept
+    overwrite(engine, &latest, "r1");
+    overwrite(engine, &latest, "r2");
+    KVs v2 = latest;
+    assert(versions(engine) == (v1.size() + 1) / 2);
+
+    // Keys added after s1 are not in it
+    gen_random(k, 17);
+    ret = engine->Write(k, "new");
+    assert(ret == kSucc);
+    latest[k] = "new";
+    std::string value;
+    assert(engine->ReadAt(s1, k, &value) == kNotFound);
+
+    const Snapshot *s2 = NULL;
+    ret = engine->GetSnapshot(&s2);
+    assert(ret == kSucc);
+    overwrite(engine, &latest, "r3");
+
+    check_view(engine, s1, v1);
+    v2[k] = "new";
+    check_view(engine, s2, v2);
+    check_view(engine, NULL, latest);
+
+    // Releasing s1 drops what only it could see
+    ret = engine->ReleaseSnapshot(s1);
+    assert(ret == kSucc);
+    assert(versions(engine) == (latest.size() + 1) / 2);
+    check_view(engine, s2, v2);
+    ret = engine->ReleaseSnapshot(s2);
+    assert(ret == kSucc);
+    assert(versions(engine) == 0);
+
+    // A snapshot reads the same while writers keep going, and while other
+    // snapshots come and go, pruning versions from under its readers
+    std::atomic<bool> stop(false);
+    std::thread writer([&] {
+        for (int r = 0; !stop; ++r) {
+            KVs mine = latest;
+            overwrite(engine, &mine, "w" + std::to_string(r));
+        }
+    });
+    std::thread churn([&] {
+        while (!stop) {
+            const Snapshot *s = NULL;
+            assert(engine->GetSnapshot(&s) == kSucc);
+            usleep(100);
+            assert(engine->ReleaseSnapshot(s) == kSucc);
+        }
+    });
+    for (int i = 0; i < 5; ++i) {
+        const Snapshot *s = NULL;
+        ret = engine->GetSnapshot(&s);
+        assert(ret == kSucc);
+        CollectVisitor first;
+        ret = engine->RangeAt(s, "", "", first);
+        assert(ret == kSucc);
+        assert(first.seen.size() == latest.size());
+        check_view(engine, s, first.seen);
+        ret = engine->ReleaseSnapshot(s);
+        assert(ret == kSucc);
+    }
+    stop = true;
+    writer.join();
+    churn.join();
+    delete engine;
+
+    ret = Engine::Open("example:" + engine_path + "-example", &engine);
+    assert(ret == kSucc);
+    const Snapshot *s = NULL;
+    assert(engine->GetSnapshot(&s) == kNotSupported);
+    delete engine;
+
+    printf_(
+        "======================= snapshot test pass :) "
+        "======================");
+
+    return 0;
+}
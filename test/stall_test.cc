@@ -0,0 +1,151 @@
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/engine.h"
+#include "test_util.h"
+
+using namespace polar_race;
+
+#define THREAD_NUM 4
+#define KV_CNT 2000
+#define LOG_SIZE 64
+
+void worker(Engine *engine, int id) {
+    char k[64];
+    char v[4096];
+    std::string value;
+    for (int i = 0; i < KV_CNT; ++i) {
+        gen_random(k, 20);
+        gen_random(v, 1 + i % 4000);
+        std::string key = std::string(k) + std::to_string(id);
+        RetCode ret = engine->Write(key, v);
+        assert(ret == kSucc);
+        ret = engine->Read(key, &value);
+        assert(ret == kSucc);
+    }
+}
+
+void run(const std::string &path, const Options &options) {
+    printf("open engine_path: %s\n", path.c_str());
+    Engine *engine = NULL;
+    RetCode ret = Engine::Open(path, options, &engine);
+    assert(ret == kSucc);
+    std::vector<std::thread> ths;
+    for (int i = 0; i < THREAD_NUM; ++i) {
+        ths.push_back(std::thread(worker, engine, i));
+    }
+    for (auto &t : ths) t.join();
+
+    std::vector<StallEvent> events;
+    ret = engine->GetStallEvents(&events);
+    Stats stats;
+    assert(engine->GetStats(&stats) == kSucc);
+    if (options.stall_threshold_ns == 0) {
+        assert(ret == kNotSupported);
+        assert(stats.stalls == 0);
+    } else if (options.stall_threshold_ns == 1) {
+        // Every wait counts, so the log fills and wraps
+        assert(ret == kSucc);
+        assert(events.size() == LOG_SIZE);
+        assert(stats.stalls > LOG_SIZE);
+
+        std::set<std::string> causes = {
+            "journal_mtx", "DataBlk::op", "p_disk_mtx", "chunk_load",
+            "flush_index", "file_grow", "flush_copy", "meta_write"};
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        uint64_t now = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        for (auto &e : events) {
+            assert(e.op == "write" || e.op == "read");
+            assert(causes.count(e.cause));
+            assert(e.duration_ns >= 1);
+            assert(e.time_ns <= now && now - e.time_ns < 600000000000ull);
+            assert(e.flush_batch <= 32);
+            if (e.op == "read") assert(e.flush_batch == 0);
+        }
+    } else {
+        assert(ret == kSucc);
+        assert(events.empty());
+        assert(stats.stalls == 0);
+    }
+    delete engine;
+}
+
+size_t count(const std::string &path, const std::string &what) {
+    FILE *f = fopen(path.c_str(), "r");
+    assert(f != NULL);
+    std::string s;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.append(buf, n);
+    fclose(f);
+    size_t c = 0;
+    for (size_t p = s.find(what); p != std::string::npos; p = s.find(what, p + 1)) {
+        ++c;
+    }
+    return c;
+}
+
+// Each engine dumps only the operations made on it
+void trace(const std::string &path) {
+    Options options;
+    options.trace_sample = 1;
+    Engine *engine = NULL;
+    RetCode ret = Engine::Open(path + "-a", options, &engine);
+    assert(ret == kSucc);
+    std::thread([engine] {
+        for (int i = 0; i < 10; ++i) {
+            RetCode ret = engine->Write("key" + std::to_string(i), "value");
+            assert(ret == kSucc);
+        }
+    }).join();
+    ret = engine->DumpTrace(path + "-a.json");
+    assert(ret == kSucc);
+    assert(count(path + "-a.json", "\"write\"") == 10);
+    delete engine;
+
+    ret = Engine::Open(path + "-b", options, &engine);
+    assert(ret == kSucc);
+    std::string value;
+    for (int i = 0; i < 3; ++i) {
+        ret = engine->Read("key", &value);
+        assert(ret == kNotFound);
+    }
+    ret = engine->DumpTrace(path + "-b.json");
+    assert(ret == kSucc);
+    assert(count(path + "-b.json", "\"write\"") == 0);
+    assert(count(path + "-b.json", "\"read\"") == 3);
+    delete engine;
+}
+
+int main() {
+    printf_(
+        "======================= stall test "
+        "============================");
+    std::string engine_path =
+        std::string("./data/test-") + std::to_string(asm_rdtsc());
+
+    Options options;
+    options.shards = 2;
+    run(engine_path + "-off", options);
+
+    options.stall_threshold_ns = 1;
+    options.stall_log_size = LOG_SIZE;
+    run(engine_path + "-all", options);
+
+    options.stall_threshold_ns = 3600ull * 1000000000ull;
+    run(engine_path + "-none", options);
+
+    trace(engine_path + "-trace");
+
+    printf_(
+        "======================= stall test pass :) "
+        "======================");
+    return 0;
+}